@@ -45,6 +45,18 @@ struct ffdata {
 	xbps_dictionary_t filesd;
 };
 
+static const char *
+file_type_string(const char *keyname)
+{
+	if (strcmp(keyname, "files") == 0)
+		return "regular file";
+	else if (strcmp(keyname, "links") == 0)
+		return "link";
+	else if (strcmp(keyname, "conf_files") == 0)
+		return "configuration file";
+	return NULL;
+}
+
 static void
 match_files_by_pattern(xbps_dictionary_t pkg_filesd,
 		       xbps_dictionary_keysym_t key,
@@ -56,13 +68,7 @@ match_files_by_pattern(xbps_dictionary_t pkg_filesd,
 
 	keyname = xbps_dictionary_keysym_cstring_nocopy(key);
 
-	if (strcmp(keyname, "files") == 0)
-		typestr = "regular file";
-	else if (strcmp(keyname, "links") == 0)
-		typestr = "link";
-	else if (strcmp(keyname, "conf_files") == 0)
-		typestr = "configuration file";
-	else
+	if ((typestr = file_type_string(keyname)) == NULL)
 		return;
 
 	array = xbps_dictionary_get_keysym(pkg_filesd, key);
@@ -127,6 +133,40 @@ ownedby_pkgdb_cb(struct xbps_handle *xhp,
 }
 
 
+/*
+ * A pattern without wildcards can only match a single path, whose
+ * owners are found in the files database of the pkgdb.
+ */
+static int
+ownedby_path(struct xbps_handle *xhp, const char *path)
+{
+	xbps_array_t owners;
+
+	owners = xbps_pkgdb_get_file_owners(xhp, path);
+	for (unsigned int i = 0; i < xbps_array_count(owners); i++) {
+		xbps_dictionary_t owner, pkgd;
+		const char *pkgname = NULL, *pkgver = NULL, *type = NULL;
+		const char *tgt = NULL, *typestr;
+
+		owner = xbps_array_get(owners, i);
+		xbps_dictionary_get_cstring_nocopy(owner, "pkgname", &pkgname);
+		xbps_dictionary_get_cstring_nocopy(owner, "type", &type);
+		xbps_dictionary_get_cstring_nocopy(owner, "target", &tgt);
+		if (pkgname == NULL || type == NULL ||
+		    (typestr = file_type_string(type)) == NULL)
+			continue;
+		if ((pkgd = xbps_pkgdb_get_pkg(xhp, pkgname)) == NULL)
+			continue;
+		xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver);
+		printf("%s: %s%s%s (%s)\n",
+			pkgver, path,
+			tgt ? " -> " : "",
+			tgt ? tgt : "",
+			typestr);
+	}
+	return 0;
+}
+
 static int
 repo_match_cb(struct xbps_handle *xhp,
 		xbps_object_t obj,
@@ -197,6 +237,8 @@ ownedby(struct xbps_handle *xhp, const char *pat, bool repo, bool regex)
 	}
 	if (repo)
 		rv = xbps_rpool_foreach(xhp, repo_ownedby_cb, &ffd);
+	else if (!regex && strpbrk(pat, "*?[\\") == NULL)
+		rv = ownedby_path(xhp, pat);
 	else
 		rv = xbps_pkgdb_foreach_cb(xhp, ownedby_pkgdb_cb, &ffd);
 
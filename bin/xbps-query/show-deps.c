@@ -84,6 +84,8 @@ show_pkg_revdeps(struct xbps_handle *xhp, const char *pkg, bool repomode)
 		xbps_array_get_cstring_nocopy(revdeps, i, &pkgdep);
 		puts(pkgdep);
 	}
-	xbps_object_release(revdeps);
+	/* the array of installed packages belongs to the pkgdb */
+	if (repomode)
+		xbps_object_release(revdeps);
 	return 0;
 }
@@ -45,7 +45,7 @@ int	sign_repo(struct xbps_handle *, const char *, const char *,
 int	sign_pkgs(struct xbps_handle *, int, int, char **, const char *, bool);
 
 /* From repoflush.c */
-int	repodata_flush(const char *repodir, const char *arch,
+int	repodata_flush(struct xbps_repo *repo, const char *repodir, const char *arch,
 		xbps_dictionary_t index, xbps_dictionary_t stage, xbps_dictionary_t meta,
 		const char *compression);
 
@@ -40,7 +40,7 @@
 #include "defs.h"
 
 static int
-repodata_commit(const char *repodir, const char *repoarch,
+repodata_commit(struct xbps_repo *repo, const char *repodir, const char *repoarch,
 	xbps_dictionary_t index, xbps_dictionary_t stage, xbps_dictionary_t meta,
 	const char *compression)
 {
@@ -184,13 +184,18 @@ repodata_commit(const char *repodir, const char *repoarch,
 			xbps_dictionary_get_cstring_nocopy(pkg, "pkgver", &pkgver);
 			xbps_dictionary_get_cstring_nocopy(pkg, "architecture", &arch);
 			printf("index: added `%s' (%s).\n", pkgver, arch);
-			xbps_dictionary_set(index, pkgname, pkg);
+			xbps_dictionary_append(index, pkgname, pkg);
 		}
 		xbps_object_iterator_release(iter);
+		if (!xbps_dictionary_sort(index)) {
+			xbps_object_release(usedshlibs);
+			xbps_object_release(oldshlibs);
+			return -ENOMEM;
+		}
 		stage = NULL;
 	}
 
-	r = repodata_flush(repodir, repoarch, index, stage, meta, compression);
+	r = repodata_flush(repo, repodir, repoarch, index, stage, meta, compression);
 	xbps_object_release(usedshlibs);
 	xbps_object_release(oldshlibs);
 	return r;
@@ -338,7 +343,7 @@ index_add(struct xbps_handle *xhp, int args, int argc, char **argv, bool force,
 			goto err2;
 	}
 
-	r = repodata_commit(repodir, repoarch, index, stage, meta, compression);
+	r = repodata_commit(repo, repodir, repoarch, index, stage, meta, compression);
 	if (r < 0) {
 		xbps_error_printf("failed to write repodata: %s\n", strerror(-r));
 		goto err2;
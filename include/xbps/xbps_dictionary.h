@@ -33,6 +33,7 @@
 #define	_XBPS_DICTIONARY_H_
 
 #include <stdint.h>
+#include <sys/types.h>
 #include <xbps/xbps_object.h>
 #include <xbps/xbps_array.h>
 
@@ -61,6 +62,9 @@ xbps_array_t	xbps_dictionary_all_keys(xbps_dictionary_t);
 xbps_object_t	xbps_dictionary_get(xbps_dictionary_t, const char *);
 bool		xbps_dictionary_set(xbps_dictionary_t, const char *,
 				    xbps_object_t);
+bool		xbps_dictionary_append(xbps_dictionary_t, const char *,
+				       xbps_object_t);
+bool		xbps_dictionary_sort(xbps_dictionary_t);
 void		xbps_dictionary_remove(xbps_dictionary_t, const char *);
 
 xbps_object_t	xbps_dictionary_get_keysym(xbps_dictionary_t,
@@ -75,6 +79,17 @@ bool		xbps_dictionary_equals(xbps_dictionary_t, xbps_dictionary_t);
 
 char *		xbps_dictionary_externalize(xbps_dictionary_t);
 xbps_dictionary_t xbps_dictionary_internalize(const char *);
+xbps_dictionary_t xbps_dictionary_internalize_stream(
+				    ssize_t (*)(void *, void *, size_t), void *);
+
+char *		xbps_dictionary_externalize_indexed(xbps_dictionary_t,
+						    void **, size_t *);
+xbps_dictionary_t xbps_dictionary_internalize_indexed(char *, size_t,
+						      const void *, size_t);
+xbps_dictionary_t xbps_dictionary_internalize_lazy(char *, size_t);
+xbps_dictionary_t xbps_dictionary_internalize_mapped(const char *, size_t,
+						     const void *, size_t,
+						     void (*)(void *), void *);
 
 bool		xbps_dictionary_externalize_to_file(xbps_dictionary_t,
 						    const char *);
@@ -52,16 +52,52 @@
 #define __arraycount(x) (sizeof(x) / sizeof(*x))
 #endif
 
+/*
+ * Repodata deltas: "<arch>-repodata.<from>.delta" archives with a single
+ * member, kept for the XBPS_REPODATA_DELTA_MAX most recent generations.
+ */
+#define XBPS_REPODATA_DELTA		"delta.plist"
+#define XBPS_REPODATA_DELTA_MAX		32
+/*
+ * Identifier of the repodata, see xbps_repodata_id(), stored in the last
+ * member by writers that publish deltas.
+ */
+#define XBPS_REPODATA_ID		"index.id"
+
+/*
+ * Database of the files of installed packages, in metadir.
+ */
+#define XBPS_PKGDB_FILES		"files-0.38.db"
+
 struct archive;
 struct archive_entry;
+struct stat;
 
 /**
  * @private
  */
 int HIDDEN dewey_match(const char *, const char *);
+void HIDDEN dewey_cache_release(void);
 int HIDDEN xbps_pkgdb_init(struct xbps_handle *);
 void HIDDEN xbps_pkgdb_release(struct xbps_handle *);
 int HIDDEN xbps_pkgdb_conversion(struct xbps_handle *);
+int HIDDEN xbps_pkgdb_cache_open(struct xbps_handle *, const struct stat *,
+		xbps_dictionary_t *);
+void HIDDEN xbps_pkgdb_cache_write(struct xbps_handle *, const struct stat *,
+		xbps_dictionary_t);
+bool HIDDEN xbps_pkgdb_set_pkgd(struct xbps_handle *, const char *,
+		xbps_dictionary_t);
+void HIDDEN xbps_pkgdb_remove_pkgd(struct xbps_handle *, const char *);
+bool HIDDEN xbps_pkgdb_journal_exists(struct xbps_handle *);
+int HIDDEN xbps_pkgdb_journal_replay(struct xbps_handle *);
+int HIDDEN xbps_pkgdb_journal_begin(struct xbps_handle *);
+void HIDDEN xbps_pkgdb_journal_add(struct xbps_handle *, const char *);
+int HIDDEN xbps_pkgdb_journal_sync(struct xbps_handle *);
+void HIDDEN xbps_pkgdb_journal_end(struct xbps_handle *, bool);
+void HIDDEN xbps_pkgdb_files_update(struct xbps_handle *, const char *);
+void HIDDEN xbps_pkgdb_files_flush(struct xbps_handle *);
+void HIDDEN xbps_pkgdb_files_release(struct xbps_handle *);
+int HIDDEN xbps_array_sort_cstrings(xbps_array_t);
 int HIDDEN xbps_array_replace_dict_by_name(xbps_array_t, xbps_dictionary_t,
 		const char *);
 int HIDDEN xbps_array_replace_dict_by_pattern(xbps_array_t, xbps_dictionary_t,
@@ -78,6 +114,7 @@ int HIDDEN xbps_entry_install_conf_file(struct xbps_handle *, xbps_dictionary_t,
 xbps_dictionary_t HIDDEN xbps_find_virtualpkg_in_conf(struct xbps_handle *,
 		xbps_dictionary_t, const char *);
 xbps_dictionary_t HIDDEN xbps_find_pkg_in_dict(xbps_dictionary_t, const char *);
+bool HIDDEN xbps_vpkg_name(char *, size_t, const char *);
 xbps_dictionary_t HIDDEN xbps_find_virtualpkg_in_dict(struct xbps_handle *,
 		xbps_dictionary_t, const char *);
 xbps_dictionary_t HIDDEN xbps_find_pkg_in_array(xbps_array_t, const char *,
@@ -91,6 +128,13 @@ bool HIDDEN xbps_transaction_check_shlibs(struct xbps_handle *, xbps_array_t);
 bool HIDDEN xbps_transaction_check_replaces(struct xbps_handle *, xbps_array_t);
 int HIDDEN xbps_transaction_check_conflicts(struct xbps_handle *, xbps_array_t);
 bool HIDDEN xbps_transaction_store(struct xbps_handle *, xbps_array_t, xbps_dictionary_t, bool);
+int HIDDEN xbps_transaction_index_pkgs(struct xbps_handle *);
+bool HIDDEN xbps_transaction_add_pkg_first(struct xbps_handle *, xbps_array_t,
+		xbps_dictionary_t);
+xbps_dictionary_t HIDDEN xbps_transaction_find_pkg(struct xbps_handle *,
+		xbps_array_t, const char *, xbps_trans_type_t);
+xbps_dictionary_t HIDDEN xbps_transaction_find_virtualpkg(struct xbps_handle *,
+		xbps_array_t, const char *, xbps_trans_type_t);
 int HIDDEN xbps_transaction_init(struct xbps_handle *);
 int HIDDEN xbps_transaction_files(struct xbps_handle *,
 		xbps_object_iterator_t);
@@ -101,6 +145,14 @@ int HIDDEN xbps_transaction_internalize(struct xbps_handle *, xbps_object_iterat
 
 char HIDDEN *xbps_get_remote_repo_string(const char *);
 int HIDDEN xbps_repo_sync(struct xbps_handle *, const char *);
+void HIDDEN xbps_repo_sync_delta(struct xbps_handle *, const char *,
+		const char *);
+void HIDDEN xbps_repo_sync_delta_update(const char *, const char *);
+int HIDDEN xbps_repodata_id(const char *, char *, size_t);
+int HIDDEN xbps_repo_cache_open(struct xbps_repo *, const char *,
+		const struct stat *);
+void HIDDEN xbps_repo_cache_write(struct xbps_repo *, const char *,
+		const struct stat *, const char *, size_t, const void *, size_t);
 int HIDDEN xbps_file_hash_check_dictionary(struct xbps_handle *,
 		xbps_dictionary_t, const char *, const char *);
 int HIDDEN xbps_file_exec(struct xbps_handle *, const char *, ...);
@@ -112,6 +164,11 @@ int HIDDEN xbps_unpack_binary_pkg(struct xbps_handle *, xbps_dictionary_t);
 int HIDDEN xbps_remove_pkg(struct xbps_handle *, const char *, bool);
 int HIDDEN xbps_register_pkg(struct xbps_handle *, xbps_dictionary_t);
 
+void HIDDEN xbps_digest2string(const uint8_t *, char *, size_t);
+int HIDDEN xbps_write_all(int, const void *, size_t);
+int HIDDEN xbps_write_member(int, const void *, size_t);
+uint64_t HIDDEN xbps_checksum64(uint64_t, const void *, size_t);
+#define XBPS_CHECKSUM64_INIT	UINT64_C(0xcbf29ce484222325)
 char HIDDEN *xbps_archive_get_file(struct archive *, struct archive_entry *);
 xbps_dictionary_t HIDDEN xbps_archive_get_dictionary(struct archive *,
 		struct archive_entry *);
@@ -95,18 +95,47 @@ err:
 	return NULL;
 }
 
+struct archive_dict_reader {
+	struct archive *ar;
+	struct archive_entry *entry;
+	int error;
+};
+
+static ssize_t
+archive_dict_read(void *arg, void *buf, size_t len)
+{
+	struct archive_dict_reader *rd = arg;
+	ssize_t r;
+
+	do {
+		r = archive_read_data(rd->ar, buf, len);
+	} while (r == ARCHIVE_RETRY);
+	if (r < 0) {
+		rd->error = xbps_archive_errno(rd->ar);
+		xbps_error_printf("failed to read archive entry: %s: %s\n",
+		    archive_entry_pathname(rd->entry),
+		    archive_error_string(rd->ar));
+		return -1;
+	}
+	return r;
+}
+
 xbps_dictionary_t HIDDEN
 xbps_archive_get_dictionary(struct archive *ar, struct archive_entry *entry)
 {
-	xbps_dictionary_t d = NULL;
-	char *buf;
+	struct archive_dict_reader rd = { .ar = ar, .entry = entry };
+	xbps_dictionary_t d;
 
-	if ((buf = xbps_archive_get_file(ar, entry)) == NULL)
-		return NULL;
+	assert(ar != NULL);
+	assert(entry != NULL);
 
-	/* If blob is already a dictionary we are done */
-	d = xbps_dictionary_internalize(buf);
-	free(buf);
+	/*
+	 * The dictionary is parsed as the entry is decompressed, the
+	 * entry is not held in memory as a whole.
+	 */
+	d = xbps_dictionary_internalize_stream(archive_dict_read, &rd);
+	if (!d && rd.error)
+		errno = rd.error;
 	return d;
 }
 
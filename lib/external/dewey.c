@@ -33,17 +33,16 @@
 #include <string.h>
 #include <strings.h>
 #include <ctype.h>
+#include <pthread.h>
 
 #include "xbps_api_impl.h"
+#include "uthash.h"
 
 #define PKG_PATTERN_MAX 1024
 
 #ifndef MIN
 #define MIN(a,b)	(((a) < (b)) ? (a) : (b))
 #endif
-#ifndef MAX
-#define MAX(a,b)	(((a) > (b)) ? (a) : (b))
-#endif
 
 enum {
 	DEWEY_LT,
@@ -63,14 +62,34 @@ enum {
         Patch = 1
 };
 
+#define DEWEY_VERSION_MAX	32
+
 /* this struct defines a version number */
 typedef struct arr_t {
 	unsigned	c;              /* # of version numbers */
 	unsigned	size;           /* size of array */
 	int	       *v;              /* array of decimal numbers */
 	int		revision;       /* any "_" suffix */
+	int		buf[DEWEY_VERSION_MAX]; /* storage of short versions */
 } arr_t;
 
+/* this struct defines a version number being scanned */
+typedef struct stream_t {
+	const char     *num;            /* next character to scan */
+	int		revision;       /* any "_" suffix */
+	int		next;           /* component scanned but not returned */
+	bool		pending;        /* if there's a component in next */
+} stream_t;
+
+/* this struct defines a dependency pattern, e.g "foo>=1.0_1<2.0_1" */
+typedef struct pattern_t {
+	size_t		namelen;        /* length of the pkgname */
+	int		op;             /* test of the lower limit */
+	int		op2;            /* test of the upper limit or -1 */
+	arr_t		version;        /* lower limit */
+	arr_t		version2;       /* upper limit */
+} pattern_t;
+
 /* this struct describes a test */
 typedef struct test_t {
 	const char     *s;              /* string representation */
@@ -117,6 +136,24 @@ dewey_mktest(int *op, const char *test)
 	return -1;
 }
 
+/*
+ * versions are stored in the array of the struct, unless they have
+ * more than DEWEY_VERSION_MAX components.
+ */
+static void
+growversion(arr_t *ap)
+{
+	ap->size *= 2;
+	if (ap->v == ap->buf) {
+		ap->v = malloc(ap->size * sizeof(int));
+		assert(ap->v != NULL);
+		memcpy(ap->v, ap->buf, sizeof(ap->buf));
+	} else {
+		ap->v = realloc(ap->v, ap->size * sizeof(int));
+		assert(ap->v != NULL);
+	}
+}
+
 /*
  * make a component of a version number.
  * '.' encodes as Dot which is '0'
@@ -125,86 +162,98 @@ dewey_mktest(int *op, const char *test)
  * 'beta' encodes as 'beta version', or Beta, which is -2.
  * 'rc' encodes as 'release candidate', or RC, which is -1.
  * '_' encodes as 'xbps revision', which is used after all other tests
+ *
+ * Components are returned one at a time as the version number is
+ * scanned, so that versions can be compared without storing them.
+ * Returns 0 after the last component.
  */
 static int
-mkcomponent(arr_t *ap, const char *num)
+mkcomponent(stream_t *sp, int *np)
 {
 	static const char       alphas[] = "abcdefghijklmnopqrstuvwxyz";
 	const test_t	       *modp;
 	int                 n;
 	const char             *cp;
 
-	if (ap->c == ap->size) {
-		if (ap->size == 0) {
-			ap->size = 62;
-			ap->v = malloc(ap->size * sizeof(int));
-			assert(ap->v != NULL);
-		} else {
-			ap->size *= 2;
-			ap->v = realloc(ap->v, ap->size * sizeof(int));
-			assert(ap->v != NULL);
-		}
+	if (sp->pending) {
+		sp->pending = false;
+		*np = sp->next;
+		return 1;
 	}
-	if (isdigit((unsigned char)*num)) {
-		for (cp = num, n = 0 ; isdigit((unsigned char)*num) ; num++) {
-			n = (n * 10) + (*num - '0');
+	while (*sp->num) {
+		if (isdigit((unsigned char)*sp->num)) {
+			for (n = 0 ; isdigit((unsigned char)*sp->num) ; sp->num++) {
+				n = (n * 10) + (*sp->num - '0');
+			}
+			*np = n;
+			return 1;
 		}
-		ap->v[ap->c++] = n;
-		return (int)(num - cp);
-	}
-	for (modp = modifiers ; modp->s ; modp++) {
-		if (strncasecmp(num, modp->s, modp->len) == 0) {
-			ap->v[ap->c++] = modp->t;
-			return modp->len;
+		for (modp = modifiers ; modp->s ; modp++) {
+			if (strncasecmp(sp->num, modp->s, modp->len) == 0) {
+				sp->num += modp->len;
+				*np = modp->t;
+				return 1;
+			}
 		}
-	}
-	if (strncasecmp(num, "_", 1) == 0) {
-		for (cp = num, num += 1, n = 0 ; isdigit((unsigned char)*num) ; num++) {
-			n = (n * 10) + (*num - '0');
+		if (strncasecmp(sp->num, "_", 1) == 0) {
+			for (sp->num += 1, n = 0 ; isdigit((unsigned char)*sp->num) ; sp->num++) {
+				n = (n * 10) + (*sp->num - '0');
+			}
+			sp->revision = n;
+			continue;
 		}
-		ap->revision = n;
-		return (int)(num - cp);
-	}
-	if (isalpha((unsigned char)*num)) {
-		ap->v[ap->c++] = Dot;
-		cp = strchr(alphas, tolower((unsigned char)*num));
-		if (ap->c == ap->size) {
-			ap->size *= 2;
-			ap->v = realloc(ap->v, ap->size * sizeof(int));
-			assert(ap->v != NULL);
+		if (isalpha((unsigned char)*sp->num)) {
+			cp = strchr(alphas, tolower((unsigned char)*sp->num));
+			sp->num++;
+			sp->next = (int)(cp - alphas) + 1;
+			sp->pending = true;
+			*np = Dot;
+			return 1;
 		}
-		ap->v[ap->c++] = (int)(cp - alphas) + 1;
-		return 1;
+		sp->num++;
 	}
-	return 1;
+	return 0;
+}
+
+static void
+mkstream(stream_t *sp, const char *num)
+{
+	sp->num = num;
+	sp->revision = 0;
+	sp->pending = false;
 }
 
 /* make a version number string into an array of comparable ints */
 static int
 mkversion(arr_t *ap, const char *num)
 {
+	stream_t s;
+	int n;
+
 	ap->c = 0;
-	ap->size = 0;
-	ap->v = NULL;
-	ap->revision = 0;
+	ap->size = DEWEY_VERSION_MAX;
+	ap->v = ap->buf;
 
-	while (*num) {
-		num += mkcomponent(ap, num);
+	mkstream(&s, num);
+	while (mkcomponent(&s, &n)) {
+		if (ap->c == ap->size)
+			growversion(ap);
+		ap->v[ap->c++] = n;
 	}
+	ap->revision = s.revision;
 	return 1;
 }
 
 static void
 freeversion(arr_t *ap)
 {
-	free(ap->v);
+	if (ap->v != ap->buf)
+		free(ap->v);
 	ap->v = NULL;
 	ap->c = 0;
 	ap->size = 0;
 }
 
-#define DIGIT(v, c, n) (((n) < (c)) ? v[n] : 0)
-
 /* compare the result against the test we were expecting */
 static int
 result(int cmp, int tst)
@@ -227,41 +276,35 @@ result(int cmp, int tst)
 	}
 }
 
-/* do the test on the 2 vectors */
-static int
-vtest(arr_t *lhs, int tst, arr_t *rhs)
-{
-	int cmp;
-	unsigned int c, i;
-
-	for (i = 0, c = MAX(lhs->c, rhs->c) ; i < c ; i++) {
-		if ((cmp = DIGIT(lhs->v, lhs->c, i) - DIGIT(rhs->v, rhs->c, i)) != 0) {
-			return result(cmp, tst);
-		}
-	}
-	return result(lhs->revision - rhs->revision, tst);
-}
-
 /*
- * Compare two dewey decimal numbers.
+ * compare a version number being scanned against another one, or
+ * against a version number already made into an array if rhs is NULL.
+ * Missing components are 0, the revisions are only compared if all
+ * components are equal.
  */
 static int
-dewey_cmp(const char *lhs, int op, const char *rhs)
+vcmp(stream_t *lhs, stream_t *rhs, const arr_t *rarr)
 {
-	arr_t	right;
-	arr_t	left;
-	int retval;
-
-	if (!mkversion(&left, lhs))
-		return 0;
-	if (!mkversion(&right, rhs)) {
-		freeversion(&left);
-		return 0;
+	unsigned int i;
+	int l, r, lok, rok;
+
+	for (i = 0 ; ; i++) {
+		lok = mkcomponent(lhs, &l);
+		if (rhs != NULL) {
+			rok = mkcomponent(rhs, &r);
+		} else if ((rok = i < rarr->c)) {
+			r = rarr->v[i];
+		}
+		if (!lok && !rok)
+			break;
+		if (!lok)
+			l = 0;
+		if (!rok)
+			r = 0;
+		if (l != r)
+			return l - r;
 	}
-        retval = vtest(&left, op, &right);
-	freeversion(&left);
-	freeversion(&right);
-	return retval;
+	return lhs->revision - (rhs ? rhs->revision : rarr->revision);
 }
 
 /*
@@ -272,70 +315,223 @@ dewey_cmp(const char *lhs, int op, const char *rhs)
 int
 xbps_cmpver(const char *pkg1, const char *pkg2)
 {
-	if (dewey_cmp(pkg1, DEWEY_LT, pkg2))
-		return -1;
-	else if (dewey_cmp(pkg1, DEWEY_GT, pkg2))
-		return 1;
-	else
-		return 0;
+	stream_t left, right;
+	int cmp;
+
+	mkstream(&left, pkg1);
+	mkstream(&right, pkg2);
+	cmp = vcmp(&left, &right, NULL);
+	return cmp < 0 ? -1 : cmp > 0;
 }
 
 /*
- * Perform dewey match on "pkg" against "pattern".
- * Return 1 on match, 0 on non-match, -1 on error.
+ * Split "pattern" into its pkgname, tests and versions.
+ * Returns false if there's no test in the pattern.
  */
-int HIDDEN
-dewey_match(const char *pattern, const char *pkg)
+static bool
+mkpattern(pattern_t *pp, const char *pattern)
 {
-	const char *version;
 	const char *sep, *sep2;
-	int op, op2;
 	int n;
 
-	/* compare names */
-	if ((version=strrchr(pkg, '-')) == NULL) {
-		return 0;
-	}
 	if ((sep = strpbrk(pattern, "<>")) == NULL)
-		return -1;
-	/* compare name lengths */
-	if ((sep-pattern != version-pkg) ||
-	    strncmp(pkg, pattern, (size_t)(version-pkg)) != 0)
-		return 0;
-	version++;
-	
+		return false;
+	pp->namelen = (size_t)(sep - pattern);
+
 	/* extract comparison operator */
-        if ((n = dewey_mktest(&op, sep)) < 0) {
-		return 0;
-        }
+	if ((n = dewey_mktest(&pp->op, sep)) < 0)
+		return false;
 	/* skip operator */
 	sep += n;
 
 	/* if greater than, look for less than */
 	sep2 = NULL;
-	if (op == DEWEY_GT || op == DEWEY_GE) {
+	pp->op2 = -1;
+	if (pp->op == DEWEY_GT || pp->op == DEWEY_GE) {
 		if ((sep2 = strchr(sep, '<')) != NULL) {
-			if ((n = dewey_mktest(&op2, sep2)) < 0) {
-				return 0;
-			}
-			/* compare upper limit */
-			if (!dewey_cmp(version, op2, sep2+n))
-				return 0;
+			if ((n = dewey_mktest(&pp->op2, sep2)) < 0)
+				return false;
 		}
 	}
-
-	/* compare only pattern / lower limit */
 	if (sep2) {
 		char ver[PKG_PATTERN_MAX];
 
 		xbps_strlcpy(ver, sep, MIN((ssize_t)sizeof(ver), sep2-sep+1));
-		if (dewey_cmp(version, op, ver))
-			return 1;
+		mkversion(&pp->version, ver);
+		mkversion(&pp->version2, sep2+n);
 	} else {
-		if (dewey_cmp(version, op, sep))
-			return 1;
+		mkversion(&pp->version, sep);
+		mkversion(&pp->version2, "");
 	}
+	return true;
+}
 
-	return 0;
+static void
+freepattern(pattern_t *pp)
+{
+	freeversion(&pp->version);
+	freeversion(&pp->version2);
+}
+
+/*
+ * Patterns already split are kept in a hash table of every thread, so
+ * that a dependency is only parsed once per thread and is looked up
+ * without locking.  The table of a thread is released when it exits or
+ * when it calls xbps_end().
+ */
+#define DEWEY_CACHE_MAX	16384
+
+struct pattern_entry {
+	pattern_t pattern;
+	UT_hash_handle hh;
+	char key[];
+};
+
+struct pattern_cache {
+	struct pattern_entry *entries;
+	unsigned int count;
+};
+
+static pthread_key_t pattern_cache_key;
+static pthread_once_t pattern_cache_once = PTHREAD_ONCE_INIT;
+static bool pattern_cache_keyed;
+
+static struct pattern_entry *
+pattern_new(const char *pattern, size_t len)
+{
+	struct pattern_entry *entry;
+
+	if ((entry = malloc(sizeof(*entry) + len + 1)) == NULL)
+		return NULL;
+	if (!mkpattern(&entry->pattern, pattern)) {
+		free(entry);
+		return NULL;
+	}
+	memcpy(entry->key, pattern, len + 1);
+	return entry;
+}
+
+static void
+pattern_free(struct pattern_entry *entry)
+{
+	freepattern(&entry->pattern);
+	free(entry);
+}
+
+static void
+pattern_cache_free(void *arg)
+{
+	struct pattern_cache *cache = arg;
+	struct pattern_entry *entry, *tmp;
+
+	HASH_ITER(hh, cache->entries, entry, tmp) {
+		HASH_DEL(cache->entries, entry);
+		pattern_free(entry);
+	}
+	free(cache);
+}
+
+static void
+pattern_cache_init(void)
+{
+	pattern_cache_keyed =
+	    pthread_key_create(&pattern_cache_key, pattern_cache_free) == 0;
+}
+
+static struct pattern_cache *
+pattern_cache_get(void)
+{
+	struct pattern_cache *cache;
+
+	pthread_once(&pattern_cache_once, pattern_cache_init);
+	if (!pattern_cache_keyed)
+		return NULL;
+	if ((cache = pthread_getspecific(pattern_cache_key)) != NULL)
+		return cache;
+	if ((cache = calloc(1, sizeof(*cache))) == NULL)
+		return NULL;
+	if (pthread_setspecific(pattern_cache_key, cache) != 0) {
+		free(cache);
+		return NULL;
+	}
+	return cache;
+}
+
+void HIDDEN
+dewey_cache_release(void)
+{
+	struct pattern_cache *cache;
+
+	pthread_once(&pattern_cache_once, pattern_cache_init);
+	if (!pattern_cache_keyed)
+		return;
+	if ((cache = pthread_getspecific(pattern_cache_key)) == NULL)
+		return;
+	(void)pthread_setspecific(pattern_cache_key, NULL);
+	pattern_cache_free(cache);
+}
+
+static int
+pattern_match(const pattern_t *pp, const char *pattern, const char *pkg)
+{
+	const char *version;
+	stream_t ver;
+
+	/* compare names */
+	if ((version = strrchr(pkg, '-')) == NULL)
+		return 0;
+	if ((size_t)(version - pkg) != pp->namelen ||
+	    strncmp(pkg, pattern, pp->namelen) != 0)
+		return 0;
+	version++;
+
+	/* compare upper limit */
+	if (pp->op2 >= 0) {
+		mkstream(&ver, version);
+		if (!result(vcmp(&ver, NULL, &pp->version2), pp->op2))
+			return 0;
+	}
+	/* compare lower limit */
+	mkstream(&ver, version);
+	return result(vcmp(&ver, NULL, &pp->version), pp->op);
 }
 
+/*
+ * Perform dewey match on "pkg" against "pattern".
+ * Return 1 on match, 0 on non-match, -1 on error.
+ */
+int HIDDEN
+dewey_match(const char *pattern, const char *pkg)
+{
+	struct pattern_cache *cache;
+	struct pattern_entry *entry = NULL;
+	pattern_t pp;
+	size_t len;
+	int rv;
+
+	if (strrchr(pkg, '-') == NULL)
+		return 0;
+	if (strpbrk(pattern, "<>") == NULL)
+		return -1;
+
+	len = strlen(pattern);
+	if ((cache = pattern_cache_get()) != NULL) {
+		HASH_FIND(hh, cache->entries, pattern, len, entry);
+		if (entry != NULL)
+			return pattern_match(&entry->pattern, pattern, pkg);
+	}
+	if (cache != NULL && cache->count < DEWEY_CACHE_MAX) {
+		if ((entry = pattern_new(pattern, len)) == NULL)
+			return 0;
+		HASH_ADD_KEYPTR(hh, cache->entries, entry->key, len, entry);
+		cache->count++;
+		return pattern_match(&entry->pattern, pattern, pkg);
+	}
+
+	/* the table is full, split the pattern on the stack */
+	if (!mkpattern(&pp, pattern))
+		return 0;
+	rv = pattern_match(&pp, pattern, pkg);
+	freepattern(&pp);
+	return rv;
+}
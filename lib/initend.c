@@ -50,6 +50,10 @@ xbps_init(struct xbps_handle *xhp)
 
 	assert(xhp != NULL);
 
+	/* the pkgdb is not locked or journaled yet */
+	xhp->lock_fd = -1;
+	xhp->journal_fd = -1;
+
 	if (xhp->flags & XBPS_FLAG_DEBUG)
 		xbps_debug_level = 1;
 
@@ -193,4 +197,5 @@ xbps_end(struct xbps_handle *xhp)
 	assert(xhp);
 
 	xbps_pkgdb_release(xhp);
+	dewey_cache_release();
 }
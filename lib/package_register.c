@@ -110,9 +110,10 @@ xbps_register_pkg(struct xbps_handle *xhp, xbps_dictionary_t pkgrd)
 	xbps_dictionary_remove(pkgd, "pkgname");
 	xbps_dictionary_remove(pkgd, "version");
 
-	if (!xbps_dictionary_set(xhp->pkgdb, pkgname, pkgd)) {
+	if (!xbps_pkgdb_set_pkgd(xhp, pkgname, pkgd)) {
 		xbps_dbg_printf("%s: failed to set pkgd for %s\n", __func__, pkgver);
 	}
+	xbps_pkgdb_files_update(xhp, pkgname);
 out:
 	xbps_object_release(pkgd);
 
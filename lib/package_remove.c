@@ -163,6 +163,7 @@ xbps_remove_pkg(struct xbps_handle *xhp, const char *pkgver, bool update)
 
 	if ((rv = xbps_alternatives_unregister(xhp, pkgd)) != 0)
 		goto out;
+	xbps_pkgdb_journal_add(xhp, "_XBPS_ALTERNATIVES_");
 
 	/*
 	 * If updating a package, we just need to execute the current
@@ -203,6 +204,7 @@ xbps_remove_pkg(struct xbps_handle *xhp, const char *pkgver, bool update)
 		    pkgver, strerror(rv));
 		goto out;
 	}
+	xbps_pkgdb_journal_add(xhp, pkgname);
 	/* XXX: setting the state and then removing the package seems useless. */
 
 purge:
@@ -223,7 +225,8 @@ purge:
 	 */
 	xbps_dbg_printf("[remove] unregister %s returned %d\n", pkgver, rv);
 	xbps_set_cb_state(xhp, XBPS_STATE_REMOVE_DONE, 0, pkgver, NULL);
-	xbps_dictionary_remove(xhp->pkgdb, pkgname);
+	xbps_pkgdb_remove_pkgd(xhp, pkgname);
+	xbps_pkgdb_files_update(xhp, pkgname);
 out:
 	if (rv != 0) {
 		xbps_set_cb_state(xhp, XBPS_STATE_REMOVE_FAIL, rv, pkgver,
@@ -161,7 +161,7 @@ xbps_set_pkg_state_installed(struct xbps_handle *xhp,
 		if (!xbps_pkg_name(pkgname, XBPS_NAME_SIZE, pkgver)) {
 			abort();
 		}
-		if (!xbps_dictionary_set(xhp->pkgdb, pkgname, pkgd)) {
+		if (!xbps_pkgdb_set_pkgd(xhp, pkgname, pkgd)) {
 			xbps_object_release(pkgd);
 			return EINVAL;
 		}
@@ -173,7 +173,7 @@ xbps_set_pkg_state_installed(struct xbps_handle *xhp,
 		if (!xbps_pkg_name(pkgname, XBPS_NAME_SIZE, pkgver)) {
 			abort();
 		}
-		if (!xbps_dictionary_set(xhp->pkgdb, pkgname, pkgd)) {
+		if (!xbps_pkgdb_set_pkgd(xhp, pkgname, pkgd)) {
 			return EINVAL;
 		}
 	}
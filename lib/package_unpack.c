@@ -580,6 +580,7 @@ xbps_unpack_binary_pkg(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod)
 		    "%s: [unpack] failed to register alternatives: %s",
 		    pkgver, strerror(rv));
 	}
+	xbps_pkgdb_journal_add(xhp, "_XBPS_ALTERNATIVES_");
 
 out:
 	if (pkg_fd != -1)
@@ -134,23 +134,27 @@ xbps_pkgdb_unlock(struct xbps_handle *xhp)
 	xhp->lock_fd = -1;
 }
 
+/*
+ * Creates the map of the virtual packages provided by installed packages,
+ * indexed by the name of the virtual package, in `vpkgsp'.
+ */
 static int
-pkgdb_map_vpkgs(struct xbps_handle *xhp)
+pkgdb_vpkgs(struct xbps_handle *xhp, xbps_dictionary_t *vpkgsp)
 {
 	xbps_object_iterator_t iter;
 	xbps_object_t obj;
+	xbps_dictionary_t vpkgs;
 	int r = 0;
 
-	if (!xbps_dictionary_count(xhp->pkgdb))
+	vpkgs = xbps_dictionary_create();
+	if (!vpkgs) {
+		r = -errno;
+		xbps_error_printf("failed to create dictionary\n");
+		return r;
+	}
+	if (!xbps_dictionary_count(xhp->pkgdb)) {
+		*vpkgsp = vpkgs;
 		return 0;
-
-	if (xhp->vpkgd == NULL) {
-		xhp->vpkgd = xbps_dictionary_create();
-		if (!xhp->vpkgd) {
-			r = -errno;
-			xbps_error_printf("failed to create dictionary\n");
-			return r;
-		}
 	}
 
 	/*
@@ -160,6 +164,7 @@ pkgdb_map_vpkgs(struct xbps_handle *xhp)
 	if (!iter) {
 		r = -errno;
 		xbps_error_printf("failed to create iterator");
+		xbps_object_release(vpkgs);
 		return r;
 	}
 
@@ -192,7 +197,7 @@ pkgdb_map_vpkgs(struct xbps_handle *xhp)
 				continue;
 			}
 
-			providers = xbps_dictionary_get(xhp->vpkgd, vpkgname);
+			providers = xbps_dictionary_get(vpkgs, vpkgname);
 			if (!providers) {
 				providers = xbps_dictionary_create();
 				if (!providers) {
@@ -200,7 +205,7 @@ pkgdb_map_vpkgs(struct xbps_handle *xhp)
 					xbps_error_printf("failed to create dictionary\n");
 					goto out;
 				}
-				if (!xbps_dictionary_set(xhp->vpkgd, vpkgname, providers)) {
+				if (!xbps_dictionary_set(vpkgs, vpkgname, providers)) {
 					r = -errno;
 					xbps_error_printf("failed to set dictionary entry\n");
 					xbps_object_release(providers);
@@ -222,6 +227,75 @@ pkgdb_map_vpkgs(struct xbps_handle *xhp)
 		}
 	}
 out:
+	xbps_object_iterator_release(iter);
+	if (r == 0)
+		*vpkgsp = vpkgs;
+	else
+		xbps_object_release(vpkgs);
+	return r;
+}
+
+/*
+ * Adds the map of virtual packages created by pkgdb_vpkgs() to
+ * xhp->vpkgd, where those set in the configuration are already stored.
+ */
+static int
+pkgdb_map_vpkgs(struct xbps_handle *xhp, xbps_dictionary_t vpkgs)
+{
+	xbps_object_iterator_t iter, iter2;
+	xbps_object_t obj, obj2;
+	int r = 0;
+
+	if (!xbps_dictionary_count(vpkgs))
+		return 0;
+
+	if (xhp->vpkgd == NULL) {
+		xhp->vpkgd = xbps_dictionary_create();
+		if (!xhp->vpkgd) {
+			r = -errno;
+			xbps_error_printf("failed to create dictionary\n");
+			return r;
+		}
+	}
+
+	iter = xbps_dictionary_iterator(vpkgs);
+	if (!iter) {
+		r = -errno;
+		xbps_error_printf("failed to create iterator");
+		return r;
+	}
+
+	while ((obj = xbps_object_iterator_next(iter))) {
+		xbps_dictionary_t providers, cur;
+
+		providers = xbps_dictionary_get_keysym(vpkgs, obj);
+		cur = xbps_dictionary_get_keysym(xhp->vpkgd, obj);
+		if (!cur) {
+			if (!xbps_dictionary_set_keysym(xhp->vpkgd, obj, providers)) {
+				r = -errno;
+				xbps_error_printf("failed to set dictionary entry\n");
+				break;
+			}
+			continue;
+		}
+		iter2 = xbps_dictionary_iterator(providers);
+		if (!iter2) {
+			r = -errno;
+			xbps_error_printf("failed to create iterator");
+			break;
+		}
+		while ((obj2 = xbps_object_iterator_next(iter2))) {
+			if (!xbps_dictionary_set_keysym(cur, obj2,
+			    xbps_dictionary_get_keysym(providers, obj2))) {
+				r = -errno;
+				xbps_error_printf("failed to set dictionary entry\n");
+				break;
+			}
+		}
+		xbps_object_iterator_release(iter2);
+		if (r < 0)
+			break;
+	}
 	xbps_object_iterator_release(iter);
 	return r;
 }
@@ -265,6 +339,264 @@ pkgdb_map_names(struct xbps_handle *xhp)
 	return rv;
 }
 
+/*
+ * The dependencies of installed packages are kept in xhp->pkgdb_depnames,
+ * which maps the name of every dependency to a dictionary of the names
+ * and versions of the packages depending on it.  It does not depend on
+ * the configuration, so it is stored in the pkgdb cache and kept up to
+ * date as packages are registered and removed, and the map of reverse
+ * dependencies in xhp->pkgdb_revdeps is derived from it when needed.
+ */
+static int
+pkgdb_depnames_add(xbps_dictionary_t depnames, const char *pkgname,
+		xbps_dictionary_t pkgd)
+{
+	xbps_array_t rundeps;
+	const char *pkgver = NULL;
+
+	rundeps = xbps_dictionary_get(pkgd, "run_depends");
+	if (!xbps_array_count(rundeps))
+		return 0;
+
+	xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver);
+	if (!pkgver)
+		return 0;
+
+	for (unsigned int i = 0; i < xbps_array_count(rundeps); i++) {
+		xbps_dictionary_t pkgs;
+		const char *pkgdep = NULL;
+		char depname[XBPS_NAME_SIZE];
+		bool alloc = false;
+
+		xbps_array_get_cstring_nocopy(rundeps, i, &pkgdep);
+		if ((!xbps_pkgpattern_name(depname, sizeof(depname), pkgdep)) &&
+		    (!xbps_pkg_name(depname, sizeof(depname), pkgdep))) {
+			xbps_dbg_printf("[pkgdb] %s: invalid dependency: %s\n",
+			    pkgver, pkgdep);
+			continue;
+		}
+		pkgs = xbps_dictionary_get(depnames, depname);
+		if (pkgs == NULL) {
+			pkgs = xbps_dictionary_create();
+			if (pkgs == NULL)
+				return -errno;
+			if (!xbps_dictionary_set(depnames, depname, pkgs)) {
+				xbps_object_release(pkgs);
+				return -ENOMEM;
+			}
+			alloc = true;
+		}
+		if (!xbps_dictionary_set_cstring(pkgs, pkgname, pkgver)) {
+			if (alloc)
+				xbps_object_release(pkgs);
+			return -ENOMEM;
+		}
+		if (alloc)
+			xbps_object_release(pkgs);
+	}
+	return 0;
+}
+
+static void
+pkgdb_depnames_del(xbps_dictionary_t depnames, const char *pkgname,
+		xbps_dictionary_t pkgd)
+{
+	xbps_array_t rundeps;
+
+	rundeps = xbps_dictionary_get(pkgd, "run_depends");
+	for (unsigned int i = 0; i < xbps_array_count(rundeps); i++) {
+		xbps_dictionary_t pkgs;
+		const char *pkgdep = NULL;
+		char depname[XBPS_NAME_SIZE];
+
+		xbps_array_get_cstring_nocopy(rundeps, i, &pkgdep);
+		if ((!xbps_pkgpattern_name(depname, sizeof(depname), pkgdep)) &&
+		    (!xbps_pkg_name(depname, sizeof(depname), pkgdep)))
+			continue;
+		if ((pkgs = xbps_dictionary_get(depnames, depname)) == NULL)
+			continue;
+		xbps_dictionary_remove(pkgs, pkgname);
+		if (!xbps_dictionary_count(pkgs))
+			xbps_dictionary_remove(depnames, depname);
+	}
+}
+
+static int
+pkgdb_depnames_init(struct xbps_handle *xhp)
+{
+	xbps_object_iterator_t iter;
+	xbps_object_t obj;
+	int r = 0;
+
+	if (xhp->pkgdb_depnames)
+		return 0;
+
+	xhp->pkgdb_depnames = xbps_dictionary_create();
+	if (!xhp->pkgdb_depnames)
+		return -errno;
+
+	iter = xbps_dictionary_iterator(xhp->pkgdb);
+	if (!iter) {
+		r = -errno;
+		goto out;
+	}
+	while ((obj = xbps_object_iterator_next(iter))) {
+		r = pkgdb_depnames_add(xhp->pkgdb_depnames,
+		    xbps_dictionary_keysym_cstring_nocopy(obj),
+		    xbps_dictionary_get_keysym(xhp->pkgdb, obj));
+		if (r < 0)
+			break;
+	}
+	xbps_object_iterator_release(iter);
+out:
+	if (r < 0) {
+		xbps_object_release(xhp->pkgdb_depnames);
+		xhp->pkgdb_depnames = NULL;
+	}
+	return r;
+}
+
+static void
+pkgdb_revdeps_release(struct xbps_handle *xhp)
+{
+	if (xhp->pkgdb_revdeps) {
+		xbps_object_release(xhp->pkgdb_revdeps);
+		xhp->pkgdb_revdeps = NULL;
+	}
+}
+
+/*
+ * Stores `pkgd' as the package `pkgname' in the pkgdb, replacing the
+ * previous one and updating its dependencies in the map of reverse
+ * dependencies.
+ */
+bool HIDDEN
+xbps_pkgdb_set_pkgd(struct xbps_handle *xhp, const char *pkgname,
+		xbps_dictionary_t pkgd)
+{
+	xbps_dictionary_t opkgd;
+
+	pkgdb_revdeps_release(xhp);
+	if (xhp->pkgdb_depnames) {
+		opkgd = xbps_dictionary_get(xhp->pkgdb, pkgname);
+		if (opkgd)
+			pkgdb_depnames_del(xhp->pkgdb_depnames, pkgname, opkgd);
+		if (pkgdb_depnames_add(xhp->pkgdb_depnames, pkgname, pkgd) < 0) {
+			/* created again from the pkgdb when needed */
+			xbps_object_release(xhp->pkgdb_depnames);
+			xhp->pkgdb_depnames = NULL;
+		}
+	}
+	if (!xbps_dictionary_set(xhp->pkgdb, pkgname, pkgd))
+		return false;
+	xbps_pkgdb_journal_add(xhp, pkgname);
+	return true;
+}
+
+/*
+ * Removes the package `pkgname' from the pkgdb and its dependencies from
+ * the map of reverse dependencies.
+ */
+void HIDDEN
+xbps_pkgdb_remove_pkgd(struct xbps_handle *xhp, const char *pkgname)
+{
+	xbps_dictionary_t pkgd;
+
+	pkgdb_revdeps_release(xhp);
+	if (xhp->pkgdb_depnames &&
+	    (pkgd = xbps_dictionary_get(xhp->pkgdb, pkgname)))
+		pkgdb_depnames_del(xhp->pkgdb_depnames, pkgname, pkgd);
+	xbps_dictionary_remove(xhp->pkgdb, pkgname);
+	xbps_pkgdb_journal_add(xhp, pkgname);
+}
+
+/*
+ * Rewrites the cache of the pkgdb plist after it has been flushed.
+ */
+static void
+pkgdb_cache_update(struct xbps_handle *xhp)
+{
+	xbps_dictionary_t vpkgs = NULL;
+	struct stat st;
+
+	if (stat(xhp->pkgdb_plist, &st) == -1 ||
+	    pkgdb_map_names(xhp) != 0 || pkgdb_vpkgs(xhp, &vpkgs) != 0)
+		return;
+	/* without it the cache is still valid, it is created when needed */
+	(void)pkgdb_depnames_init(xhp);
+	xbps_pkgdb_cache_write(xhp, &st, vpkgs);
+	xbps_object_release(vpkgs);
+}
+
+/*
+ * Sets up xhp->pkgdb and adds the virtual packages provided by installed
+ * packages to xhp->vpkgd.  Both are loaded from the cache of the plist
+ * if it is up to date, otherwise they are computed from the plist and,
+ * if the pkgdb is locked by this handle, the cache is written again.
+ * If a transaction was interrupted, its journal is replayed on top of
+ * the plist and the cache is left alone.
+ */
+static int
+pkgdb_load(struct xbps_handle *xhp)
+{
+	xbps_dictionary_t vpkgs = NULL;
+	struct stat st;
+	bool have_st, journal;
+	int rv;
+
+	pkgdb_revdeps_release(xhp);
+	if (xhp->pkgdb_depnames) {
+		xbps_object_release(xhp->pkgdb_depnames);
+		xhp->pkgdb_depnames = NULL;
+	}
+
+	/*
+	 * The status of the plist is taken before reading it, so that a
+	 * cache written from it is never newer than what it records.
+	 */
+	have_st = stat(xhp->pkgdb_plist, &st) == 0;
+	journal = xbps_pkgdb_journal_exists(xhp);
+	if (have_st && !journal && xbps_pkgdb_cache_open(xhp, &st, &vpkgs) == 0)
+		goto map;
+
+	if ((xhp->pkgdb = xbps_dictionary_internalize_from_file(xhp->pkgdb_plist)) == NULL) {
+		rv = errno;
+		if (!rv)
+			rv = EINVAL;
+
+		if (rv == ENOENT)
+			xhp->pkgdb = xbps_dictionary_create();
+		else
+			xbps_error_printf("cannot access to pkgdb: %s\n", strerror(rv));
+
+		if (rv != ENOENT || !journal)
+			return rv;
+	}
+	if (journal && (rv = xbps_pkgdb_journal_replay(xhp)) < 0) {
+		xbps_error_printf("cannot replay pkgdb journal: %s\n",
+		    strerror(-rv));
+		return -rv;
+	}
+	if ((rv = pkgdb_map_names(xhp)) != 0) {
+		xbps_dbg_printf("[pkgdb] pkgdb_map_names %s\n", strerror(rv));
+		return rv;
+	}
+	if ((rv = pkgdb_vpkgs(xhp, &vpkgs)) != 0) {
+		xbps_dbg_printf("[pkgdb] pkgdb_vpkgs %s\n", strerror(-rv));
+		return -rv;
+	}
+	if (have_st && !journal && xhp->lock_fd != -1) {
+		(void)pkgdb_depnames_init(xhp);
+		xbps_pkgdb_cache_write(xhp, &st, vpkgs);
+	}
+map:
+	rv = pkgdb_map_vpkgs(xhp, vpkgs);
+	xbps_object_release(vpkgs);
+	if (rv != 0)
+		xbps_dbg_printf("[pkgdb] pkgdb_map_vpkgs %s\n", strerror(-rv));
+	return -rv;
+}
+
 int HIDDEN
 xbps_pkgdb_init(struct xbps_handle *xhp)
 {
@@ -289,14 +621,6 @@ xbps_pkgdb_init(struct xbps_handle *xhp)
 			xbps_error_printf("failed to initialize pkgdb: %s\n", strerror(rv));
 		return rv;
 	}
-	if ((rv = pkgdb_map_names(xhp)) != 0) {
-		xbps_dbg_printf("[pkgdb] pkgdb_map_names %s\n", strerror(rv));
-		return rv;
-	}
-	if ((rv = pkgdb_map_vpkgs(xhp)) != 0) {
-		xbps_dbg_printf("[pkgdb] pkgdb_map_vpkgs %s\n", strerror(rv));
-		return rv;
-	}
 	assert(xhp->pkgdb);
 	xbps_dbg_printf("[pkgdb] initialized ok.\n");
 
@@ -325,9 +649,13 @@ xbps_pkgdb_update(struct xbps_handle *xhp, bool flush, bool update)
 				return errno;
 			}
 			umask(prev_umask);
+			pkgdb_cache_update(xhp);
 		}
 		if (pkgdb_storage)
 			xbps_object_release(pkgdb_storage);
+		xbps_pkgdb_files_flush(xhp);
+		/* the journal is contained in the plist now */
+		xbps_pkgdb_journal_end(xhp, true);
 
 		xbps_object_release(xhp->pkgdb);
 		xhp->pkgdb = NULL;
@@ -336,19 +664,9 @@ xbps_pkgdb_update(struct xbps_handle *xhp, bool flush, bool update)
 	if (!update)
 		return rv;
 
-	/* update copy in memory */
-	if ((xhp->pkgdb = xbps_dictionary_internalize_from_file(xhp->pkgdb_plist)) == NULL) {
-		rv = errno;
-		if (!rv)
-			rv = EINVAL;
-
-		if (rv == ENOENT)
-			xhp->pkgdb = xbps_dictionary_create();
-		else
-			xbps_error_printf("cannot access to pkgdb: %s\n", strerror(rv));
-
-		cached_rv = rv = errno;
-	}
+	/* update copy in memory, the cache written above is up to date */
+	if ((rv = pkgdb_load(xhp)) != 0)
+		cached_rv = rv;
 
 	return rv;
 }
@@ -359,6 +677,13 @@ xbps_pkgdb_release(struct xbps_handle *xhp)
 	assert(xhp);
 
 	xbps_pkgdb_unlock(xhp);
+	xbps_pkgdb_journal_end(xhp, false);
+	xbps_pkgdb_files_release(xhp);
+	pkgdb_revdeps_release(xhp);
+	if (xhp->pkgdb_depnames) {
+		xbps_object_release(xhp->pkgdb_depnames);
+		xhp->pkgdb_depnames = NULL;
+	}
 	if (xhp->pkgdb)
 		xbps_object_release(xhp->pkgdb);
 	xbps_dbg_printf("[pkgdb] released ok.\n");
@@ -427,82 +752,128 @@ xbps_pkgdb_get_virtualpkg(struct xbps_handle *xhp, const char *vpkg)
 	return xbps_find_virtualpkg_in_dict(xhp, xhp->pkgdb, vpkg);
 }
 
-static void
+/*
+ * Creates the map of reverse dependencies from the dependencies of the
+ * installed packages.  Dependencies on virtual packages are attributed
+ * to their provider, the packages depending on each package are sorted
+ * by name.
+ */
+static int
 generate_full_revdeps_tree(struct xbps_handle *xhp)
 {
-	xbps_object_t obj;
-	xbps_object_iterator_t iter;
-	xbps_dictionary_t vpkg_cache;
+	xbps_object_t obj, obj2;
+	xbps_object_iterator_t iter, iter2;
+	xbps_dictionary_t merged, pkgs, cur;
+	int r;
 
 	if (xhp->pkgdb_revdeps)
-		return;
-
-	xhp->pkgdb_revdeps = xbps_dictionary_create();
-	assert(xhp->pkgdb_revdeps);
+		return 0;
 
-	vpkg_cache = xbps_dictionary_create();
-	assert(vpkg_cache);
+	if ((r = pkgdb_depnames_init(xhp)) < 0)
+		return r;
 
-	iter = xbps_dictionary_iterator(xhp->pkgdb);
-	assert(iter);
+	merged = xbps_dictionary_create();
+	if (!merged)
+		return -errno;
 
+	/*
+	 * First collect the packages depending on each package, this only
+	 * copies the dictionaries of dependencies on virtual packages.
+	 */
+	iter = xbps_dictionary_iterator(xhp->pkgdb_depnames);
+	if (!iter) {
+		r = -errno;
+		goto out;
+	}
 	while ((obj = xbps_object_iterator_next(iter))) {
-		xbps_array_t rundeps;
-		xbps_dictionary_t pkgd;
-		const char *pkgver = NULL;
-
-		pkgd = xbps_dictionary_get_keysym(xhp->pkgdb, obj);
-		rundeps = xbps_dictionary_get(pkgd, "run_depends");
-		if (!xbps_array_count(rundeps))
-			continue;
+		const char *depname, *v;
 
-		xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver);
-		for (unsigned int i = 0; i < xbps_array_count(rundeps); i++) {
-			xbps_array_t pkg;
-			const char *pkgdep = NULL, *v;
-			char curpkgname[XBPS_NAME_SIZE];
-			bool alloc = false;
+		depname = xbps_dictionary_keysym_cstring_nocopy(obj);
+		pkgs = xbps_dictionary_get_keysym(xhp->pkgdb_depnames, obj);
+		if ((v = vpkg_user_conf(xhp, depname)) == NULL)
+			v = depname;
 
-			xbps_array_get_cstring_nocopy(rundeps, i, &pkgdep);
-			if ((!xbps_pkgpattern_name(curpkgname, sizeof(curpkgname), pkgdep)) &&
-			    (!xbps_pkg_name(curpkgname, sizeof(curpkgname), pkgdep))) {
-					abort();
+		if ((cur = xbps_dictionary_get(merged, v)) == NULL) {
+			if (!xbps_dictionary_set(merged, v, pkgs)) {
+				r = -ENOMEM;
+				break;
 			}
-
-			/* TODO: this is kind of a workaround, to avoid calling vpkg_user_conf
-			 * over and over again for the same packages which is slow. A better
-			 * solution for itself vpkg_user_conf being slow should probably be
-			 * implemented at some point.
-			 */
-			if (!xbps_dictionary_get_cstring_nocopy(vpkg_cache, curpkgname, &v)) {
-				const char *vpkgname = vpkg_user_conf(xhp, curpkgname);
-				if (vpkgname) {
-					v = vpkgname;
-				} else {
-					v = curpkgname;
-				}
-				errno = 0;
-				if (!xbps_dictionary_set_cstring_nocopy(vpkg_cache, curpkgname, v)) {
-					xbps_error_printf("%s\n", strerror(errno ? errno : ENOMEM));
-					abort();
-				}
+			continue;
+		}
+		if ((cur = xbps_dictionary_copy_mutable(cur)) == NULL) {
+			r = -ENOMEM;
+			break;
+		}
+		iter2 = xbps_dictionary_iterator(pkgs);
+		if (!iter2) {
+			xbps_object_release(cur);
+			r = -ENOMEM;
+			break;
+		}
+		while ((obj2 = xbps_object_iterator_next(iter2))) {
+			if (!xbps_dictionary_set_keysym(cur, obj2,
+			    xbps_dictionary_get_keysym(pkgs, obj2))) {
+				r = -ENOMEM;
+				break;
 			}
+		}
+		xbps_object_iterator_release(iter2);
+		if (r == 0 && !xbps_dictionary_set(merged, v, cur))
+			r = -ENOMEM;
+		xbps_object_release(cur);
+		if (r < 0)
+			break;
+	}
+	xbps_object_iterator_release(iter);
+	if (r < 0)
+		goto out;
 
-			pkg = xbps_dictionary_get(xhp->pkgdb_revdeps, v);
-			if (pkg == NULL) {
-				alloc = true;
-				pkg = xbps_array_create();
-			}
-			if (!xbps_match_string_in_array(pkg, pkgver)) {
-				xbps_array_add_cstring_nocopy(pkg, pkgver);
-				xbps_dictionary_set(xhp->pkgdb_revdeps, v, pkg);
+	xhp->pkgdb_revdeps = xbps_dictionary_create();
+	if (!xhp->pkgdb_revdeps) {
+		r = -errno;
+		goto out;
+	}
+	iter = xbps_dictionary_iterator(merged);
+	if (!iter) {
+		r = -errno;
+		goto out;
+	}
+	while ((obj = xbps_object_iterator_next(iter))) {
+		xbps_array_t revdeps;
+
+		pkgs = xbps_dictionary_get_keysym(merged, obj);
+		revdeps = xbps_array_create_with_capacity(xbps_dictionary_count(pkgs));
+		if (!revdeps) {
+			r = -ENOMEM;
+			break;
+		}
+		iter2 = xbps_dictionary_iterator(pkgs);
+		if (!iter2) {
+			xbps_object_release(revdeps);
+			r = -ENOMEM;
+			break;
+		}
+		while ((obj2 = xbps_object_iterator_next(iter2))) {
+			if (!xbps_array_add(revdeps,
+			    xbps_dictionary_get_keysym(pkgs, obj2))) {
+				r = -ENOMEM;
+				break;
 			}
-			if (alloc)
-				xbps_object_release(pkg);
 		}
+		xbps_object_iterator_release(iter2);
+		if (r == 0 &&
+		    !xbps_dictionary_set_keysym(xhp->pkgdb_revdeps, obj, revdeps))
+			r = -ENOMEM;
+		xbps_object_release(revdeps);
+		if (r < 0)
+			break;
 	}
 	xbps_object_iterator_release(iter);
-	xbps_object_release(vpkg_cache);
+out:
+	if (r < 0)
+		pkgdb_revdeps_release(xhp);
+	xbps_object_release(merged);
+	return r;
 }
 
 xbps_array_t
@@ -515,7 +886,11 @@ xbps_pkgdb_get_pkg_revdeps(struct xbps_handle *xhp, const char *pkg)
 	if ((pkgd = xbps_pkgdb_get_pkg(xhp, pkg)) == NULL)
 		return NULL;
 
-	generate_full_revdeps_tree(xhp);
+	if (generate_full_revdeps_tree(xhp) < 0) {
+		xbps_error_printf("failed to create the map of reverse "
+		    "dependencies\n");
+		return NULL;
+	}
 	xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver);
 	if (!xbps_pkg_name(pkgname, sizeof(pkgname), pkgver)) 
 		return NULL;
@@ -528,25 +903,3 @@ xbps_pkgdb_get_pkg_fulldeptree(struct xbps_handle *xhp, const char *pkg)
 {
 	return xbps_get_pkg_fulldeptree(xhp, pkg, false);
 }
-
-xbps_dictionary_t
-xbps_pkgdb_get_pkg_files(struct xbps_handle *xhp, const char *pkg)
-{
-	xbps_dictionary_t pkgd;
-	const char *pkgver = NULL;
-	char pkgname[XBPS_NAME_SIZE], plist[PATH_MAX];
-
-	if (pkg == NULL)
-		return NULL;
-
-	pkgd = xbps_pkgdb_get_pkg(xhp, pkg);
-	if (pkgd == NULL)
-		return NULL;
-
-	xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver);
-	if (!xbps_pkg_name(pkgname, sizeof(pkgname), pkgver))
-		return NULL;
-
-	snprintf(plist, sizeof(plist)-1, "%s/.%s-files.plist", xhp->metadir, pkgname);
-	return xbps_plist_dictionary_from_file(plist);
-}
@@ -0,0 +1,357 @@
+/*-
+ * Copyright (c) 2026 xbps contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "xbps_api_impl.h"
+
+/*
+ * Binary copy of the package database, stored next to it in metadir as
+ * pkgdb-0.38.plist.cache.
+ *
+ * The plist remains the authoritative copy, the cache is recreated from
+ * it whenever it is found to be out of date and whenever the pkgdb is
+ * flushed.  It records the size, modification time and inode of the
+ * plist it was created from, and is ignored once they do not match.
+ * The lookup indexes are trusted for offsets into the mapping without
+ * being parsed, so they are covered by a checksum; the plists are
+ * validated by the parser as they are accessed.
+ *
+ * The file is the header followed by the pkgdb with the "pkgname"
+ * object of every package already set, its lookup index, the map of
+ * virtual packages provided by installed packages and the map of the
+ * dependencies of installed packages with its lookup index, each
+ * followed by a NUL byte.  The pkgdb and the map of dependencies are
+ * internalized from the mapping, so their values are only parsed when
+ * accessed.  The cache is only ever replaced by rename(2), after it has
+ * been synced, so a mapping is never modified.
+ */
+#define PKGDB_CACHE_MAGIC	"XBPSPDB"
+#define PKGDB_CACHE_VERSION	3
+#define PKGDB_CACHE_BYTEORDER	0x01020304
+
+struct pkgdb_cache_hdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteorder;
+	uint64_t src_size;
+	int64_t src_mtime;
+	int64_t src_mtime_nsec;
+	uint64_t src_ino;
+	uint64_t checksum;
+	uint64_t pkgdb_size;
+	uint64_t idx_size;
+	uint64_t vpkgs_size;
+	uint64_t depnames_size;
+	uint64_t depnames_idx_size;
+};
+
+/* Shared by the pkgdb and the map of dependencies. */
+struct pkgdb_cache_map {
+	void *addr;
+	size_t len;
+	unsigned int refs;
+};
+
+static void
+pkgdb_cache_unmap(void *arg)
+{
+	struct pkgdb_cache_map *map = arg;
+
+	if (--map->refs > 0)
+		return;
+	(void)munmap(map->addr, map->len);
+	free(map);
+}
+
+static void
+pkgdb_cache_hdr_init(struct pkgdb_cache_hdr *hdr, const struct stat *st)
+{
+	memset(hdr, 0, sizeof(*hdr));
+	memcpy(hdr->magic, PKGDB_CACHE_MAGIC, sizeof(PKGDB_CACHE_MAGIC));
+	hdr->version = PKGDB_CACHE_VERSION;
+	hdr->byteorder = PKGDB_CACHE_BYTEORDER;
+	hdr->src_size = st->st_size;
+	hdr->src_mtime = st->st_mtim.tv_sec;
+	hdr->src_mtime_nsec = st->st_mtim.tv_nsec;
+	hdr->src_ino = st->st_ino;
+}
+
+static int
+pkgdb_cache_path(char *path, size_t pathlen, struct xbps_handle *xhp)
+{
+	int r;
+
+	r = snprintf(path, pathlen, "%s.cache", xhp->pkgdb_plist);
+	if (r < 0 || (size_t)r >= pathlen)
+		return -ENAMETOOLONG;
+	return 0;
+}
+
+/*
+ * Sets up xhp->pkgdb and, if it was stored, xhp->pkgdb_depnames from the
+ * cache of the pkgdb plist, if it is up to date, and returns the map of
+ * virtual packages provided by installed packages in `vpkgsp', which has
+ * to be released by the caller.
+ * Returns 0 on success or a negative errno, in which case the plist has
+ * to be read instead.
+ */
+int HIDDEN
+xbps_pkgdb_cache_open(struct xbps_handle *xhp, const struct stat *st,
+		xbps_dictionary_t *vpkgsp)
+{
+	char path[PATH_MAX];
+	struct pkgdb_cache_hdr hdr, *fhdr;
+	struct pkgdb_cache_map *map;
+	struct stat cst;
+	const char *pkgdb, *idx, *vpkgs, *depnames, *depnames_idx;
+	xbps_dictionary_t d, depd = NULL, vpkgd = NULL;
+	size_t size;
+	uint64_t sum;
+	void *addr;
+	int fd, r;
+
+	r = pkgdb_cache_path(path, sizeof(path), xhp);
+	if (r < 0)
+		return r;
+
+	fd = open(path, O_RDONLY|O_CLOEXEC);
+	if (fd == -1)
+		return -errno;
+	if (fstat(fd, &cst) == -1) {
+		r = -errno;
+		close(fd);
+		return r;
+	}
+	if ((uint64_t)cst.st_size < sizeof(hdr) ||
+	    (uint64_t)cst.st_size > SIZE_MAX) {
+		close(fd);
+		return -EINVAL;
+	}
+	size = cst.st_size;
+	addr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	r = -errno;
+	close(fd);
+	if (addr == MAP_FAILED)
+		return r;
+
+	fhdr = addr;
+	pkgdb_cache_hdr_init(&hdr, st);
+	if (memcmp(fhdr, &hdr,
+	    offsetof(struct pkgdb_cache_hdr, checksum)) != 0) {
+		xbps_dbg_printf("[pkgdb] stale cache\n");
+		r = -ESTALE;
+		goto err;
+	}
+	/* Every member is followed by a NUL byte. */
+	if (fhdr->pkgdb_size == 0 || fhdr->pkgdb_size > size ||
+	    fhdr->idx_size > size || fhdr->vpkgs_size > size ||
+	    fhdr->depnames_size > size || fhdr->depnames_idx_size > size ||
+	    sizeof(hdr) + fhdr->pkgdb_size + fhdr->idx_size +
+	    fhdr->vpkgs_size + fhdr->depnames_size +
+	    fhdr->depnames_idx_size + 5 != size) {
+		r = -EINVAL;
+		goto err;
+	}
+	pkgdb = (const char *)addr + sizeof(hdr);
+	idx = pkgdb + fhdr->pkgdb_size + 1;
+	vpkgs = idx + fhdr->idx_size + 1;
+	depnames = vpkgs + fhdr->vpkgs_size + 1;
+	depnames_idx = depnames + fhdr->depnames_size + 1;
+	if (pkgdb[fhdr->pkgdb_size] != '\0' || idx[fhdr->idx_size] != '\0' ||
+	    vpkgs[fhdr->vpkgs_size] != '\0' ||
+	    depnames[fhdr->depnames_size] != '\0' ||
+	    depnames_idx[fhdr->depnames_idx_size] != '\0') {
+		r = -EINVAL;
+		goto err;
+	}
+	sum = xbps_checksum64(XBPS_CHECKSUM64_INIT, idx, fhdr->idx_size + 1);
+	if (xbps_checksum64(sum, depnames_idx,
+	    fhdr->depnames_idx_size + 1) != fhdr->checksum) {
+		xbps_dbg_printf("[pkgdb] corrupted cache\n");
+		r = -EINVAL;
+		goto err;
+	}
+
+	if (fhdr->vpkgs_size)
+		vpkgd = xbps_dictionary_internalize(vpkgs);
+	else
+		vpkgd = xbps_dictionary_create();
+	if (!vpkgd) {
+		r = -EINVAL;
+		goto err;
+	}
+
+	map = malloc(sizeof(*map));
+	if (!map) {
+		r = -errno;
+		goto err;
+	}
+	map->addr = addr;
+	map->len = size;
+	map->refs = 1;
+	if (fhdr->depnames_size) {
+		depd = xbps_dictionary_internalize_mapped(depnames,
+		    fhdr->depnames_size,
+		    fhdr->depnames_idx_size ? depnames_idx : NULL,
+		    fhdr->depnames_idx_size, pkgdb_cache_unmap, map);
+		if (!depd) {
+			free(map);
+			r = -EINVAL;
+			goto err;
+		}
+		map->refs++;
+	}
+	d = xbps_dictionary_internalize_mapped(pkgdb, fhdr->pkgdb_size,
+	    fhdr->idx_size ? idx : NULL, fhdr->idx_size,
+	    pkgdb_cache_unmap, map);
+	if (!d) {
+		if (depd) {
+			/* drops the reference taken for the pkgdb */
+			map->refs--;
+			xbps_object_release(depd);
+		} else {
+			free(map);
+			(void)munmap(addr, size);
+		}
+		xbps_object_release(vpkgd);
+		return -EINVAL;
+	}
+	/* From here on the mapping is owned by the dictionaries. */
+	xhp->pkgdb = d;
+	xhp->pkgdb_depnames = depd;
+	*vpkgsp = vpkgd;
+	xbps_dbg_printf("[pkgdb] using cache\n");
+	return 0;
+
+err:
+	if (vpkgd)
+		xbps_object_release(vpkgd);
+	(void)munmap(addr, size);
+	return r;
+}
+
+/*
+ * Replaces the cache of the pkgdb plist, whose status is `st', with
+ * xhp->pkgdb, the map of virtual packages `vpkgs' and, if set,
+ * xhp->pkgdb_depnames.  Every package in xhp->pkgdb must have its
+ * "pkgname" object set.  Failing to write the cache is not an error,
+ * the plist is simply read again next time.
+ */
+void HIDDEN
+xbps_pkgdb_cache_write(struct xbps_handle *xhp, const struct stat *st,
+		xbps_dictionary_t vpkgs)
+{
+	char path[PATH_MAX], tmp[PATH_MAX];
+	struct pkgdb_cache_hdr hdr;
+	char *pkgdb = NULL, *vpkgsxml = NULL, *depnames = NULL;
+	void *idx = NULL, *depnames_idx = NULL;
+	size_t idxlen = 0, depnames_idxlen = 0;
+	uint64_t sum;
+	int fd = -1, r;
+
+	if (pkgdb_cache_path(path, sizeof(path), xhp) < 0)
+		return;
+	r = snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+	if (r < 0 || (size_t)r >= sizeof(tmp))
+		return;
+
+	pkgdb = xbps_dictionary_externalize_indexed(xhp->pkgdb, &idx, &idxlen);
+	if (!pkgdb) {
+		r = -ENOMEM;
+		goto out;
+	}
+	if (xbps_dictionary_count(vpkgs) > 0 &&
+	    (vpkgsxml = xbps_dictionary_externalize(vpkgs)) == NULL) {
+		r = -ENOMEM;
+		goto out;
+	}
+	if (xhp->pkgdb_depnames &&
+	    xbps_dictionary_count(xhp->pkgdb_depnames) > 0 &&
+	    (depnames = xbps_dictionary_externalize_indexed(xhp->pkgdb_depnames,
+	    &depnames_idx, &depnames_idxlen)) == NULL) {
+		r = -ENOMEM;
+		goto out;
+	}
+
+	pkgdb_cache_hdr_init(&hdr, st);
+	hdr.pkgdb_size = strlen(pkgdb);
+	hdr.idx_size = idxlen;
+	hdr.vpkgs_size = vpkgsxml ? strlen(vpkgsxml) : 0;
+	hdr.depnames_size = depnames ? strlen(depnames) : 0;
+	hdr.depnames_idx_size = depnames_idxlen;
+	/* The checksum covers the indexes and their trailing NUL bytes. */
+	sum = xbps_checksum64(XBPS_CHECKSUM64_INIT, idx, idxlen);
+	sum = xbps_checksum64(sum, "", 1);
+	sum = xbps_checksum64(sum, depnames_idx, depnames_idxlen);
+	hdr.checksum = xbps_checksum64(sum, "", 1);
+
+	fd = mkstemp(tmp);
+	if (fd == -1) {
+		r = -errno;
+		goto out;
+	}
+	if ((r = xbps_write_all(fd, &hdr, sizeof(hdr))) < 0 ||
+	    (r = xbps_write_member(fd, pkgdb, hdr.pkgdb_size)) < 0 ||
+	    (r = xbps_write_member(fd, idx, idxlen)) < 0 ||
+	    (r = xbps_write_member(fd, vpkgsxml, hdr.vpkgs_size)) < 0 ||
+	    (r = xbps_write_member(fd, depnames, hdr.depnames_size)) < 0 ||
+	    (r = xbps_write_member(fd, depnames_idx, depnames_idxlen)) < 0)
+		goto out;
+	if (fchmod(fd, 0644) == -1 || fsync(fd) == -1 ||
+	    rename(tmp, path) == -1) {
+		r = -errno;
+		goto out;
+	}
+	close(fd);
+	fd = -1;
+	r = 0;
+
+out:
+	if (fd != -1) {
+		close(fd);
+		unlink(tmp);
+	}
+	if (r < 0) {
+		xbps_dbg_printf("[pkgdb] failed to write cache: %s\n",
+		    strerror(-r));
+	}
+	free(pkgdb);
+	free(vpkgsxml);
+	free(idx);
+	free(depnames);
+	free(depnames_idx);
+}
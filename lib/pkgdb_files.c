@@ -0,0 +1,717 @@
+/*-
+ * Copyright (c) 2026 xbps contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "xbps_api_impl.h"
+
+/*
+ * Database of the files of installed packages, stored in metadir as
+ * XBPS_PKGDB_FILES.
+ *
+ * It holds the files metadata of every installed package, as found in
+ * its <metadir>/.<pkgname>-files.plist, and a map of every path to the
+ * packages owning it, with the type ("files", "conf_files", "links" or
+ * "dirs") and the hash, size and target of the entry in each package.
+ *
+ * The per-package plists are still written when packages are unpacked
+ * and remain the authoritative copy.  The database records the
+ * "metafile-sha256" of every package it holds, an entry is read again
+ * from its plist once the pkgdb records a different hash for it, which
+ * happens when a package is registered, and dropped when the package is
+ * removed.  Only the paths map requires every package to be checked.
+ *
+ * The file is the header followed by the map of hashes, the files of
+ * packages with its lookup index and the paths map with its lookup
+ * index, each followed by a NUL byte.  The last two are internalized
+ * from the mapping, so the files of a package and the owners of a path
+ * are only parsed when accessed.  The database is only ever replaced by
+ * rename(2), so a mapping is never modified.
+ */
+#define PKGDB_FILES_MAGIC	"XBPSFDB"
+#define PKGDB_FILES_VERSION	1
+#define PKGDB_FILES_BYTEORDER	0x01020304
+
+struct pkgdb_files_hdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteorder;
+	uint64_t checksum;
+	uint64_t sums_size;
+	uint64_t pkgs_size;
+	uint64_t pkgs_idx_size;
+	uint64_t paths_size;
+	uint64_t paths_idx_size;
+};
+
+struct xbps_pkgdb_files {
+	/* pkgname -> metafile-sha256 */
+	xbps_dictionary_t sums;
+	/* pkgname -> files dictionary */
+	xbps_dictionary_t pkgs;
+	/* path -> array of owners */
+	xbps_dictionary_t paths;
+	/* every installed package has been checked */
+	bool synced;
+	bool dirty;
+};
+
+/* Shared by the files of packages and the paths map. */
+struct pkgdb_files_map {
+	void *addr;
+	size_t len;
+	unsigned int refs;
+};
+
+static const char *const pkgdb_files_types[] = {
+	"files", "conf_files", "links", "dirs",
+};
+
+static void
+pkgdb_files_unmap(void *arg)
+{
+	struct pkgdb_files_map *map = arg;
+
+	if (--map->refs > 0)
+		return;
+	(void)munmap(map->addr, map->len);
+	free(map);
+}
+
+static void
+pkgdb_files_hdr_init(struct pkgdb_files_hdr *hdr)
+{
+	memset(hdr, 0, sizeof(*hdr));
+	memcpy(hdr->magic, PKGDB_FILES_MAGIC, sizeof(PKGDB_FILES_MAGIC));
+	hdr->version = PKGDB_FILES_VERSION;
+	hdr->byteorder = PKGDB_FILES_BYTEORDER;
+}
+
+static int
+pkgdb_files_path(char *path, size_t pathlen, struct xbps_handle *xhp)
+{
+	int r;
+
+	r = snprintf(path, pathlen, "%s/%s", xhp->metadir, XBPS_PKGDB_FILES);
+	if (r < 0 || (size_t)r >= pathlen)
+		return -ENAMETOOLONG;
+	return 0;
+}
+
+/*
+ * Reads the database into `f'.  Returns 0 on success or a negative
+ * errno, in which case `f' is left untouched.
+ */
+static int
+pkgdb_files_read(struct xbps_handle *xhp, struct xbps_pkgdb_files *f)
+{
+	char path[PATH_MAX];
+	struct pkgdb_files_hdr hdr, *fhdr;
+	struct pkgdb_files_map *map;
+	struct stat st;
+	const char *sums, *pkgs, *pkgs_idx, *paths, *paths_idx;
+	xbps_dictionary_t sumsd = NULL, pkgsd = NULL, pathsd = NULL;
+	size_t size;
+	void *addr;
+	int fd, r;
+
+	if ((r = pkgdb_files_path(path, sizeof(path), xhp)) < 0)
+		return r;
+	fd = open(path, O_RDONLY|O_CLOEXEC);
+	if (fd == -1)
+		return -errno;
+	if (fstat(fd, &st) == -1) {
+		r = -errno;
+		close(fd);
+		return r;
+	}
+	if ((uint64_t)st.st_size < sizeof(hdr) ||
+	    (uint64_t)st.st_size > SIZE_MAX) {
+		close(fd);
+		return -EINVAL;
+	}
+	size = st.st_size;
+	addr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	r = -errno;
+	close(fd);
+	if (addr == MAP_FAILED)
+		return r;
+
+	fhdr = addr;
+	pkgdb_files_hdr_init(&hdr);
+	if (memcmp(fhdr, &hdr, offsetof(struct pkgdb_files_hdr, checksum)) != 0) {
+		r = -EINVAL;
+		goto err;
+	}
+	/* Every member is followed by a NUL byte. */
+	if (fhdr->sums_size > size || fhdr->pkgs_size > size ||
+	    fhdr->pkgs_idx_size > size || fhdr->paths_size > size ||
+	    fhdr->paths_idx_size > size ||
+	    sizeof(hdr) + fhdr->sums_size + fhdr->pkgs_size +
+	    fhdr->pkgs_idx_size + fhdr->paths_size +
+	    fhdr->paths_idx_size + 5 != size) {
+		r = -EINVAL;
+		goto err;
+	}
+	sums = (const char *)addr + sizeof(hdr);
+	pkgs = sums + fhdr->sums_size + 1;
+	pkgs_idx = pkgs + fhdr->pkgs_size + 1;
+	paths = pkgs_idx + fhdr->pkgs_idx_size + 1;
+	paths_idx = paths + fhdr->paths_size + 1;
+	if (sums[fhdr->sums_size] != '\0' || pkgs[fhdr->pkgs_size] != '\0' ||
+	    pkgs_idx[fhdr->pkgs_idx_size] != '\0' ||
+	    paths[fhdr->paths_size] != '\0' ||
+	    paths_idx[fhdr->paths_idx_size] != '\0') {
+		r = -EINVAL;
+		goto err;
+	}
+	if (xbps_checksum64(XBPS_CHECKSUM64_INIT, sums,
+	    size - sizeof(hdr)) != fhdr->checksum) {
+		xbps_dbg_printf("[pkgdb] corrupted files database\n");
+		r = -EINVAL;
+		goto err;
+	}
+	/* An empty database does not need the mapping. */
+	if (fhdr->sums_size == 0 || fhdr->pkgs_size == 0 ||
+	    fhdr->paths_size == 0) {
+		(void)munmap(addr, size);
+		return -ENOENT;
+	}
+
+	if ((sumsd = xbps_dictionary_internalize(sums)) == NULL) {
+		r = -EINVAL;
+		goto err;
+	}
+	map = malloc(sizeof(*map));
+	if (!map) {
+		r = -errno;
+		goto err;
+	}
+	map->addr = addr;
+	map->len = size;
+	map->refs = 1;
+	pathsd = xbps_dictionary_internalize_mapped(paths, fhdr->paths_size,
+	    fhdr->paths_idx_size ? paths_idx : NULL, fhdr->paths_idx_size,
+	    pkgdb_files_unmap, map);
+	if (!pathsd) {
+		free(map);
+		r = -EINVAL;
+		goto err;
+	}
+	map->refs++;
+	pkgsd = xbps_dictionary_internalize_mapped(pkgs, fhdr->pkgs_size,
+	    fhdr->pkgs_idx_size ? pkgs_idx : NULL, fhdr->pkgs_idx_size,
+	    pkgdb_files_unmap, map);
+	if (!pkgsd) {
+		/* drops the reference taken for the files of packages */
+		map->refs--;
+		xbps_object_release(pathsd);
+		xbps_object_release(sumsd);
+		return -EINVAL;
+	}
+	/* From here on the mapping is owned by the dictionaries. */
+	f->sums = sumsd;
+	f->pkgs = pkgsd;
+	f->paths = pathsd;
+	xbps_dbg_printf("[pkgdb] using files database\n");
+	return 0;
+
+err:
+	if (sumsd)
+		xbps_object_release(sumsd);
+	(void)munmap(addr, size);
+	return r;
+}
+
+/*
+ * Replaces the database with `f'.  Failing to write it is not an error,
+ * the per-package plists are simply read again next time.
+ */
+static void
+pkgdb_files_write(struct xbps_handle *xhp, struct xbps_pkgdb_files *f)
+{
+	char path[PATH_MAX], tmp[PATH_MAX];
+	struct pkgdb_files_hdr hdr;
+	char *sums = NULL, *pkgs = NULL, *paths = NULL;
+	void *pkgs_idx = NULL, *paths_idx = NULL;
+	size_t pkgs_idxlen = 0, paths_idxlen = 0;
+	uint64_t sum;
+	int fd = -1, r;
+
+	if (pkgdb_files_path(path, sizeof(path), xhp) < 0)
+		return;
+	r = snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+	if (r < 0 || (size_t)r >= sizeof(tmp))
+		return;
+
+	if (xbps_dictionary_count(f->sums) > 0) {
+		if ((sums = xbps_dictionary_externalize(f->sums)) == NULL ||
+		    (pkgs = xbps_dictionary_externalize_indexed(f->pkgs,
+		    &pkgs_idx, &pkgs_idxlen)) == NULL ||
+		    (paths = xbps_dictionary_externalize_indexed(f->paths,
+		    &paths_idx, &paths_idxlen)) == NULL) {
+			r = -ENOMEM;
+			goto out;
+		}
+	}
+
+	pkgdb_files_hdr_init(&hdr);
+	hdr.sums_size = sums ? strlen(sums) : 0;
+	hdr.pkgs_size = pkgs ? strlen(pkgs) : 0;
+	hdr.pkgs_idx_size = pkgs_idxlen;
+	hdr.paths_size = paths ? strlen(paths) : 0;
+	hdr.paths_idx_size = paths_idxlen;
+	/* The checksum covers every member and its trailing NUL byte. */
+	sum = xbps_checksum64(XBPS_CHECKSUM64_INIT, sums,
+	    hdr.sums_size);
+	sum = xbps_checksum64(sum, "", 1);
+	sum = xbps_checksum64(sum, pkgs, hdr.pkgs_size);
+	sum = xbps_checksum64(sum, "", 1);
+	sum = xbps_checksum64(sum, pkgs_idx, pkgs_idxlen);
+	sum = xbps_checksum64(sum, "", 1);
+	sum = xbps_checksum64(sum, paths, hdr.paths_size);
+	sum = xbps_checksum64(sum, "", 1);
+	sum = xbps_checksum64(sum, paths_idx, paths_idxlen);
+	hdr.checksum = xbps_checksum64(sum, "", 1);
+
+	fd = mkstemp(tmp);
+	if (fd == -1) {
+		r = -errno;
+		goto out;
+	}
+	if ((r = xbps_write_all(fd, &hdr, sizeof(hdr))) < 0 ||
+	    (r = xbps_write_member(fd, sums, hdr.sums_size)) < 0 ||
+	    (r = xbps_write_member(fd, pkgs, hdr.pkgs_size)) < 0 ||
+	    (r = xbps_write_member(fd, pkgs_idx, pkgs_idxlen)) < 0 ||
+	    (r = xbps_write_member(fd, paths, hdr.paths_size)) < 0 ||
+	    (r = xbps_write_member(fd, paths_idx, paths_idxlen)) < 0)
+		goto out;
+	if (fchmod(fd, 0644) == -1 || rename(tmp, path) == -1) {
+		r = -errno;
+		goto out;
+	}
+	close(fd);
+	fd = -1;
+	r = 0;
+	f->dirty = false;
+
+out:
+	if (fd != -1) {
+		close(fd);
+		unlink(tmp);
+	}
+	if (r < 0) {
+		xbps_dbg_printf("[pkgdb] failed to write files database: %s\n",
+		    strerror(-r));
+	}
+	free(sums);
+	free(pkgs);
+	free(pkgs_idx);
+	free(paths);
+	free(paths_idx);
+}
+
+/*
+ * The database is shared by the threads of xbps_pkgdb_foreach_cb_multi(),
+ * it is created and used with this lock held.
+ */
+static pthread_mutex_t pkgdb_files_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct xbps_pkgdb_files *
+pkgdb_files_get(struct xbps_handle *xhp)
+{
+	struct xbps_pkgdb_files *f;
+
+	if (xhp->pkgdb_files)
+		return xhp->pkgdb_files;
+
+	if ((f = calloc(1, sizeof(*f))) == NULL)
+		return NULL;
+	if (pkgdb_files_read(xhp, f) < 0) {
+		f->sums = xbps_dictionary_create();
+		f->pkgs = xbps_dictionary_create();
+		f->paths = xbps_dictionary_create();
+		if (!f->sums || !f->pkgs || !f->paths) {
+			if (f->sums)
+				xbps_object_release(f->sums);
+			if (f->pkgs)
+				xbps_object_release(f->pkgs);
+			free(f);
+			return NULL;
+		}
+	}
+	xhp->pkgdb_files = f;
+	return f;
+}
+
+/*
+ * Returns a copy of the dictionaries and arrays in `obj', sharing only
+ * its strings, numbers and data objects, so that callers can modify the
+ * files of a package without changing the database.
+ */
+static xbps_object_t
+pkgdb_files_copy(xbps_object_t obj)
+{
+	xbps_object_iterator_t iter;
+	xbps_object_t copy, o, oc;
+	bool ok = true;
+
+	if (xbps_object_type(obj) == XBPS_TYPE_ARRAY) {
+		copy = xbps_array_create_with_capacity(xbps_array_count(obj));
+		if (copy == NULL)
+			return NULL;
+		for (unsigned int i = 0; ok && i < xbps_array_count(obj); i++) {
+			if ((oc = pkgdb_files_copy(xbps_array_get(obj, i))) == NULL)
+				ok = false;
+			else {
+				ok = xbps_array_add(copy, oc);
+				xbps_object_release(oc);
+			}
+		}
+	} else if (xbps_object_type(obj) == XBPS_TYPE_DICTIONARY) {
+		copy = xbps_dictionary_create_with_capacity(
+		    xbps_dictionary_count(obj));
+		if (copy == NULL)
+			return NULL;
+		if ((iter = xbps_dictionary_iterator(obj)) == NULL) {
+			xbps_object_release(copy);
+			return NULL;
+		}
+		while (ok && (o = xbps_object_iterator_next(iter))) {
+			oc = pkgdb_files_copy(
+			    xbps_dictionary_get_keysym(obj, o));
+			if (oc == NULL)
+				ok = false;
+			else {
+				ok = xbps_dictionary_set_keysym(copy, o, oc);
+				xbps_object_release(oc);
+			}
+		}
+		xbps_object_iterator_release(iter);
+	} else {
+		xbps_object_retain(obj);
+		return obj;
+	}
+	if (!ok) {
+		xbps_object_release(copy);
+		return NULL;
+	}
+	return copy;
+}
+
+static int
+pkgdb_files_add_paths(struct xbps_pkgdb_files *f, const char *pkgname,
+		xbps_dictionary_t filesd)
+{
+	static const char *const keys[] = { "sha256", "size", "target" };
+
+	for (size_t i = 0; i < __arraycount(pkgdb_files_types); i++) {
+		xbps_array_t entries;
+
+		entries = xbps_dictionary_get(filesd, pkgdb_files_types[i]);
+		for (unsigned int j = 0; j < xbps_array_count(entries); j++) {
+			xbps_dictionary_t entry, owner;
+			xbps_array_t owners;
+			const char *file = NULL;
+			bool ok;
+
+			entry = xbps_array_get(entries, j);
+			if (!xbps_dictionary_get_cstring_nocopy(entry, "file", &file))
+				continue;
+
+			owner = xbps_dictionary_create();
+			if (!owner)
+				return -ENOMEM;
+			ok = xbps_dictionary_set_cstring(owner, "pkgname", pkgname) &&
+			    xbps_dictionary_set_cstring_nocopy(owner, "type",
+			    pkgdb_files_types[i]);
+			for (size_t k = 0; ok && k < __arraycount(keys); k++) {
+				xbps_object_t obj;
+
+				if ((obj = xbps_dictionary_get(entry, keys[k])))
+					ok = xbps_dictionary_set(owner, keys[k], obj);
+			}
+			if (ok && (owners = xbps_dictionary_get(f->paths, file)) == NULL) {
+				if ((owners = xbps_array_create()) == NULL) {
+					ok = false;
+				} else {
+					ok = xbps_dictionary_set(f->paths, file, owners);
+					xbps_object_release(owners);
+				}
+			}
+			ok = ok && xbps_array_add(owners, owner);
+			xbps_object_release(owner);
+			if (!ok)
+				return -ENOMEM;
+		}
+	}
+	return 0;
+}
+
+static void
+pkgdb_files_del_paths(struct xbps_pkgdb_files *f, const char *pkgname,
+		xbps_dictionary_t filesd)
+{
+	for (size_t i = 0; i < __arraycount(pkgdb_files_types); i++) {
+		xbps_array_t entries;
+
+		entries = xbps_dictionary_get(filesd, pkgdb_files_types[i]);
+		for (unsigned int j = 0; j < xbps_array_count(entries); j++) {
+			xbps_array_t owners;
+			const char *file = NULL;
+
+			if (!xbps_dictionary_get_cstring_nocopy(
+			    xbps_array_get(entries, j), "file", &file))
+				continue;
+			if ((owners = xbps_dictionary_get(f->paths, file)) == NULL)
+				continue;
+			for (unsigned int k = xbps_array_count(owners); k-- > 0;) {
+				const char *owner = NULL;
+
+				xbps_dictionary_get_cstring_nocopy(
+				    xbps_array_get(owners, k), "pkgname", &owner);
+				if (owner && strcmp(owner, pkgname) == 0)
+					xbps_array_remove(owners, k);
+			}
+			if (xbps_array_count(owners) == 0)
+				xbps_dictionary_remove(f->paths, file);
+		}
+	}
+}
+
+static void
+pkgdb_files_del(struct xbps_pkgdb_files *f, const char *pkgname)
+{
+	xbps_dictionary_t filesd;
+
+	if ((filesd = xbps_dictionary_get(f->pkgs, pkgname)))
+		pkgdb_files_del_paths(f, pkgname, filesd);
+	xbps_dictionary_remove(f->pkgs, pkgname);
+	xbps_dictionary_remove(f->sums, pkgname);
+	f->dirty = true;
+}
+
+/*
+ * Brings the entry of the package `pkgname' up to date with the pkgdb,
+ * reading its files plist again if the pkgdb records a different hash.
+ */
+static int
+pkgdb_files_refresh(struct xbps_handle *xhp, struct xbps_pkgdb_files *f,
+		const char *pkgname)
+{
+	char plist[PATH_MAX];
+	xbps_dictionary_t pkgd, filesd;
+	const char *sha256 = NULL, *cursha256 = NULL;
+	int r;
+
+	if ((pkgd = xbps_dictionary_get(xhp->pkgdb, pkgname)))
+		xbps_dictionary_get_cstring_nocopy(pkgd, "metafile-sha256", &sha256);
+	xbps_dictionary_get_cstring_nocopy(f->sums, pkgname, &cursha256);
+	if (sha256 == NULL && cursha256 == NULL)
+		return 0;
+	if (sha256 && cursha256 && strcmp(sha256, cursha256) == 0)
+		return 0;
+
+	if (cursha256)
+		pkgdb_files_del(f, pkgname);
+	if (sha256 == NULL)
+		return 0;
+
+	r = snprintf(plist, sizeof(plist), "%s/.%s-files.plist",
+	    xhp->metadir, pkgname);
+	if (r < 0 || (size_t)r >= sizeof(plist))
+		return -ENAMETOOLONG;
+	if ((filesd = xbps_plist_dictionary_from_file(plist)) == NULL) {
+		xbps_dbg_printf("[pkgdb] cannot read %s\n", plist);
+		return 0;
+	}
+	if (!xbps_dictionary_set(f->pkgs, pkgname, filesd) ||
+	    !xbps_dictionary_set_cstring(f->sums, pkgname, sha256) ||
+	    (r = pkgdb_files_add_paths(f, pkgname, filesd)) < 0) {
+		xbps_object_release(filesd);
+		pkgdb_files_del(f, pkgname);
+		return -ENOMEM;
+	}
+	xbps_object_release(filesd);
+	f->dirty = true;
+	return 0;
+}
+
+/*
+ * Checks every installed package, and drops the packages which are no
+ * longer installed, before the paths map is used.
+ */
+static int
+pkgdb_files_sync(struct xbps_handle *xhp, struct xbps_pkgdb_files *f)
+{
+	xbps_array_t keys;
+	int r = 0;
+
+	if (f->synced)
+		return 0;
+
+	if ((keys = xbps_dictionary_all_keys(xhp->pkgdb)) == NULL)
+		return -ENOMEM;
+	for (unsigned int i = 0; r == 0 && i < xbps_array_count(keys); i++) {
+		const char *pkgname;
+
+		pkgname = xbps_dictionary_keysym_cstring_nocopy(
+		    xbps_array_get(keys, i));
+		r = pkgdb_files_refresh(xhp, f, pkgname);
+	}
+	xbps_object_release(keys);
+	if (r < 0)
+		return r;
+
+	if ((keys = xbps_dictionary_all_keys(f->sums)) == NULL)
+		return -ENOMEM;
+	for (unsigned int i = 0; i < xbps_array_count(keys); i++) {
+		const char *pkgname;
+
+		pkgname = xbps_dictionary_keysym_cstring_nocopy(
+		    xbps_array_get(keys, i));
+		if (!xbps_dictionary_get(xhp->pkgdb, pkgname))
+			pkgdb_files_del(f, pkgname);
+	}
+	xbps_object_release(keys);
+	f->synced = true;
+	return 0;
+}
+
+/*
+ * Updates the files of the package `pkgname' after it has been
+ * registered in or removed from the pkgdb.
+ */
+void HIDDEN
+xbps_pkgdb_files_update(struct xbps_handle *xhp, const char *pkgname)
+{
+	struct xbps_pkgdb_files *f;
+	int r = 0;
+
+	pthread_mutex_lock(&pkgdb_files_lock);
+	if ((f = pkgdb_files_get(xhp)) != NULL)
+		r = pkgdb_files_refresh(xhp, f, pkgname);
+	pthread_mutex_unlock(&pkgdb_files_lock);
+	if (r < 0) {
+		xbps_dbg_printf("[pkgdb] failed to update files of %s: %s\n",
+		    pkgname, strerror(-r));
+	}
+}
+
+/*
+ * Writes the database if it has been changed, called when the pkgdb is
+ * written so that commands which only read it leave the file alone.
+ */
+void HIDDEN
+xbps_pkgdb_files_flush(struct xbps_handle *xhp)
+{
+	struct xbps_pkgdb_files *f;
+
+	pthread_mutex_lock(&pkgdb_files_lock);
+	if ((f = xhp->pkgdb_files) != NULL && f->dirty) {
+		pkgdb_files_write(xhp, f);
+		f->dirty = false;
+	}
+	pthread_mutex_unlock(&pkgdb_files_lock);
+}
+
+/*
+ * Releases the database, changes not written by xbps_pkgdb_files_flush()
+ * are discarded.
+ */
+void HIDDEN
+xbps_pkgdb_files_release(struct xbps_handle *xhp)
+{
+	struct xbps_pkgdb_files *f = xhp->pkgdb_files;
+
+	if (f == NULL)
+		return;
+	xbps_object_release(f->sums);
+	xbps_object_release(f->pkgs);
+	xbps_object_release(f->paths);
+	free(f);
+	xhp->pkgdb_files = NULL;
+}
+
+xbps_dictionary_t
+xbps_pkgdb_get_pkg_files(struct xbps_handle *xhp, const char *pkg)
+{
+	struct xbps_pkgdb_files *f;
+	xbps_dictionary_t pkgd, filesd = NULL;
+	const char *pkgver = NULL;
+	char pkgname[XBPS_NAME_SIZE];
+
+	if (pkg == NULL)
+		return NULL;
+
+	pkgd = xbps_pkgdb_get_pkg(xhp, pkg);
+	if (pkgd == NULL)
+		return NULL;
+
+	xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver);
+	if (!xbps_pkg_name(pkgname, sizeof(pkgname), pkgver))
+		return NULL;
+
+	pthread_mutex_lock(&pkgdb_files_lock);
+	if ((f = pkgdb_files_get(xhp)) != NULL &&
+	    pkgdb_files_refresh(xhp, f, pkgname) == 0 &&
+	    (filesd = xbps_dictionary_get(f->pkgs, pkgname)) != NULL)
+		filesd = pkgdb_files_copy(filesd);
+	pthread_mutex_unlock(&pkgdb_files_lock);
+	return filesd;
+}
+
+xbps_array_t
+xbps_pkgdb_get_file_owners(struct xbps_handle *xhp, const char *path)
+{
+	struct xbps_pkgdb_files *f;
+	xbps_array_t owners = NULL;
+	int r = -ENOMEM;
+
+	if (path == NULL || xbps_pkgdb_init(xhp) != 0)
+		return NULL;
+	pthread_mutex_lock(&pkgdb_files_lock);
+	if ((f = pkgdb_files_get(xhp)) != NULL &&
+	    (r = pkgdb_files_sync(xhp, f)) == 0)
+		owners = xbps_dictionary_get(f->paths, path);
+	pthread_mutex_unlock(&pkgdb_files_lock);
+	if (r < 0) {
+		xbps_dbg_printf("[pkgdb] failed to check files database: %s\n",
+		    strerror(-r));
+	}
+	return owners;
+}
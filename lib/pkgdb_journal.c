@@ -0,0 +1,398 @@
+/*-
+ * Copyright (c) 2026 xbps contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "xbps_api_impl.h"
+
+/*
+ * Journal of the changes made to the pkgdb during a transaction, stored
+ * next to it in metadir as pkgdb-0.38.plist.journal.
+ *
+ * Every change to a package is appended as a record holding its new
+ * dictionary, or none if it was removed, so the cost of a change does
+ * not depend on the size of the pkgdb.  The journal is made durable at
+ * the points where the pkgdb used to be written in the middle of the
+ * transaction and is compacted into the plist when the pkgdb is flushed
+ * at its end, whether it succeeded or failed.  If the process is
+ * interrupted, the journal is replayed on top of the plist when the
+ * pkgdb is loaded.
+ *
+ * Records only hold absolute states, so replaying a journal that has
+ * already been compacted is harmless.  A record that was not completely
+ * written ends the journal.
+ */
+#define PKGDB_JOURNAL_MAGIC	"XBPSPDJ"
+#define PKGDB_JOURNAL_VERSION	1
+#define PKGDB_JOURNAL_BYTEORDER	0x01020304
+#define PKGDB_JOURNAL_REC_MAGIC	0x4a524543
+
+enum {
+	PKGDB_JOURNAL_SET = 1,
+	PKGDB_JOURNAL_REMOVE = 2,
+};
+
+struct pkgdb_journal_hdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteorder;
+};
+
+struct pkgdb_journal_rec {
+	uint32_t magic;
+	uint32_t type;
+	uint32_t keylen;
+	uint32_t datalen;
+	uint64_t checksum;
+};
+
+static int
+pkgdb_journal_path(char *path, size_t pathlen, struct xbps_handle *xhp)
+{
+	int r;
+
+	r = snprintf(path, pathlen, "%s.journal", xhp->pkgdb_plist);
+	if (r < 0 || (size_t)r >= pathlen)
+		return -ENAMETOOLONG;
+	return 0;
+}
+
+static int
+pkgdb_journal_fsync(const char *path, int flags)
+{
+	int fd, r = 0;
+
+	fd = open(path, O_RDONLY|O_CLOEXEC|flags);
+	if (fd == -1)
+		return -errno;
+	if (fsync(fd) == -1)
+		r = -errno;
+	close(fd);
+	return r;
+}
+
+static void
+pkgdb_journal_hdr_init(struct pkgdb_journal_hdr *hdr)
+{
+	memset(hdr, 0, sizeof(*hdr));
+	memcpy(hdr->magic, PKGDB_JOURNAL_MAGIC, sizeof(PKGDB_JOURNAL_MAGIC));
+	hdr->version = PKGDB_JOURNAL_VERSION;
+	hdr->byteorder = PKGDB_JOURNAL_BYTEORDER;
+}
+
+/*
+ * Calls `fn' for every complete record of the journal in `buf' and
+ * returns the size of the valid part of the journal, or a negative
+ * errno if it has no valid header or `fn' fails.
+ */
+static ssize_t
+pkgdb_journal_scan(const char *buf, size_t size,
+		int (*fn)(const struct pkgdb_journal_rec *, const char *, void *),
+		void *arg)
+{
+	struct pkgdb_journal_hdr hdr;
+	struct pkgdb_journal_rec rec;
+	size_t off;
+	int r;
+
+	pkgdb_journal_hdr_init(&hdr);
+	if (size < sizeof(hdr) || memcmp(buf, &hdr, sizeof(hdr)) != 0)
+		return -EINVAL;
+
+	for (off = sizeof(hdr); size - off >= sizeof(rec);) {
+		memcpy(&rec, buf + off, sizeof(rec));
+		if (rec.magic != PKGDB_JOURNAL_REC_MAGIC ||
+		    (rec.type != PKGDB_JOURNAL_SET &&
+		     rec.type != PKGDB_JOURNAL_REMOVE) ||
+		    rec.keylen == 0 ||
+		    rec.keylen > size - off - sizeof(rec) ||
+		    rec.datalen > size - off - sizeof(rec) - rec.keylen)
+			break;
+		if (xbps_checksum64(XBPS_CHECKSUM64_INIT,
+		    buf + off + sizeof(rec), rec.keylen + rec.datalen) !=
+		    rec.checksum)
+			break;
+		if (fn && (r = fn(&rec, buf + off + sizeof(rec), arg)) < 0)
+			return r;
+		off += sizeof(rec) + rec.keylen + rec.datalen;
+	}
+	return off;
+}
+
+static int
+pkgdb_journal_apply(const struct pkgdb_journal_rec *rec, const char *p,
+		void *arg)
+{
+	struct xbps_handle *xhp = arg;
+	xbps_dictionary_t d;
+	char *key, *data;
+
+	key = strndup(p, rec->keylen);
+	if (!key)
+		return -errno;
+	if (rec->type == PKGDB_JOURNAL_REMOVE) {
+		xbps_dictionary_remove(xhp->pkgdb, key);
+		free(key);
+		return 0;
+	}
+	data = strndup(p + rec->keylen, rec->datalen);
+	if (!data) {
+		free(key);
+		return -errno;
+	}
+	d = xbps_dictionary_internalize(data);
+	free(data);
+	if (!d || !xbps_dictionary_set(xhp->pkgdb, key, d)) {
+		free(key);
+		if (d)
+			xbps_object_release(d);
+		return -EINVAL;
+	}
+	xbps_dbg_printf("[pkgdb] journal: replayed %s\n", key);
+	xbps_object_release(d);
+	free(key);
+	return 0;
+}
+
+/*
+ * Returns true if a journal was left behind by an interrupted
+ * transaction.
+ */
+bool HIDDEN
+xbps_pkgdb_journal_exists(struct xbps_handle *xhp)
+{
+	char path[PATH_MAX];
+	struct stat st;
+
+	if (pkgdb_journal_path(path, sizeof(path), xhp) < 0)
+		return false;
+	return stat(path, &st) == 0 &&
+	    (size_t)st.st_size > sizeof(struct pkgdb_journal_hdr);
+}
+
+/*
+ * Applies the journal to xhp->pkgdb, which has been read from the plist.
+ * Returns 0 on success or a negative errno.
+ */
+int HIDDEN
+xbps_pkgdb_journal_replay(struct xbps_handle *xhp)
+{
+	char path[PATH_MAX];
+	struct stat st;
+	ssize_t len;
+	void *addr;
+	int fd, r;
+
+	if ((r = pkgdb_journal_path(path, sizeof(path), xhp)) < 0)
+		return r;
+	fd = open(path, O_RDONLY|O_CLOEXEC);
+	if (fd == -1)
+		return errno == ENOENT ? 0 : -errno;
+	if (fstat(fd, &st) == -1) {
+		r = -errno;
+		close(fd);
+		return r;
+	}
+	if (st.st_size == 0) {
+		close(fd);
+		return 0;
+	}
+	addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	r = -errno;
+	close(fd);
+	if (addr == MAP_FAILED)
+		return r;
+
+	len = pkgdb_journal_scan(addr, st.st_size, pkgdb_journal_apply, xhp);
+	(void)munmap(addr, st.st_size);
+	if (len < 0) {
+		xbps_dbg_printf("[pkgdb] journal: failed to replay: %s\n",
+		    strerror(-len));
+		return len;
+	}
+	if (len != st.st_size) {
+		xbps_dbg_printf("[pkgdb] journal: ignored %zu bytes of "
+		    "incomplete records\n", (size_t)(st.st_size - len));
+	}
+	return 0;
+}
+
+/*
+ * Starts journaling the changes made to the pkgdb.  A journal left
+ * behind by an interrupted transaction, which has already been replayed
+ * into xhp->pkgdb, is continued after its last complete record.
+ * Returns 0 on success or a negative errno, in which case the pkgdb is
+ * written instead.
+ */
+int HIDDEN
+xbps_pkgdb_journal_begin(struct xbps_handle *xhp)
+{
+	char path[PATH_MAX];
+	struct pkgdb_journal_hdr hdr;
+	struct stat st;
+	ssize_t len = 0;
+	void *addr;
+	int fd, r;
+
+	if (xhp->journal_fd != -1)
+		return 0;
+	xhp->journal_failed = false;
+
+	if ((r = pkgdb_journal_path(path, sizeof(path), xhp)) < 0)
+		return r;
+	fd = open(path, O_RDWR|O_CREAT|O_CLOEXEC, 0644);
+	if (fd == -1)
+		return -errno;
+	if (fstat(fd, &st) == -1)
+		goto err;
+
+	if (st.st_size > 0) {
+		addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (addr == MAP_FAILED)
+			goto err;
+		len = pkgdb_journal_scan(addr, st.st_size, NULL, NULL);
+		(void)munmap(addr, st.st_size);
+		if (len < 0)
+			len = 0;
+	}
+	if (len == 0) {
+		pkgdb_journal_hdr_init(&hdr);
+		if (ftruncate(fd, 0) == -1 ||
+		    (r = xbps_write_all(fd, &hdr, sizeof(hdr))) < 0) {
+			errno = -r;
+			goto err;
+		}
+	} else if (ftruncate(fd, len) == -1 ||
+	    lseek(fd, len, SEEK_SET) == -1) {
+		goto err;
+	}
+	xhp->journal_fd = fd;
+	xbps_dbg_printf("[pkgdb] journal: started\n");
+	return 0;
+
+err:
+	r = -errno;
+	close(fd);
+	return r;
+}
+
+/*
+ * Appends the current state of the entry `key' of xhp->pkgdb to the
+ * journal, if one is in use.
+ */
+void HIDDEN
+xbps_pkgdb_journal_add(struct xbps_handle *xhp, const char *key)
+{
+	struct pkgdb_journal_rec rec;
+	xbps_dictionary_t d;
+	char *data = NULL;
+	int r;
+
+	if (xhp->journal_fd == -1 || xhp->journal_failed)
+		return;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.magic = PKGDB_JOURNAL_REC_MAGIC;
+	rec.keylen = strlen(key);
+	if ((d = xbps_dictionary_get(xhp->pkgdb, key)) != NULL) {
+		if ((data = xbps_dictionary_externalize(d)) == NULL) {
+			r = -ENOMEM;
+			goto err;
+		}
+		rec.type = PKGDB_JOURNAL_SET;
+		rec.datalen = strlen(data);
+	} else {
+		rec.type = PKGDB_JOURNAL_REMOVE;
+	}
+	rec.checksum = xbps_checksum64(XBPS_CHECKSUM64_INIT,
+	    key, rec.keylen);
+	rec.checksum = xbps_checksum64(rec.checksum, data, rec.datalen);
+
+	if ((r = xbps_write_all(xhp->journal_fd, &rec, sizeof(rec))) < 0 ||
+	    (r = xbps_write_all(xhp->journal_fd, key, rec.keylen)) < 0 ||
+	    (r = xbps_write_all(xhp->journal_fd, data, rec.datalen)) < 0)
+		goto err;
+	free(data);
+	return;
+
+err:
+	free(data);
+	xbps_dbg_printf("[pkgdb] journal: failed to append %s: %s\n",
+	    key, strerror(-r));
+	xhp->journal_failed = true;
+}
+
+/*
+ * Makes the changes made to the pkgdb so far durable, by syncing the
+ * journal if it is in use or by writing the pkgdb otherwise.  Returns 0
+ * on success or an errno.
+ */
+int HIDDEN
+xbps_pkgdb_journal_sync(struct xbps_handle *xhp)
+{
+	if (xhp->journal_fd == -1 || xhp->journal_failed)
+		return xbps_pkgdb_update(xhp, true, true);
+	if (fdatasync(xhp->journal_fd) == -1)
+		return errno;
+	return 0;
+}
+
+/*
+ * Stops journaling the changes made to the pkgdb.  If `compacted' is set
+ * the pkgdb has been written and the journal is removed, once the plist
+ * and its directory entry have been synced.
+ */
+void HIDDEN
+xbps_pkgdb_journal_end(struct xbps_handle *xhp, bool compacted)
+{
+	char path[PATH_MAX];
+	int r;
+
+	if (xhp->journal_fd != -1) {
+		close(xhp->journal_fd);
+		xhp->journal_fd = -1;
+	}
+	xhp->journal_failed = false;
+	if (!compacted || pkgdb_journal_path(path, sizeof(path), xhp) < 0)
+		return;
+	if ((r = pkgdb_journal_fsync(xhp->pkgdb_plist, 0)) < 0 ||
+	    (r = pkgdb_journal_fsync(xhp->metadir, O_DIRECTORY)) < 0) {
+		xbps_dbg_printf("[pkgdb] journal: cannot sync pkgdb: %s\n",
+		    strerror(-r));
+		return;
+	}
+	if (unlink(path) == 0)
+		xbps_dbg_printf("[pkgdb] journal: compacted\n");
+}
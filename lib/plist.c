@@ -228,6 +228,43 @@ xbps_array_foreach_cb(struct xbps_handle *xhp,
 	return 0;
 }
 
+static int
+cstring_cmp(const void *a, const void *b)
+{
+	return strcmp(xbps_string_cstring_nocopy(*(xbps_string_t const *)a),
+	    xbps_string_cstring_nocopy(*(xbps_string_t const *)b));
+}
+
+/*
+ * Sorts the array of strings `array', used for the results that
+ * xbps_array_foreach_cb_multi() callbacks append in no particular order.
+ */
+int HIDDEN
+xbps_array_sort_cstrings(xbps_array_t array)
+{
+	xbps_string_t *strs;
+	unsigned int cnt = xbps_array_count(array);
+	int r = 0;
+
+	if (cnt < 2)
+		return 0;
+	if ((strs = calloc(cnt, sizeof(*strs))) == NULL)
+		return -ENOMEM;
+	for (unsigned int i = 0; i < cnt; i++) {
+		strs[i] = xbps_array_get(array, i);
+		assert(xbps_object_type(strs[i]) == XBPS_TYPE_STRING);
+		xbps_object_retain(strs[i]);
+	}
+	qsort(strs, cnt, sizeof(*strs), cstring_cmp);
+	for (unsigned int i = 0; i < cnt; i++) {
+		if (r == 0 && !xbps_array_set(array, i, strs[i]))
+			r = -ENOMEM;
+		xbps_object_release(strs[i]);
+	}
+	free(strs);
+	return r;
+}
+
 xbps_object_iterator_t
 xbps_array_iter_from_dict(xbps_dictionary_t dict, const char *key)
 {
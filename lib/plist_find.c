@@ -360,6 +360,24 @@ xbps_find_virtualpkg_in_conf(struct xbps_handle *xhp,
 	return pkgd;
 }
 
+/*
+ * Stores the name of the virtual package `pkg' refers to in `dst', to look
+ * up its providers by name.  Returns false for patterns that can match
+ * more than one name.
+ */
+bool HIDDEN
+xbps_vpkg_name(char *dst, size_t len, const char *pkg)
+{
+	if (xbps_pkgpattern_version(pkg)) {
+		if (strpbrk(pkg, "*?[]"))
+			return false;
+		return xbps_pkgpattern_name(dst, len, pkg);
+	} else if (xbps_pkg_version(pkg)) {
+		return xbps_pkg_name(dst, len, pkg);
+	}
+	return xbps_strlcpy(dst, pkg, len) < len;
+}
+
 xbps_dictionary_t HIDDEN
 xbps_find_virtualpkg_in_dict(struct xbps_handle *xhp,
 			     xbps_dictionary_t d,
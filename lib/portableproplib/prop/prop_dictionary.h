@@ -33,6 +33,7 @@
 #define	_PROPLIB_PROP_DICTIONARY_H_
 
 #include <stdint.h>
+#include <sys/types.h>
 #include <prop/prop_object.h>
 #include <prop/prop_array.h>
 
@@ -62,6 +63,9 @@ prop_array_t	prop_dictionary_all_keys(prop_dictionary_t);
 prop_object_t	prop_dictionary_get(prop_dictionary_t, const char *);
 bool		prop_dictionary_set(prop_dictionary_t, const char *,
 				    prop_object_t);
+bool		prop_dictionary_append(prop_dictionary_t, const char *,
+				       prop_object_t);
+bool		prop_dictionary_sort(prop_dictionary_t);
 void		prop_dictionary_remove(prop_dictionary_t, const char *);
 
 prop_object_t	prop_dictionary_get_keysym(prop_dictionary_t,
@@ -76,6 +80,17 @@ bool		prop_dictionary_equals(prop_dictionary_t, prop_dictionary_t);
 
 char *		prop_dictionary_externalize(prop_dictionary_t);
 prop_dictionary_t prop_dictionary_internalize(const char *);
+prop_dictionary_t prop_dictionary_internalize_stream(
+				    ssize_t (*)(void *, void *, size_t), void *);
+
+char *		prop_dictionary_externalize_indexed(prop_dictionary_t,
+						    void **, size_t *);
+prop_dictionary_t prop_dictionary_internalize_indexed(char *, size_t,
+						      const void *, size_t);
+prop_dictionary_t prop_dictionary_internalize_lazy(char *, size_t);
+prop_dictionary_t prop_dictionary_internalize_mapped(const char *, size_t,
+						     const void *, size_t,
+						     void (*)(void *), void *);
 
 bool		prop_dictionary_externalize_to_file(prop_dictionary_t,
 						    const char *);
@@ -78,7 +78,35 @@ static const struct _prop_object_type _prop_object_type_array = {
 #define prop_object_is_array(x)		\
 	((x) != NULL && (x)->pa_obj.po_type == &_prop_object_type_array)
 
-#define prop_array_is_immutable(x) (((x)->pa_flags & PA_F_IMMUTABLE) != 0)
+#define prop_array_is_immutable(x) _prop_array_is_immutable(x)
+
+/*
+ * The immutable flag is read without the lock, see prop_dictionary.c.
+ */
+static bool
+_prop_array_is_immutable(prop_array_t pa)
+{
+	int flags;
+
+	_PROP_ATOMIC_LOAD_INT(&pa->pa_flags, flags);
+	return ((flags & PA_F_IMMUTABLE) != 0);
+}
+
+/*
+ * Immutable arrays are read without taking the lock, whether it was taken
+ * is recorded in `l'.
+ */
+#define _PROP_ARRAY_RDLOCK(x, l)				\
+	do {							\
+		(l) = !prop_array_is_immutable(x);		\
+		if (l)						\
+			_PROP_RWLOCK_RDLOCK((x)->pa_rwlock);	\
+	} while (/*CONSTCOND*/0)
+#define _PROP_ARRAY_UNLOCK(x, l)				\
+	do {							\
+		if (l)						\
+			_PROP_RWLOCK_UNLOCK((x)->pa_rwlock);	\
+	} while (/*CONSTCOND*/0)
 
 struct _prop_array_iterator {
 	struct _prop_object_iterator pai_base;
@@ -150,11 +178,12 @@ _prop_array_externalize(struct _prop_object_externalize_context *ctx,
 	prop_object_iterator_t pi;
 	unsigned int i;
 	bool rv = false;
+	bool locked;
 
-	_PROP_RWLOCK_RDLOCK(pa->pa_rwlock);
+	_PROP_ARRAY_RDLOCK(pa, locked);
 
 	if (pa->pa_count == 0) {
-		_PROP_RWLOCK_UNLOCK(pa->pa_rwlock);
+		_PROP_ARRAY_UNLOCK(pa, locked);
 		return (_prop_object_externalize_empty_tag(ctx, "array"));
 	}
 
@@ -190,7 +219,7 @@ _prop_array_externalize(struct _prop_object_externalize_context *ctx,
 	rv = true;
 
  out:
-	_PROP_RWLOCK_UNLOCK(pa->pa_rwlock);
+	_PROP_ARRAY_UNLOCK(pa, locked);
 	return (rv);
 }
 
@@ -212,6 +241,7 @@ _prop_array_equals(prop_object_t v1, prop_object_t v2,
 	idx = (uintptr_t)*stored_pointer1;
 
 	/* For the first iteration, lock the objects. */
+	/* The locks are held until _prop_array_equals_finish(). */
 	if (idx == 0) {
 		if ((uintptr_t)array1 < (uintptr_t)array2) {
 			_PROP_RWLOCK_RDLOCK(array1->pa_rwlock);
@@ -338,12 +368,13 @@ _prop_array_iterator_next_object(void *v)
 	struct _prop_array_iterator *pai = v;
 	prop_array_t pa _PROP_ARG_UNUSED = pai->pai_base.pi_obj;
 	prop_object_t po;
+	bool locked;
 
 	_PROP_ASSERT(prop_object_is_array(pa));
 
-	_PROP_RWLOCK_RDLOCK(pa->pa_rwlock);
+	_PROP_ARRAY_RDLOCK(pa, locked);
 	po = _prop_array_iterator_next_object_locked(pai);
-	_PROP_RWLOCK_UNLOCK(pa->pa_rwlock);
+	_PROP_ARRAY_UNLOCK(pa, locked);
 	return (po);
 }
 
@@ -364,12 +395,13 @@ _prop_array_iterator_reset(void *v)
 {
 	struct _prop_array_iterator *pai = v;
 	prop_array_t pa _PROP_ARG_UNUSED = pai->pai_base.pi_obj;
+	bool locked;
 
 	_PROP_ASSERT(prop_object_is_array(pa));
 
-	_PROP_RWLOCK_RDLOCK(pa->pa_rwlock);
+	_PROP_ARRAY_RDLOCK(pa, locked);
 	_prop_array_iterator_reset_locked(pai);
-	_PROP_RWLOCK_UNLOCK(pa->pa_rwlock);
+	_PROP_ARRAY_UNLOCK(pa, locked);
 }
 
 /*
@@ -407,11 +439,12 @@ prop_array_copy(prop_array_t opa)
 	prop_array_t pa;
 	prop_object_t po;
 	unsigned int idx;
+	bool locked;
 
 	if (! prop_object_is_array(opa))
 		return (NULL);
 
-	_PROP_RWLOCK_RDLOCK(opa->pa_rwlock);
+	_PROP_ARRAY_RDLOCK(opa, locked);
 
 	pa = _prop_array_alloc(opa->pa_count);
 	if (pa != NULL) {
@@ -423,7 +456,7 @@ prop_array_copy(prop_array_t opa)
 		pa->pa_count = opa->pa_count;
 		pa->pa_flags = opa->pa_flags;
 	}
-	_PROP_RWLOCK_UNLOCK(opa->pa_rwlock);
+	_PROP_ARRAY_UNLOCK(opa, locked);
 	return (pa);
 }
 
@@ -451,13 +484,14 @@ unsigned int
 prop_array_capacity(prop_array_t pa)
 {
 	unsigned int rv;
+	bool locked;
 
 	if (! prop_object_is_array(pa))
 		return (0);
 
-	_PROP_RWLOCK_RDLOCK(pa->pa_rwlock);
+	_PROP_ARRAY_RDLOCK(pa, locked);
 	rv = pa->pa_capacity;
-	_PROP_RWLOCK_UNLOCK(pa->pa_rwlock);
+	_PROP_ARRAY_UNLOCK(pa, locked);
 
 	return (rv);
 }
@@ -470,13 +504,14 @@ unsigned int
 prop_array_count(prop_array_t pa)
 {
 	unsigned int rv;
+	bool locked;
 
 	if (! prop_object_is_array(pa))
 		return (0);
 
-	_PROP_RWLOCK_RDLOCK(pa->pa_rwlock);
+	_PROP_ARRAY_RDLOCK(pa, locked);
 	rv = pa->pa_count;
-	_PROP_RWLOCK_UNLOCK(pa->pa_rwlock);
+	_PROP_ARRAY_UNLOCK(pa, locked);
 
 	return (rv);
 }
@@ -534,10 +569,11 @@ prop_object_iterator_t
 prop_array_iterator(prop_array_t pa)
 {
 	prop_object_iterator_t pi;
+	bool locked;
 
-	_PROP_RWLOCK_RDLOCK(pa->pa_rwlock);
+	_PROP_ARRAY_RDLOCK(pa, locked);
 	pi = _prop_array_iterator_locked(pa);
-	_PROP_RWLOCK_UNLOCK(pa->pa_rwlock);
+	_PROP_ARRAY_UNLOCK(pa, locked);
 	return (pi);
 }
 
@@ -551,7 +587,8 @@ prop_array_make_immutable(prop_array_t pa)
 
 	_PROP_RWLOCK_WRLOCK(pa->pa_rwlock);
 	if (prop_array_is_immutable(pa) == false)
-		pa->pa_flags |= PA_F_IMMUTABLE;
+		_PROP_ATOMIC_STORE_INT(&pa->pa_flags,
+		    pa->pa_flags | PA_F_IMMUTABLE);
 	_PROP_RWLOCK_UNLOCK(pa->pa_rwlock);
 }
 
@@ -563,10 +600,11 @@ bool
 prop_array_mutable(prop_array_t pa)
 {
 	bool rv;
+	bool locked;
 
-	_PROP_RWLOCK_RDLOCK(pa->pa_rwlock);
+	_PROP_ARRAY_RDLOCK(pa, locked);
 	rv = prop_array_is_immutable(pa) == false;
-	_PROP_RWLOCK_UNLOCK(pa->pa_rwlock);
+	_PROP_ARRAY_UNLOCK(pa, locked);
 
 	return (rv);
 }
@@ -579,17 +617,18 @@ prop_object_t
 prop_array_get(prop_array_t pa, unsigned int idx)
 {
 	prop_object_t po = NULL;
+	bool locked;
 
 	if (! prop_object_is_array(pa))
 		return (NULL);
 
-	_PROP_RWLOCK_RDLOCK(pa->pa_rwlock);
+	_PROP_ARRAY_RDLOCK(pa, locked);
 	if (idx >= pa->pa_count)
 		goto out;
 	po = pa->pa_array[idx];
 	_PROP_ASSERT(po != NULL);
  out:
-	_PROP_RWLOCK_UNLOCK(pa->pa_rwlock);
+	_PROP_ARRAY_UNLOCK(pa, locked);
 	return (po);
 }
 
@@ -925,21 +964,11 @@ prop_array_internalize(const char *xml)
 bool
 prop_array_externalize_to_file(prop_array_t array, const char *fname)
 {
-	char *xml;
-	bool rv;
-	int save_errno = 0;	/* XXXGCC -Wuninitialized [mips, ...] */
 
-	xml = prop_array_externalize(array);
-	if (xml == NULL)
+	if (! prop_object_is_array(array))
 		return (false);
-	rv = _prop_object_externalize_write_file(fname, xml, strlen(xml), false);
-	if (rv == false)
-		save_errno = errno;
-	_PROP_FREE(xml, M_TEMP);
-	if (rv == false)
-		errno = save_errno;
 
-	return (rv);
+	return (_prop_object_externalize_write_file(fname, array, false));
 }
 
 /*
@@ -80,6 +80,20 @@ struct _prop_dict_entry {
 	prop_object_t			pde_objref;
 };
 
+/*
+ * Large dictionaries that are not going to change, like the pkgdb or a
+ * repository index, also get an open addressing hash table mapping the
+ * hash of a key to its entry, so that lookups do not have to strcmp()
+ * their way down the sorted array.  pdh_idx is the index of the entry
+ * plus one, 0 for an empty slot.
+ */
+struct _prop_dict_hash_slot {
+	uint32_t		pdh_hash;
+	uint32_t		pdh_idx;
+};
+
+#define	PD_HASH_MIN		64	/* smallest dictionary to hash */
+
 struct _prop_dictionary {
 	struct _prop_object	pd_obj;
 	_PROP_RWLOCK_DECL(pd_rwlock)
@@ -89,9 +103,13 @@ struct _prop_dictionary {
 	int			pd_flags;
 
 	uint32_t		pd_version;
+
+	struct _prop_dict_hash_slot *pd_hash;
+	uint32_t		pd_hashmask;
 };
 
 #define	PD_F_IMMUTABLE		0x01	/* dictionary is immutable */
+#define	PD_F_UNSORTED		0x02	/* appended out of order */
 
 _PROP_POOL_INIT(_prop_dictionary_pool, sizeof(struct _prop_dictionary),
 		"propdict")
@@ -154,7 +172,37 @@ static const struct _prop_object_type _prop_object_type_dict_keysym = {
 	((x) != NULL && (x)->pdk_obj.po_type == &_prop_object_type_dict_keysym)
 
 #define	prop_dictionary_is_immutable(x)		\
-				(((x)->pd_flags & PD_F_IMMUTABLE) != 0)
+				_prop_dictionary_is_immutable(x)
+
+/*
+ * The immutable flag is read without the lock, it is only set with the
+ * lock held for writing and is never cleared.
+ */
+static bool
+_prop_dictionary_is_immutable(prop_dictionary_t pd)
+{
+	int flags;
+
+	_PROP_ATOMIC_LOAD_INT(&pd->pd_flags, flags);
+	return ((flags & PD_F_IMMUTABLE) != 0);
+}
+
+/*
+ * Immutable dictionaries are read without taking the lock.  Whether it
+ * was taken is recorded in `l', the dictionary may be made immutable
+ * while a reader waits for it.
+ */
+#define	_PROP_DICT_RDLOCK(x, l)					\
+	do {							\
+		(l) = !prop_dictionary_is_immutable(x);		\
+		if (l)						\
+			_PROP_RWLOCK_RDLOCK((x)->pd_rwlock);	\
+	} while (/*CONSTCOND*/0)
+#define	_PROP_DICT_UNLOCK(x, l)					\
+	do {							\
+		if (l)						\
+			_PROP_RWLOCK_UNLOCK((x)->pd_rwlock);	\
+	} while (/*CONSTCOND*/0)
 
 struct _prop_dictionary_iterator {
 	struct _prop_object_iterator pdi_base;
@@ -337,6 +385,190 @@ _prop_dict_keysym_alloc(const char *key)
 	return (rpdk);
 }
 
+/*
+ * Lazily internalized values.
+ *
+ * prop_dictionary_internalize_indexed() does not parse the values of the
+ * dictionary up front.  Each entry instead references a placeholder that
+ * records where the value is located in the XML document, the value is
+ * internalized on first access and cached in the placeholder.  The XML
+ * document is shared by all placeholders and released with the last one.
+ *
+ * Placeholders never escape this file, every accessor resolves them
+ * before handing out a value.
+ */
+struct _prop_dict_lazy_source {
+	uint32_t		pdls_refcnt;
+	_PROP_MUTEX_DECL(pdls_mutex)
+	const char *		pdls_xml;
+	size_t			pdls_size;
+	void			(*pdls_release)(void *);
+	void *			pdls_arg;
+};
+
+struct _prop_dict_lazy_value {
+	struct _prop_object		pdlv_obj;
+	struct _prop_dict_lazy_source	*pdlv_src;
+	size_t				pdlv_off;
+	size_t				pdlv_len;
+	prop_object_t			pdlv_value;
+};
+
+static _prop_object_free_rv_t
+		_prop_dict_lazy_free(prop_stack_t, prop_object_t *);
+static void	_prop_dict_lazy_emergency_free(prop_object_t);
+
+static const struct _prop_object_type _prop_object_type_dict_lazy = {
+	.pot_type		=	PROP_TYPE_UNKNOWN,
+	.pot_free		=	_prop_dict_lazy_free,
+	.pot_emergency_free	=	_prop_dict_lazy_emergency_free,
+};
+
+#define	prop_object_is_dict_lazy(x)		\
+	(((struct _prop_object *)(x))->po_type == &_prop_object_type_dict_lazy)
+
+static struct _prop_dict_lazy_source *
+_prop_dict_lazy_source_alloc(const char *xml, size_t size,
+    void (*release)(void *), void *arg)
+{
+	struct _prop_dict_lazy_source *pdls;
+
+	pdls = _PROP_MALLOC(sizeof(*pdls), M_TEMP);
+	if (pdls == NULL)
+		return (NULL);
+
+	pdls->pdls_refcnt = 1;
+	_PROP_MUTEX_INIT(pdls->pdls_mutex);
+	pdls->pdls_xml = xml;
+	pdls->pdls_size = size;
+	pdls->pdls_release = release;
+	pdls->pdls_arg = arg;
+	return (pdls);
+}
+
+static void
+_prop_dict_lazy_source_release(struct _prop_dict_lazy_source *pdls)
+{
+	uint32_t ncnt;
+
+	_PROP_ATOMIC_DEC32_NV(&pdls->pdls_refcnt, ncnt);
+	if (ncnt != 0)
+		return;
+
+	if (pdls->pdls_release != NULL)
+		(*pdls->pdls_release)(pdls->pdls_arg);
+	_PROP_MUTEX_DESTROY(pdls->pdls_mutex);
+	_PROP_FREE(pdls, M_TEMP);
+}
+
+static struct _prop_dict_lazy_value *
+_prop_dict_lazy_alloc(struct _prop_dict_lazy_source *pdls, size_t off,
+    size_t len)
+{
+	struct _prop_dict_lazy_value *pdlv;
+
+	pdlv = _PROP_MALLOC(sizeof(*pdlv), M_TEMP);
+	if (pdlv == NULL)
+		return (NULL);
+
+	_prop_object_init(&pdlv->pdlv_obj, &_prop_object_type_dict_lazy);
+	_PROP_ATOMIC_INC32(&pdls->pdls_refcnt);
+	pdlv->pdlv_src = pdls;
+	pdlv->pdlv_off = off;
+	pdlv->pdlv_len = len;
+	pdlv->pdlv_value = NULL;
+	return (pdlv);
+}
+
+static _prop_object_free_rv_t
+_prop_dict_lazy_free(prop_stack_t stack, prop_object_t *obj)
+{
+	struct _prop_dict_lazy_value *pdlv = *obj;
+	prop_object_t po;
+
+	po = pdlv->pdlv_value;
+	if (po != NULL) {
+		if (stack == NULL) {
+			*obj = po;
+			return (_PROP_OBJECT_FREE_FAILED);
+		}
+		if (!_prop_stack_push(stack, pdlv, NULL, NULL, NULL))
+			return (_PROP_OBJECT_FREE_FAILED);
+		pdlv->pdlv_value = NULL;
+		*obj = po;
+		return (_PROP_OBJECT_FREE_RECURSE);
+	}
+
+	_prop_dict_lazy_source_release(pdlv->pdlv_src);
+	_PROP_FREE(pdlv, M_TEMP);
+	return (_PROP_OBJECT_FREE_DONE);
+}
+
+static void
+_prop_dict_lazy_emergency_free(prop_object_t obj)
+{
+	struct _prop_dict_lazy_value *pdlv = obj;
+
+	pdlv->pdlv_value = NULL;
+}
+
+/*
+ * _prop_dict_lazy_resolve --
+ *	Return the value of a placeholder, internalizing it on first use.
+ *	Returns NULL if the referenced XML does not describe a valid object.
+ */
+static prop_object_t
+_prop_dict_lazy_resolve(struct _prop_dict_lazy_value *pdlv)
+{
+	struct _prop_dict_lazy_source *pdls = pdlv->pdlv_src;
+	struct _prop_object_internalize_context *ctx;
+	const char *xml;
+	prop_object_t po;
+
+	_PROP_ATOMIC_LOAD_PTR(&pdlv->pdlv_value, po);
+	if (po != NULL)
+		return (po);
+
+	_PROP_MUTEX_LOCK(pdls->pdls_mutex);
+	po = pdlv->pdlv_value;
+	if (po != NULL)
+		goto out;
+
+	xml = pdls->pdls_xml + pdlv->pdlv_off;
+	ctx = _prop_object_internalize_context_alloc(xml);
+	if (ctx == NULL)
+		goto out;
+	if (_prop_object_internalize_find_tag(ctx, NULL,
+					      _PROP_TAG_TYPE_START))
+		po = _prop_object_internalize_by_tag(ctx);
+	/* The object must not extend past the range recorded for it. */
+	if (po != NULL && ctx->poic_cp > xml + pdlv->pdlv_len) {
+		prop_object_release(po);
+		po = NULL;
+	}
+	_prop_object_internalize_context_free(ctx);
+	if (po != NULL)
+		_PROP_ATOMIC_STORE_PTR(&pdlv->pdlv_value, po);
+ out:
+	_PROP_MUTEX_UNLOCK(pdls->pdls_mutex);
+	return (po);
+}
+
+/*
+ * _prop_dict_entry_value --
+ *	Return the object stored in a dictionary entry.
+ */
+static prop_object_t
+_prop_dict_entry_value(const struct _prop_dict_entry *pde)
+{
+	prop_object_t po = pde->pde_objref;
+
+	_PROP_ASSERT(po != NULL);
+	if (prop_object_is_dict_lazy(po))
+		return (_prop_dict_lazy_resolve(po));
+	return (po);
+}
+
 static _prop_object_free_rv_t
 _prop_dictionary_free(prop_stack_t stack, prop_object_t *obj)
 {
@@ -352,6 +584,8 @@ _prop_dictionary_free(prop_stack_t stack, prop_object_t *obj)
 	if (pd->pd_count == 0) {
 		if (pd->pd_array != NULL)
 			_PROP_FREE(pd->pd_array, M_PROP_DICT);
+		if (pd->pd_hash != NULL)
+			_PROP_FREE(pd->pd_hash, M_PROP_DICT);
 
 		_PROP_RWLOCK_DESTROY(pd->pd_rwlock);
 
@@ -418,21 +652,42 @@ _prop_dictionary_emergency_free(prop_object_t obj)
 	prop_object_release(pdk);
 }
 
+/*
+ * Location of a value in an externalized dictionary, as recorded by
+ * prop_dictionary_externalize_indexed().
+ */
+struct _prop_dict_extern_range {
+	prop_dictionary_keysym_t	pder_key;
+	size_t				pder_off;
+	size_t				pder_len;
+};
+
+/*
+ * _prop_dictionary_externalize_ranges --
+ *	Externalize a dictionary.  If ranges is not NULL, the key and the
+ *	location of the value of each of its nranges entries are recorded
+ *	in it; the dictionary must then hold exactly nranges entries.
+ */
 static bool
-_prop_dictionary_externalize(struct _prop_object_externalize_context *ctx,
-			     void *v)
+_prop_dictionary_externalize_ranges(
+    struct _prop_object_externalize_context *ctx, prop_dictionary_t pd,
+    struct _prop_dict_extern_range *ranges, unsigned int nranges)
 {
-	prop_dictionary_t pd = v;
 	prop_dictionary_keysym_t pdk;
 	struct _prop_object *po;
 	prop_object_iterator_t pi;
-	unsigned int i;
+	unsigned int i, n = 0;
+	size_t off;
 	bool rv = false;
+	bool locked;
 
-	_PROP_RWLOCK_RDLOCK(pd->pd_rwlock);
+	_PROP_DICT_RDLOCK(pd, locked);
+
+	if (ranges != NULL && pd->pd_count != nranges)
+		goto out;
 
 	if (pd->pd_count == 0) {
-		_PROP_RWLOCK_UNLOCK(pd->pd_rwlock);
+		_PROP_DICT_UNLOCK(pd, locked);
 		return (_prop_object_externalize_empty_tag(ctx, "dict"));
 	}
 
@@ -454,11 +709,22 @@ _prop_dictionary_externalize(struct _prop_object_externalize_context *ctx,
 		    _prop_object_externalize_start_tag(ctx, "key") == false ||
 		    _prop_object_externalize_append_encoded_cstring(ctx,
 						   pdk->pdk_key) == false ||
-		    _prop_object_externalize_end_tag(ctx, "key") == false ||
-		    (*po->po_type->pot_extern)(ctx, po) == false) {
+		    _prop_object_externalize_end_tag(ctx, "key") == false) {
+			prop_object_iterator_release(pi);
+			goto out;
+		}
+		off = ctx->poec_len;
+		if ((*po->po_type->pot_extern)(ctx, po) == false) {
 			prop_object_iterator_release(pi);
 			goto out;
 		}
+		if (ranges != NULL) {
+			prop_object_retain(pdk);
+			ranges[n].pder_key = pdk;
+			ranges[n].pder_off = off;
+			ranges[n].pder_len = ctx->poec_len - off;
+			n++;
+		}
 	}
 
 	prop_object_iterator_release(pi);
@@ -474,10 +740,22 @@ _prop_dictionary_externalize(struct _prop_object_externalize_context *ctx,
 	rv = true;
 
  out:
-	_PROP_RWLOCK_UNLOCK(pd->pd_rwlock);
+	_PROP_DICT_UNLOCK(pd, locked);
+	if (!rv) {
+		while (n-- != 0)
+			prop_object_release(ranges[n].pder_key);
+	}
 	return (rv);
 }
 
+static bool
+_prop_dictionary_externalize(struct _prop_object_externalize_context *ctx,
+			     void *v)
+{
+
+	return (_prop_dictionary_externalize_ranges(ctx, v, NULL, 0));
+}
+
 /* ARGSUSED */
 static _prop_object_equals_rv_t
 _prop_dictionary_equals(prop_object_t v1, prop_object_t v2,
@@ -496,6 +774,7 @@ _prop_dictionary_equals(prop_object_t v1, prop_object_t v2,
 
 	idx = (uintptr_t)*stored_pointer1;
 
+	/* The locks are held until _prop_dictionary_equals_finish(). */
 	if (idx == 0) {
 		if ((uintptr_t)dict1 < (uintptr_t)dict2) {
 			_PROP_RWLOCK_RDLOCK(dict1->pd_rwlock);
@@ -519,13 +798,15 @@ _prop_dictionary_equals(prop_object_t v1, prop_object_t v2,
 	*stored_pointer1 = (void *)(idx + 1);
 	*stored_pointer2 = (void *)(idx + 1);
 
-	*next_obj1 = dict1->pd_array[idx].pde_objref;
-	*next_obj2 = dict2->pd_array[idx].pde_objref;
-
 	if (!prop_dictionary_keysym_equals(dict1->pd_array[idx].pde_key,
 					   dict2->pd_array[idx].pde_key))
 		goto out;
 
+	*next_obj1 = _prop_dict_entry_value(&dict1->pd_array[idx]);
+	*next_obj2 = _prop_dict_entry_value(&dict2->pd_array[idx]);
+	if (*next_obj1 == NULL || *next_obj2 == NULL)
+		goto out;
+
 	return (_PROP_OBJECT_EQUALS_RECURSE);
 
  out:
@@ -537,8 +818,8 @@ _prop_dictionary_equals(prop_object_t v1, prop_object_t v2,
 static void
 _prop_dictionary_equals_finish(prop_object_t v1, prop_object_t v2)
 {
- 	_PROP_RWLOCK_UNLOCK(((prop_dictionary_t)v1)->pd_rwlock);
- 	_PROP_RWLOCK_UNLOCK(((prop_dictionary_t)v2)->pd_rwlock);
+	_PROP_RWLOCK_UNLOCK(((prop_dictionary_t)v1)->pd_rwlock);
+	_PROP_RWLOCK_UNLOCK(((prop_dictionary_t)v2)->pd_rwlock);
 }
 
 static prop_dictionary_t
@@ -565,6 +846,9 @@ _prop_dictionary_alloc(unsigned int capacity)
 		pd->pd_flags = 0;
 
 		pd->pd_version = 0;
+
+		pd->pd_hash = NULL;
+		pd->pd_hashmask = 0;
 	} else if (array != NULL)
 		_PROP_FREE(array, M_PROP_DICT);
 
@@ -596,6 +880,174 @@ _prop_dictionary_expand(prop_dictionary_t pd, unsigned int capacity)
 	return (true);
 }
 
+static uint32_t
+_prop_dict_hash(const char *key)
+{
+	uint32_t h = 2166136261U;
+
+	/* FNV-1a */
+	for (; *key != '\0'; key++) {
+		h ^= (unsigned char)*key;
+		h *= 16777619U;
+	}
+	return (h);
+}
+
+/*
+ * _prop_dictionary_hash_build --
+ *	Build the hash table of a dictionary of at least PD_HASH_MIN
+ *	entries.  This is only an optimization, if it cannot be allocated
+ *	lookups keep using the binary search.
+ */
+static void
+_prop_dictionary_hash_build(prop_dictionary_t pd)
+{
+	struct _prop_dict_hash_slot *slot;
+	uint32_t h, i, size;
+	unsigned int idx;
+
+	/*
+	 * Dictionary must be WRITE-LOCKED.
+	 */
+
+	if (pd->pd_hash != NULL || pd->pd_count < PD_HASH_MIN ||
+	    (pd->pd_flags & PD_F_UNSORTED) != 0)
+		return;
+
+	/* Keep the table at most half full. */
+	for (size = PD_HASH_MIN * 2; size < pd->pd_count * 2; size *= 2)
+		;
+	pd->pd_hash = _PROP_CALLOC(size * sizeof(*pd->pd_hash), M_PROP_DICT);
+	if (pd->pd_hash == NULL)
+		return;
+	pd->pd_hashmask = size - 1;
+
+	for (idx = 0; idx < pd->pd_count; idx++) {
+		h = _prop_dict_hash(pd->pd_array[idx].pde_key->pdk_key);
+		for (i = h & pd->pd_hashmask; ; i = (i + 1) & pd->pd_hashmask) {
+			slot = &pd->pd_hash[i];
+			if (slot->pdh_idx == 0)
+				break;
+		}
+		slot->pdh_hash = h;
+		slot->pdh_idx = idx + 1;
+	}
+}
+
+/*
+ * _prop_dictionary_hash_drop --
+ *	Drop the hash table before entries are inserted or removed.
+ */
+static void
+_prop_dictionary_hash_drop(prop_dictionary_t pd)
+{
+
+	/*
+	 * Dictionary must be WRITE-LOCKED.
+	 */
+
+	if (pd->pd_hash != NULL) {
+		_PROP_FREE(pd->pd_hash, M_PROP_DICT);
+		pd->pd_hash = NULL;
+		pd->pd_hashmask = 0;
+	}
+}
+
+/*
+ * _prop_dictionary_grow --
+ *	Make room for one more entry, doubling the capacity so that
+ *	filling a dictionary entry by entry does not copy the array
+ *	again every EXPAND_STEP entries.
+ */
+static bool
+_prop_dictionary_grow(prop_dictionary_t pd)
+{
+
+	/*
+	 * Dictionary must be WRITE-LOCKED.
+	 */
+
+	if (pd->pd_count < pd->pd_capacity)
+		return (true);
+	return (_prop_dictionary_expand(pd, pd->pd_capacity < EXPAND_STEP ?
+	    pd->pd_capacity + EXPAND_STEP : pd->pd_capacity * 2));
+}
+
+/*
+ * _prop_dictionary_sort_locked --
+ *	Sort the entries added by prop_dictionary_append() out of order
+ *	with a stable merge sort, and drop all but the last value stored
+ *	with the same key.
+ */
+static bool
+_prop_dictionary_sort_locked(prop_dictionary_t pd)
+{
+	struct _prop_dict_entry *src, *dst, *tmp, *pde;
+	unsigned int width, lo, mid, hi, i, j, k;
+
+	/*
+	 * Dictionary must be WRITE-LOCKED.
+	 */
+
+	if ((pd->pd_flags & PD_F_UNSORTED) == 0)
+		return (true);
+
+	_prop_dictionary_hash_drop(pd);
+
+	tmp = _PROP_MALLOC(pd->pd_count * sizeof(*tmp), M_TEMP);
+	if (tmp == NULL)
+		return (false);
+
+	src = pd->pd_array;
+	dst = tmp;
+	for (width = 1; width < pd->pd_count; width *= 2) {
+		for (lo = 0; lo < pd->pd_count; lo += 2 * width) {
+			mid = lo + width;
+			if (mid > pd->pd_count)
+				mid = pd->pd_count;
+			hi = mid + width;
+			if (hi > pd->pd_count)
+				hi = pd->pd_count;
+			/* Take from the right run only if strictly less. */
+			for (i = lo, j = mid, k = lo; i < mid && j < hi; k++) {
+				if (strcmp(src[j].pde_key->pdk_key,
+				    src[i].pde_key->pdk_key) < 0)
+					dst[k] = src[j++];
+				else
+					dst[k] = src[i++];
+			}
+			memcpy(&dst[k], &src[i], (mid - i) * sizeof(*src));
+			k += mid - i;
+			memcpy(&dst[k], &src[j], (hi - j) * sizeof(*src));
+		}
+		pde = src;
+		src = dst;
+		dst = pde;
+	}
+	if (src != pd->pd_array)
+		memcpy(pd->pd_array, src, pd->pd_count * sizeof(*src));
+	_PROP_FREE(tmp, M_TEMP);
+
+	/* Equal keys are adjacent now, in the order they were appended. */
+	for (i = 1, k = 0; i < pd->pd_count; i++) {
+		pde = &pd->pd_array[i];
+		if (strcmp(pde->pde_key->pdk_key,
+		    pd->pd_array[k].pde_key->pdk_key) == 0) {
+			prop_object_release(pd->pd_array[k].pde_key);
+			prop_object_release(pd->pd_array[k].pde_objref);
+		} else
+			k++;
+		pd->pd_array[k] = *pde;
+	}
+	if (pd->pd_count != 0)
+		pd->pd_count = k + 1;
+
+	_PROP_ATOMIC_STORE_INT(&pd->pd_flags, pd->pd_flags & ~PD_F_UNSORTED);
+	pd->pd_version++;
+
+	return (true);
+}
+
 static prop_object_t
 _prop_dictionary_iterator_next_object_locked(void *v)
 {
@@ -626,12 +1078,13 @@ _prop_dictionary_iterator_next_object(void *v)
 	struct _prop_dictionary_iterator *pdi = v;
 	prop_dictionary_t pd _PROP_ARG_UNUSED = pdi->pdi_base.pi_obj;
 	prop_dictionary_keysym_t pdk;
+	bool locked;
 
 	_PROP_ASSERT(prop_object_is_dictionary(pd));
 
-	_PROP_RWLOCK_RDLOCK(pd->pd_rwlock);
+	_PROP_DICT_RDLOCK(pd, locked);
 	pdk = _prop_dictionary_iterator_next_object_locked(pdi);
-	_PROP_RWLOCK_UNLOCK(pd->pd_rwlock);
+	_PROP_DICT_UNLOCK(pd, locked);
 	return (pdk);
 }
 
@@ -652,10 +1105,11 @@ _prop_dictionary_iterator_reset(void *v)
 {
 	struct _prop_dictionary_iterator *pdi = v;
 	prop_dictionary_t pd _PROP_ARG_UNUSED = pdi->pdi_base.pi_obj;
+	bool locked;
 
-	_PROP_RWLOCK_RDLOCK(pd->pd_rwlock);
+	_PROP_DICT_RDLOCK(pd, locked);
 	_prop_dictionary_iterator_reset_locked(pdi);
-	_PROP_RWLOCK_UNLOCK(pd->pd_rwlock);
+	_PROP_DICT_UNLOCK(pd, locked);
 }
 
 /*
@@ -694,11 +1148,12 @@ prop_dictionary_copy(prop_dictionary_t opd)
 	prop_dictionary_keysym_t pdk;
 	prop_object_t po;
 	unsigned int idx;
+	bool locked;
 
 	if (! prop_object_is_dictionary(opd))
 		return (NULL);
 
-	_PROP_RWLOCK_RDLOCK(opd->pd_rwlock);
+	_PROP_DICT_RDLOCK(opd, locked);
 
 	pd = _prop_dictionary_alloc(opd->pd_count);
 	if (pd != NULL) {
@@ -714,8 +1169,10 @@ prop_dictionary_copy(prop_dictionary_t opd)
 		}
 		pd->pd_count = opd->pd_count;
 		pd->pd_flags = opd->pd_flags;
+		if (opd->pd_hash != NULL)
+			_prop_dictionary_hash_build(pd);
 	}
-	_PROP_RWLOCK_UNLOCK(opd->pd_rwlock);
+	_PROP_DICT_UNLOCK(opd, locked);
 	return (pd);
 }
 
@@ -748,8 +1205,13 @@ prop_dictionary_make_immutable(prop_dictionary_t pd)
 {
 
 	_PROP_RWLOCK_WRLOCK(pd->pd_rwlock);
-	if (prop_dictionary_is_immutable(pd) == false)
-		pd->pd_flags |= PD_F_IMMUTABLE;
+	if (prop_dictionary_is_immutable(pd) == false) {
+		/* Lookups no longer lock, the table must be there first. */
+		(void)_prop_dictionary_sort_locked(pd);
+		_prop_dictionary_hash_build(pd);
+		_PROP_ATOMIC_STORE_INT(&pd->pd_flags,
+		    pd->pd_flags | PD_F_IMMUTABLE);
+	}
 	_PROP_RWLOCK_UNLOCK(pd->pd_rwlock);
 }
 
@@ -761,13 +1223,14 @@ unsigned int
 prop_dictionary_count(prop_dictionary_t pd)
 {
 	unsigned int rv;
+	bool locked;
 
 	if (! prop_object_is_dictionary(pd))
 		return (0);
 
-	_PROP_RWLOCK_RDLOCK(pd->pd_rwlock);
+	_PROP_DICT_RDLOCK(pd, locked);
 	rv = pd->pd_count;
-	_PROP_RWLOCK_UNLOCK(pd->pd_rwlock);
+	_PROP_DICT_UNLOCK(pd, locked);
 
 	return (rv);
 }
@@ -824,10 +1287,11 @@ prop_object_iterator_t
 prop_dictionary_iterator(prop_dictionary_t pd)
 {
 	prop_object_iterator_t pi;
+	bool locked;
 
-	_PROP_RWLOCK_RDLOCK(pd->pd_rwlock);
+	_PROP_DICT_RDLOCK(pd, locked);
 	pi = _prop_dictionary_iterator_locked(pd);
-	_PROP_RWLOCK_UNLOCK(pd->pd_rwlock);
+	_PROP_DICT_UNLOCK(pd, locked);
 	return (pi);
 }
 
@@ -842,6 +1306,7 @@ prop_dictionary_all_keys(prop_dictionary_t pd)
 	prop_array_t array;
 	unsigned int idx;
 	bool rv = true;
+	bool locked;
 
 	if (! prop_object_is_dictionary(pd))
 		return (NULL);
@@ -849,7 +1314,7 @@ prop_dictionary_all_keys(prop_dictionary_t pd)
 	/* There is no pressing need to lock the dictionary for this. */
 	array = prop_array_create_with_capacity(pd->pd_count);
 
-	_PROP_RWLOCK_RDLOCK(pd->pd_rwlock);
+	_PROP_DICT_RDLOCK(pd, locked);
 
 	for (idx = 0; idx < pd->pd_count; idx++) {
 		rv = prop_array_add(array, pd->pd_array[idx].pde_key);
@@ -857,7 +1322,7 @@ prop_dictionary_all_keys(prop_dictionary_t pd)
 			break;
 	}
 
-	_PROP_RWLOCK_UNLOCK(pd->pd_rwlock);
+	_PROP_DICT_UNLOCK(pd, locked);
 
 	if (rv == false) {
 		prop_object_release(array);
@@ -871,13 +1336,38 @@ _prop_dict_lookup(prop_dictionary_t pd, const char *key,
 		  unsigned int *idxp)
 {
 	struct _prop_dict_entry *pde;
+	struct _prop_dict_hash_slot *slot;
 	unsigned int base, idx, distance;
+	uint32_t h, i;
 	int res;
 
 	/*
 	 * Dictionary must be READ-LOCKED or WRITE-LOCKED.
 	 */
 
+	/* Only sorted entries can be searched. */
+	if ((pd->pd_flags & PD_F_UNSORTED) != 0)
+		return (NULL);
+
+	if (pd->pd_hash != NULL) {
+		h = _prop_dict_hash(key);
+		for (i = h & pd->pd_hashmask; ; i = (i + 1) & pd->pd_hashmask) {
+			slot = &pd->pd_hash[i];
+			if (slot->pdh_idx == 0)
+				break;
+			pde = &pd->pd_array[slot->pdh_idx - 1];
+			if (slot->pdh_hash == h &&
+			    strcmp(key, pde->pde_key->pdk_key) == 0) {
+				if (idxp != NULL)
+					*idxp = slot->pdh_idx - 1;
+				return (pde);
+			}
+		}
+		/* Only an insertion needs to know where the key would go. */
+		if (idxp == NULL)
+			return (NULL);
+	}
+
 	for (idx = 0, base = 0, distance = pd->pd_count; distance != 0;
 	     distance >>= 1) {
 		idx = base + (distance >> 1);
@@ -906,19 +1396,29 @@ _prop_dictionary_get(prop_dictionary_t pd, const char *key, bool locked)
 {
 	const struct _prop_dict_entry *pde;
 	prop_object_t po = NULL;
+	bool rdlocked = false;
 
 	if (! prop_object_is_dictionary(pd))
 		return (NULL);
 
-	if (!locked)
-		_PROP_RWLOCK_RDLOCK(pd->pd_rwlock);
-	pde = _prop_dict_lookup(pd, key, NULL);
-	if (pde != NULL) {
-		_PROP_ASSERT(pde->pde_objref != NULL);
-		po = pde->pde_objref;
+	if (!locked) {
+		_PROP_DICT_RDLOCK(pd, rdlocked);
+		if ((pd->pd_flags & PD_F_UNSORTED) != 0) {
+			/*
+			 * Sort what prop_dictionary_append() left
+			 * unsorted, the first lookup pays for it.
+			 */
+			_PROP_DICT_UNLOCK(pd, rdlocked);
+			_PROP_RWLOCK_WRLOCK(pd->pd_rwlock);
+			(void)_prop_dictionary_sort_locked(pd);
+			rdlocked = true;
+		}
 	}
+	pde = _prop_dict_lookup(pd, key, NULL);
+	if (pde != NULL)
+		po = _prop_dict_entry_value(pde);
 	if (!locked)
-		_PROP_RWLOCK_UNLOCK(pd->pd_rwlock);
+		_PROP_DICT_UNLOCK(pd, rdlocked);
 	return (po);
 }
 /*
@@ -928,15 +1428,8 @@ _prop_dictionary_get(prop_dictionary_t pd, const char *key, bool locked)
 prop_object_t
 prop_dictionary_get(prop_dictionary_t pd, const char *key)
 {
-	prop_object_t po = NULL;
-
-	if (! prop_object_is_dictionary(pd))
-		return (NULL);
 
-	_PROP_RWLOCK_RDLOCK(pd->pd_rwlock);
-	po = _prop_dictionary_get(pd, key, true);
-	_PROP_RWLOCK_UNLOCK(pd->pd_rwlock);
-	return (po);
+	return (_prop_dictionary_get(pd, key, false));
 }
 
 static prop_object_t
@@ -985,6 +1478,9 @@ prop_dictionary_set(prop_dictionary_t pd, const char *key, prop_object_t po)
 
 	_PROP_RWLOCK_WRLOCK(pd->pd_rwlock);
 
+	if (_prop_dictionary_sort_locked(pd) == false)
+		goto out;
+
 	pde = _prop_dict_lookup(pd, key, &idx);
 	if (pde != NULL) {
 		prop_object_t opo = pde->pde_objref;
@@ -999,13 +1495,13 @@ prop_dictionary_set(prop_dictionary_t pd, const char *key, prop_object_t po)
 	if (pdk == NULL)
 		goto out;
 
-	if (pd->pd_count == pd->pd_capacity &&
-	    _prop_dictionary_expand(pd,
-	    			    pd->pd_capacity + EXPAND_STEP) == false) {
+	if (_prop_dictionary_grow(pd) == false) {
 		prop_object_release(pdk);
 	    	goto out;
 	}
 
+	_prop_dictionary_hash_drop(pd);
+
 	/* At this point, the store will succeed. */
 	prop_object_retain(po);
 
@@ -1058,6 +1554,91 @@ prop_dictionary_set(prop_dictionary_t pd, const char *key, prop_object_t po)
 	return (rv);
 }
 
+/*
+ * prop_dictionary_append --
+ *	Like prop_dictionary_set(), but add the object after the last
+ *	entry without searching for its place.  Keys appended in
+ *	ascending order keep the dictionary sorted; otherwise it is
+ *	sorted once by prop_dictionary_sort() or by the first lookup,
+ *	which keeps building a dictionary from unsorted keys O(N log N)
+ *	instead of O(N^2).
+ */
+bool
+prop_dictionary_append(prop_dictionary_t pd, const char *key,
+		       prop_object_t po)
+{
+	struct _prop_dict_entry *pde;
+	prop_dictionary_keysym_t pdk;
+	int res;
+	bool rv = false;
+
+	if (! prop_object_is_dictionary(pd))
+		return (false);
+
+	if (prop_dictionary_is_immutable(pd))
+		return (false);
+
+	_PROP_RWLOCK_WRLOCK(pd->pd_rwlock);
+
+	if (pd->pd_count != 0 && (pd->pd_flags & PD_F_UNSORTED) == 0) {
+		pde = &pd->pd_array[pd->pd_count - 1];
+		res = strcmp(key, pde->pde_key->pdk_key);
+		if (res == 0) {
+			prop_object_t opo = pde->pde_objref;
+			prop_object_retain(po);
+			pde->pde_objref = po;
+			prop_object_release(opo);
+			rv = true;
+			goto out;
+		}
+		if (res < 0)
+			_PROP_ATOMIC_STORE_INT(&pd->pd_flags,
+			    pd->pd_flags | PD_F_UNSORTED);
+	}
+
+	pdk = _prop_dict_keysym_alloc(key);
+	if (pdk == NULL)
+		goto out;
+
+	if (_prop_dictionary_grow(pd) == false) {
+		prop_object_release(pdk);
+		goto out;
+	}
+
+	_prop_dictionary_hash_drop(pd);
+
+	prop_object_retain(po);
+	pd->pd_array[pd->pd_count].pde_key = pdk;
+	pd->pd_array[pd->pd_count].pde_objref = po;
+	pd->pd_count++;
+	pd->pd_version++;
+	rv = true;
+
+ out:
+	_PROP_RWLOCK_UNLOCK(pd->pd_rwlock);
+	return (rv);
+}
+
+/*
+ * prop_dictionary_sort --
+ *	Sort the entries added with prop_dictionary_append(), if the
+ *	keys were not appended in order.  When a key was appended more
+ *	than once, the object appended last is kept.
+ */
+bool
+prop_dictionary_sort(prop_dictionary_t pd)
+{
+	bool rv;
+
+	if (! prop_object_is_dictionary(pd))
+		return (false);
+
+	_PROP_RWLOCK_WRLOCK(pd->pd_rwlock);
+	rv = _prop_dictionary_sort_locked(pd);
+	_PROP_RWLOCK_UNLOCK(pd->pd_rwlock);
+	return (rv);
+}
+
 /*
  * prop_dictionary_set_keysym --
  *	Replace the object in the dictionary at the location encoded by
@@ -1090,6 +1671,8 @@ _prop_dictionary_remove(prop_dictionary_t pd, struct _prop_dict_entry *pde,
 	_PROP_ASSERT(idx < pd->pd_count);
 	_PROP_ASSERT(pde == &pd->pd_array[idx]);
 
+	_prop_dictionary_hash_drop(pd);
+
 	idx++;
 	memmove(&pd->pd_array[idx - 1], &pd->pd_array[idx],
 		(pd->pd_count - idx) * sizeof(*pde));
@@ -1122,6 +1705,9 @@ prop_dictionary_remove(prop_dictionary_t pd, const char *key)
 	if (prop_dictionary_is_immutable(pd))
 		goto out;
 
+	if (_prop_dictionary_sort_locked(pd) == false)
+		goto out;
+
 	pde = _prop_dict_lookup(pd, key, &idx);
 	/* XXX Should this be a _PROP_ASSERT()? */
 	if (pde == NULL)
@@ -1225,6 +1811,476 @@ prop_dictionary_externalize(prop_dictionary_t pd)
 	return (cp);
 }
 
+/*
+ * Index describing the top-level entries of an externalized dictionary.
+ * All integers are 32-bit little endian:
+ *
+ *	header:	"PLISTIDX", version, entry count, XML size, reserved (0)
+ *	entry:	key offset (in key pool), value offset, value length
+ *	pool:	NUL-terminated keys
+ *
+ * Entries are sorted by key, as in the dictionary itself.
+ */
+#define	PDI_MAGIC		"PLISTIDX"
+#define	PDI_MAGIC_SIZE		8
+#define	PDI_VERSION		1
+#define	PDI_HEADER_SIZE		(PDI_MAGIC_SIZE + 4 * 4)
+#define	PDI_ENTRY_SIZE		(3 * 4)
+
+static void
+_prop_dict_index_put32(unsigned char *p, size_t v)
+{
+
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+	p[3] = (v >> 24) & 0xff;
+}
+
+static size_t
+_prop_dict_index_get32(const unsigned char *p)
+{
+
+	return ((size_t)p[0] | ((size_t)p[1] << 8) |
+	    ((size_t)p[2] << 16) | ((size_t)p[3] << 24));
+}
+
+/*
+ * prop_dictionary_externalize_indexed --
+ *	Externalize a dictionary like prop_dictionary_externalize() and
+ *	also return an index of its top-level entries in *idxp, suitable
+ *	for prop_dictionary_internalize_indexed().  Both buffers are
+ *	allocated with the M_TEMP memory type.
+ */
+char *
+prop_dictionary_externalize_indexed(prop_dictionary_t pd, void **idxp,
+    size_t *idxsizep)
+{
+	struct _prop_object_externalize_context *ctx;
+	struct _prop_dict_extern_range *ranges = NULL;
+	unsigned char *idx = NULL, *p, *kp;
+	unsigned int i, count;
+	size_t poolsize = 0, size;
+	char *cp = NULL;
+
+	if (! prop_object_is_dictionary(pd))
+		return (NULL);
+
+	count = prop_dictionary_count(pd);
+	if (count != 0) {
+		ranges = _PROP_CALLOC(count * sizeof(*ranges), M_TEMP);
+		if (ranges == NULL)
+			return (NULL);
+	}
+
+	ctx = _prop_object_externalize_context_alloc();
+	if (ctx == NULL)
+		goto out;
+
+	if (_prop_object_externalize_header(ctx) == false) {
+		_PROP_FREE(ctx->poec_buf, M_TEMP);
+		_prop_object_externalize_context_free(ctx);
+		goto out;
+	}
+	if (_prop_dictionary_externalize_ranges(ctx, pd, ranges,
+						count) == false) {
+		/* Nothing has been recorded on failure. */
+		count = 0;
+		_PROP_FREE(ctx->poec_buf, M_TEMP);
+		_prop_object_externalize_context_free(ctx);
+		goto out;
+	}
+	if (_prop_object_externalize_footer(ctx) == false ||
+	    ctx->poec_len > UINT32_MAX) {
+		_PROP_FREE(ctx->poec_buf, M_TEMP);
+		_prop_object_externalize_context_free(ctx);
+		goto out;
+	}
+	cp = ctx->poec_buf;
+	/* Not including the terminating NUL. */
+	size = ctx->poec_len - 1;
+	_prop_object_externalize_context_free(ctx);
+
+	for (i = 0; i < count; i++)
+		poolsize += strlen(ranges[i].pder_key->pdk_key) + 1;
+
+	idx = _PROP_MALLOC(PDI_HEADER_SIZE + count * PDI_ENTRY_SIZE +
+	    poolsize, M_TEMP);
+	if (idx == NULL) {
+		_PROP_FREE(cp, M_TEMP);
+		cp = NULL;
+		goto out;
+	}
+
+	memcpy(idx, PDI_MAGIC, PDI_MAGIC_SIZE);
+	p = idx + PDI_MAGIC_SIZE;
+	_prop_dict_index_put32(p, PDI_VERSION);
+	_prop_dict_index_put32(p + 4, count);
+	_prop_dict_index_put32(p + 8, size);
+	_prop_dict_index_put32(p + 12, 0);
+
+	p = idx + PDI_HEADER_SIZE;
+	kp = p + count * PDI_ENTRY_SIZE;
+	for (i = 0; i < count; i++, p += PDI_ENTRY_SIZE) {
+		_prop_dict_index_put32(p,
+		    (size_t)(kp - (idx + PDI_HEADER_SIZE +
+		    count * PDI_ENTRY_SIZE)));
+		_prop_dict_index_put32(p + 4, ranges[i].pder_off);
+		_prop_dict_index_put32(p + 8, ranges[i].pder_len);
+		size = strlen(ranges[i].pder_key->pdk_key) + 1;
+		memcpy(kp, ranges[i].pder_key->pdk_key, size);
+		kp += size;
+	}
+
+	*idxp = idx;
+	*idxsizep = PDI_HEADER_SIZE + count * PDI_ENTRY_SIZE + poolsize;
+	_PROP_ASSERT(*idxsizep == (size_t)(kp - idx));
+
+ out:
+	for (i = 0; i < count; i++)
+		prop_object_release(ranges[i].pder_key);
+	if (ranges != NULL)
+		_PROP_FREE(ranges, M_TEMP);
+	return (cp);
+}
+
+static void
+_prop_dict_lazy_free_xml(void *xml)
+{
+
+	_PROP_FREE(xml, M_TEMP);
+}
+
+/*
+ * Top-level entry of a dictionary created with lazily internalized values.
+ * The key is not necessarily NUL-terminated.
+ */
+struct _prop_dict_lazy_entry {
+	const char *	pdle_key;
+	size_t		pdle_keylen;
+	size_t		pdle_off;
+	size_t		pdle_len;
+};
+
+/*
+ * _prop_dictionary_create_lazy --
+ *	Create a dictionary from an XML document and the location of its
+ *	values, deferring the parse of each value until it is accessed.
+ *	Entries must be sorted by key.  On success the document is owned
+ *	by the dictionary and release(arg) is called once it is no longer
+ *	referenced.
+ */
+static prop_dictionary_t
+_prop_dictionary_create_lazy(const char *xml, size_t xmlsize,
+    const struct _prop_dict_lazy_entry *ents, size_t count,
+    void (*release)(void *), void *arg)
+{
+	struct _prop_dict_lazy_source *pdls;
+	struct _prop_dict_lazy_value *pdlv;
+	prop_dictionary_keysym_t pdk;
+	prop_dictionary_t pd;
+	char key[PDK_MAXKEY];
+	size_t i;
+
+	pdls = _prop_dict_lazy_source_alloc(xml, xmlsize, release, arg);
+	if (pdls == NULL)
+		return (NULL);
+
+	pd = _prop_dictionary_alloc(count);
+	if (pd == NULL)
+		goto fail;
+
+	for (i = 0; i < count; i++) {
+		_PROP_ASSERT(ents[i].pdle_keylen < sizeof(key));
+		memcpy(key, ents[i].pdle_key, ents[i].pdle_keylen);
+		key[ents[i].pdle_keylen] = '\0';
+		pdk = _prop_dict_keysym_alloc(key);
+		if (pdk == NULL)
+			goto fail;
+		pdlv = _prop_dict_lazy_alloc(pdls, ents[i].pdle_off,
+		    ents[i].pdle_len);
+		if (pdlv == NULL) {
+			prop_object_release(pdk);
+			goto fail;
+		}
+		pd->pd_array[i].pde_key = pdk;
+		pd->pd_array[i].pde_objref = pdlv;
+		pd->pd_count++;
+	}
+	pd->pd_version++;
+
+	/* Drop the reference held during construction. */
+	_prop_dict_lazy_source_release(pdls);
+	return (pd);
+
+ fail:
+	/*
+	 * The caller keeps ownership of the document on failure, make
+	 * sure it is not released along with the placeholders.
+	 */
+	pdls->pdls_release = NULL;
+	if (pd != NULL)
+		prop_object_release(pd);
+	_prop_dict_lazy_source_release(pdls);
+	return (NULL);
+}
+
+/*
+ * _prop_dictionary_internalize_indexed --
+ *	Create a dictionary from an XML document and its index, see
+ *	_prop_dictionary_create_lazy().
+ */
+static prop_dictionary_t
+_prop_dictionary_internalize_indexed(const char *xml, size_t xmlsize,
+    const void *idxv, size_t idxsize, void (*release)(void *), void *arg)
+{
+	struct _prop_dict_lazy_entry *ents;
+	prop_dictionary_t pd;
+	const unsigned char *idx = idxv, *p;
+	const char *pool, *key, *okey = NULL, *end;
+	size_t i, count, poolsize, koff, voff, vlen;
+
+	if (idxsize < PDI_HEADER_SIZE ||
+	    memcmp(idx, PDI_MAGIC, PDI_MAGIC_SIZE) != 0)
+		return (NULL);
+
+	p = idx + PDI_MAGIC_SIZE;
+	count = _prop_dict_index_get32(p + 4);
+	if (_prop_dict_index_get32(p) != PDI_VERSION ||
+	    _prop_dict_index_get32(p + 8) != xmlsize ||
+	    count > (idxsize - PDI_HEADER_SIZE) / PDI_ENTRY_SIZE)
+		return (NULL);
+
+	pool = (const char *)idx + PDI_HEADER_SIZE + count * PDI_ENTRY_SIZE;
+	poolsize = idxsize - PDI_HEADER_SIZE - count * PDI_ENTRY_SIZE;
+
+	ents = _PROP_MALLOC((count ? count : 1) * sizeof(*ents), M_TEMP);
+	if (ents == NULL)
+		return (NULL);
+
+	/*
+	 * Validate the whole index before building anything, so that a
+	 * damaged index is rejected rather than failing on access.
+	 */
+	p = idx + PDI_HEADER_SIZE;
+	for (i = 0; i < count; i++, p += PDI_ENTRY_SIZE) {
+		koff = _prop_dict_index_get32(p);
+		voff = _prop_dict_index_get32(p + 4);
+		vlen = _prop_dict_index_get32(p + 8);
+		if (koff >= poolsize)
+			goto bad;
+		key = pool + koff;
+		end = memchr(key, '\0', poolsize - koff);
+		if (end == NULL || end == key || end - key >= PDK_MAXKEY)
+			goto bad;
+		if (okey != NULL && strcmp(okey, key) >= 0)
+			goto bad;
+		okey = key;
+		if (vlen == 0 || voff >= xmlsize || vlen > xmlsize - voff)
+			goto bad;
+		if (!_PROP_ISSPACE(xml[voff]) && xml[voff] != '<')
+			goto bad;
+		ents[i].pdle_key = key;
+		ents[i].pdle_keylen = end - key;
+		ents[i].pdle_off = voff;
+		ents[i].pdle_len = vlen;
+	}
+
+	pd = _prop_dictionary_create_lazy(xml, xmlsize, ents, count,
+	    release, arg);
+	_PROP_FREE(ents, M_TEMP);
+	return (pd);
+
+ bad:
+	_PROP_FREE(ents, M_TEMP);
+	return (NULL);
+}
+
+/*
+ * prop_dictionary_internalize_indexed --
+ *	Create a dictionary from a NUL-terminated XML document of xmlsize
+ *	bytes and the index produced along with it by
+ *	prop_dictionary_externalize_indexed().  Values are internalized on
+ *	first access.  On success the dictionary takes ownership of the
+ *	document, which must have been allocated with malloc(3); on failure
+ *	it remains owned by the caller.
+ */
+prop_dictionary_t
+prop_dictionary_internalize_indexed(char *xml, size_t xmlsize,
+    const void *idx, size_t idxsize)
+{
+
+	return (_prop_dictionary_internalize_indexed(xml, xmlsize, idx,
+	    idxsize, _prop_dict_lazy_free_xml, xml));
+}
+
+/*
+ * _prop_dictionary_skip_value --
+ *	Skip over the object starting at the current position, without
+ *	internalizing it.  Only the nesting of tags is checked, the object
+ *	itself is validated when it is internalized.
+ */
+static bool
+_prop_dictionary_skip_value(struct _prop_object_internalize_context *ctx)
+{
+	unsigned int depth = 0;
+
+	do {
+		if (_prop_object_internalize_find_tag(ctx, NULL,
+		    _PROP_TAG_TYPE_EITHER) == false)
+			return (false);
+		if (ctx->poic_tag_type == _PROP_TAG_TYPE_END) {
+			if (depth == 0)
+				return (false);
+			depth--;
+		} else if (!ctx->poic_is_empty_element)
+			depth++;
+		/* Element contents are escaped and never contain a '<'. */
+		if (depth != 0) {
+			while (!_PROP_EOF(*ctx->poic_cp) && *ctx->poic_cp != '<')
+				ctx->poic_cp++;
+		}
+	} while (depth != 0);
+
+	return (true);
+}
+
+/*
+ * _prop_dictionary_internalize_scan --
+ *	Create a dictionary from an XML document, locating its values by
+ *	scanning it, see _prop_dictionary_create_lazy().
+ */
+static prop_dictionary_t
+_prop_dictionary_internalize_scan(const char *xml, size_t xmlsize,
+    void (*release)(void *), void *arg)
+{
+	struct _prop_object_internalize_context *ctx;
+	struct _prop_dict_lazy_entry *ents = NULL, *nents;
+	prop_dictionary_t pd = NULL;
+	const char *key, *okey = NULL;
+	size_t count = 0, capacity = 0, keylen, okeylen = 0, off;
+	bool empty;
+
+	ctx = _prop_object_internalize_context_alloc(xml);
+	if (ctx == NULL)
+		return (NULL);
+
+	if (_prop_object_internalize_find_tag(ctx, "plist",
+					      _PROP_TAG_TYPE_START) == false ||
+	    ctx->poic_is_empty_element ||
+	    _prop_object_internalize_find_tag(ctx, "dict",
+					      _PROP_TAG_TYPE_START) == false)
+		goto out;
+
+	empty = ctx->poic_is_empty_element;
+	while (!empty) {
+		if (_prop_object_internalize_find_tag(ctx, NULL,
+		    _PROP_TAG_TYPE_EITHER) == false)
+			goto out;
+		if (ctx->poic_tag_type == _PROP_TAG_TYPE_END) {
+			if (ctx->poic_tagname_len != 4 ||
+			    memcmp(ctx->poic_tagname, "dict", 4) != 0)
+				goto out;
+			break;
+		}
+		if (ctx->poic_tagname_len != 3 ||
+		    memcmp(ctx->poic_tagname, "key", 3) != 0 ||
+		    ctx->poic_is_empty_element)
+			goto out;
+
+		key = ctx->poic_cp;
+		while (!_PROP_EOF(*ctx->poic_cp) && *ctx->poic_cp != '<') {
+			/* Escaped keys are left to the full parser. */
+			if (*ctx->poic_cp == '&')
+				goto out;
+			ctx->poic_cp++;
+		}
+		keylen = ctx->poic_cp - key;
+		if (keylen == 0 || keylen >= PDK_MAXKEY ||
+		    _prop_object_internalize_find_tag(ctx, "key",
+					      _PROP_TAG_TYPE_END) == false)
+			goto out;
+
+		/* Keys must be sorted to be stored in order. */
+		if (okey != NULL) {
+			int cmp = memcmp(okey, key,
+			    okeylen < keylen ? okeylen : keylen);
+			if (cmp > 0 || (cmp == 0 && okeylen >= keylen))
+				goto out;
+		}
+		okey = key;
+		okeylen = keylen;
+
+		off = ctx->poic_cp - xml;
+		if (_prop_dictionary_skip_value(ctx) == false)
+			goto out;
+
+		if (count == capacity) {
+			capacity = capacity ? capacity * 2 : 256;
+			nents = _PROP_REALLOC(ents,
+			    capacity * sizeof(*ents), M_TEMP);
+			if (nents == NULL)
+				goto out;
+			ents = nents;
+		}
+		ents[count].pdle_key = key;
+		ents[count].pdle_keylen = keylen;
+		ents[count].pdle_off = off;
+		ents[count].pdle_len = (ctx->poic_cp - xml) - off;
+		count++;
+	}
+
+	if (_prop_object_internalize_find_tag(ctx, "plist",
+					      _PROP_TAG_TYPE_END) == false)
+		goto out;
+
+	pd = _prop_dictionary_create_lazy(xml, xmlsize, ents, count,
+	    release, arg);
+
+ out:
+	_prop_object_internalize_context_free(ctx);
+	if (ents != NULL)
+		_PROP_FREE(ents, M_TEMP);
+	return (pd);
+}
+
+/*
+ * prop_dictionary_internalize_lazy --
+ *	Like prop_dictionary_internalize_indexed(), but locate the values
+ *	of the dictionary by scanning the NUL-terminated XML document of
+ *	xmlsize bytes, which only has to find the boundaries of each value.
+ *	Returns NULL if the document does not hold a dictionary with
+ *	sorted, unescaped keys, the caller should then fall back to
+ *	prop_dictionary_internalize().
+ */
+prop_dictionary_t
+prop_dictionary_internalize_lazy(char *xml, size_t xmlsize)
+{
+
+	return (_prop_dictionary_internalize_scan(xml, xmlsize,
+	    _prop_dict_lazy_free_xml, xml));
+}
+
+/*
+ * prop_dictionary_internalize_mapped --
+ *	Like prop_dictionary_internalize_indexed(), or
+ *	prop_dictionary_internalize_lazy() if idx is NULL, for a document
+ *	whose storage is managed by the caller, e.g. a mapped file.  The
+ *	document must stay valid until the dictionary calls release(arg).
+ *	On failure release() is not called.
+ */
+prop_dictionary_t
+prop_dictionary_internalize_mapped(const char *xml, size_t xmlsize,
+    const void *idx, size_t idxsize, void (*release)(void *), void *arg)
+{
+
+	if (idx == NULL)
+		return (_prop_dictionary_internalize_scan(xml, xmlsize,
+		    release, arg));
+	return (_prop_dictionary_internalize_indexed(xml, xmlsize, idx,
+	    idxsize, release, arg));
+}
+
 /*
  * _prop_dictionary_internalize --
  *	Parse a <dict>...</dict> and return the object created from the
@@ -1285,7 +2341,7 @@ _prop_dictionary_internalize_continue(prop_stack_t stack, prop_object_t *obj,
 	_PROP_ASSERT(tmpkey != NULL);
 
 	if (child == NULL ||
-	    prop_dictionary_set(dict, tmpkey, child) == false) {
+	    prop_dictionary_append(dict, tmpkey, child) == false) {
 		_PROP_FREE(tmpkey, M_TEMP);
 		if (child != NULL)
 			prop_object_release(child);
@@ -1314,10 +2370,20 @@ _prop_dictionary_internalize_body(prop_stack_t stack, prop_object_t *obj,
 	if (_prop_object_internalize_find_tag(ctx, NULL, _PROP_TAG_TYPE_EITHER) == false)
 		goto bad;
 
-	/* Check to see if this is the end of the dictionary. */
+	/*
+	 * Check to see if this is the end of the dictionary, the keys
+	 * were appended in document order and are sorted only now.
+	 */
 	if (_PROP_TAG_MATCH(ctx, "dict") &&
 	    ctx->poic_tag_type == _PROP_TAG_TYPE_END) {
 		_PROP_FREE(tmpkey, M_TEMP);
+		if (prop_dictionary_sort(dict) == false) {
+			prop_object_release(dict);
+			*obj = NULL;
+			return (true);
+		}
+		/* Large dictionaries like the pkgdb are mostly looked up. */
+		_prop_dictionary_hash_build(dict);
 		return (true);
 	}
 
@@ -1370,6 +2436,19 @@ prop_dictionary_internalize(const char *xml)
 	return _prop_generic_internalize(xml, "dict");
 }
 
+/*
+ * prop_dictionary_internalize_stream --
+ *	Create a dictionary by parsing the XML-style representation
+ *	returned by the read(2) like function `readfn', which is only
+ *	held in memory a few elements at a time.
+ */
+prop_dictionary_t
+prop_dictionary_internalize_stream(ssize_t (*readfn)(void *, void *, size_t),
+				   void *cookie)
+{
+	return _prop_generic_internalize_stream(readfn, cookie, "dict");
+}
+
 /*
  * prop_dictionary_externalize_to_file --
  *	Externalize a dictionary to the specified file.
@@ -1377,21 +2456,11 @@ prop_dictionary_internalize(const char *xml)
 bool
 prop_dictionary_externalize_to_file(prop_dictionary_t dict, const char *fname)
 {
-	char *xml;
-	bool rv;
-	int save_errno = 0;	/* XXXGCC -Wuninitialized [mips, ...] */
 
-	xml = prop_dictionary_externalize(dict);
-	if (xml == NULL)
+	if (! prop_object_is_dictionary(dict))
 		return (false);
-	rv = _prop_object_externalize_write_file(fname, xml, strlen(xml), false);
-	if (rv == false)
-		save_errno = errno;
-	_PROP_FREE(xml, M_TEMP);
-	if (rv == false)
-		errno = save_errno;
 
-	return (rv);
+	return (_prop_object_externalize_write_file(fname, dict, false));
 }
 
 /*
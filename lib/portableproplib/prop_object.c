@@ -137,6 +137,34 @@ _prop_object_externalize_empty_tag(
 	return (true);
 }
 
+static bool	_prop_object_externalize_reserve(
+				struct _prop_object_externalize_context *);
+
+/*
+ * _prop_object_externalize_append_buf --
+ *	Append len octets to the externalize buffer.
+ */
+static bool
+_prop_object_externalize_append_buf(
+    struct _prop_object_externalize_context *ctx, const char *cp, size_t len)
+{
+	size_t n;
+
+	while (len != 0) {
+		if (_prop_object_externalize_reserve(ctx) == false)
+			return (false);
+		n = ctx->poec_capacity - ctx->poec_len;
+		if (n > len)
+			n = len;
+		memcpy(ctx->poec_buf + ctx->poec_len, cp, n);
+		ctx->poec_len += n;
+		cp += n;
+		len -= n;
+	}
+
+	return (true);
+}
+
 /*
  * _prop_object_externalize_append_cstring --
  *	Append a C string to the externalize buffer.
@@ -146,14 +174,7 @@ _prop_object_externalize_append_cstring(
     struct _prop_object_externalize_context *ctx, const char *cp)
 {
 
-	while (*cp != '\0') {
-		if (_prop_object_externalize_append_char(ctx,
-						(unsigned char) *cp) == false)
-			return (false);
-		cp++;
-	}
-
-	return (true);
+	return (_prop_object_externalize_append_buf(ctx, cp, strlen(cp)));
 }
 
 /*
@@ -164,9 +185,17 @@ bool
 _prop_object_externalize_append_encoded_cstring(
     struct _prop_object_externalize_context *ctx, const char *cp)
 {
+	size_t n;
 
 	while (*cp != '\0') {
+		/* Copy the run of characters that need no encoding at once. */
+		n = strcspn(cp, "<>&");
+		if (_prop_object_externalize_append_buf(ctx, cp, n) == false)
+			return (false);
+		cp += n;
 		switch (*cp) {
+		case '\0':
+			return (true);
 		case '<':
 			if (_prop_object_externalize_append_cstring(ctx,
 					"&lt;") == false)
@@ -182,11 +211,6 @@ _prop_object_externalize_append_encoded_cstring(
 					"&amp;") == false)
 				return (false);
 			break;
-		default:
-			if (_prop_object_externalize_append_char(ctx,
-					(unsigned char) *cp) == false)
-				return (false);
-			break;
 		}
 		cp++;
 	}
@@ -195,29 +219,72 @@ _prop_object_externalize_append_encoded_cstring(
 }
 
 #define	BUF_EXPAND		256
+#define	BUF_STREAM		(64 * 1024)
 
 /*
- * _prop_object_externalize_append_char --
- *	Append a single character to the externalize buffer.
+ * _prop_object_externalize_flush --
+ *	Write out the buffer of a streaming externalize context.
  */
 bool
-_prop_object_externalize_append_char(
-    struct _prop_object_externalize_context *ctx, unsigned char c)
+_prop_object_externalize_flush(struct _prop_object_externalize_context *ctx)
+{
+	size_t off = 0;
+	ssize_t n;
+
+	_PROP_ASSERT(ctx->poec_write != NULL);
+
+	while (off < ctx->poec_len) {
+		n = (*ctx->poec_write)(ctx->poec_cookie,
+		    ctx->poec_buf + off, ctx->poec_len - off);
+		if (n <= 0)
+			return (false);
+		off += n;
+	}
+	ctx->poec_len = 0;
+
+	return (true);
+}
+
+/*
+ * _prop_object_externalize_reserve --
+ *	Make room for at least one more character in the externalize
+ *	buffer, by writing it out when streaming or else by doubling it.
+ */
+static bool
+_prop_object_externalize_reserve(struct _prop_object_externalize_context *ctx)
 {
+	char *cp;
 
 	_PROP_ASSERT(ctx->poec_capacity != 0);
 	_PROP_ASSERT(ctx->poec_buf != NULL);
 	_PROP_ASSERT(ctx->poec_len <= ctx->poec_capacity);
 
-	if (ctx->poec_len == ctx->poec_capacity) {
-		char *cp = _PROP_REALLOC(ctx->poec_buf,
-					 ctx->poec_capacity + BUF_EXPAND,
-					 M_TEMP);
-		if (cp == NULL)
-			return (false);
-		ctx->poec_capacity = ctx->poec_capacity + BUF_EXPAND;
-		ctx->poec_buf = cp;
-	}
+	if (ctx->poec_len < ctx->poec_capacity)
+		return (true);
+
+	if (ctx->poec_write != NULL)
+		return (_prop_object_externalize_flush(ctx));
+
+	cp = _PROP_REALLOC(ctx->poec_buf, ctx->poec_capacity * 2, M_TEMP);
+	if (cp == NULL)
+		return (false);
+	ctx->poec_capacity = ctx->poec_capacity * 2;
+	ctx->poec_buf = cp;
+
+	return (true);
+}
+
+/*
+ * _prop_object_externalize_append_char --
+ *	Append a single character to the externalize buffer.
+ */
+bool
+_prop_object_externalize_append_char(
+    struct _prop_object_externalize_context *ctx, unsigned char c)
+{
+
+	if (_prop_object_externalize_reserve(ctx) == false)
+		return (false);
 
 	ctx->poec_buf[ctx->poec_len++] = c;
 
@@ -280,6 +347,36 @@ _prop_object_externalize_context_alloc(void)
 		ctx->poec_len = 0;
 		ctx->poec_capacity = BUF_EXPAND;
 		ctx->poec_depth = 0;
+		ctx->poec_write = NULL;
+		ctx->poec_cookie = NULL;
+	}
+	return (ctx);
+}
+
+/*
+ * _prop_object_externalize_context_alloc_stream --
+ *	Allocate an externalize context with a fixed-size buffer, which
+ *	is written out with the write(2) like function `writefn' whenever
+ *	it fills up.  The caller must _prop_object_externalize_flush()
+ *	what is left when done, and free the buffer.
+ */
+struct _prop_object_externalize_context *
+_prop_object_externalize_context_alloc_stream(
+    ssize_t (*writefn)(void *, const void *, size_t), void *cookie)
+{
+	struct _prop_object_externalize_context *ctx;
+
+	ctx = _prop_object_externalize_context_alloc();
+	if (ctx != NULL) {
+		_PROP_FREE(ctx->poec_buf, M_TEMP);
+		ctx->poec_buf = _PROP_MALLOC(BUF_STREAM, M_TEMP);
+		if (ctx->poec_buf == NULL) {
+			_PROP_FREE(ctx, M_TEMP);
+			return (NULL);
+		}
+		ctx->poec_capacity = BUF_STREAM;
+		ctx->poec_write = writefn;
+		ctx->poec_cookie = cookie;
 	}
 	return (ctx);
 }
@@ -305,19 +402,14 @@ static bool
 _prop_object_internalize_skip_comment(
 				struct _prop_object_internalize_context *ctx)
 {
-	const char *cp = ctx->poic_cp;
+	const char *cp;
 
-	while (!_PROP_EOF(*cp)) {
-		if (cp[0] == '-' &&
-		    cp[1] == '-' &&
-		    cp[2] == '>') {
-			ctx->poic_cp = cp + 3;
-			return (true);
-		}
-		cp++;
-	}
+	cp = strstr(ctx->poic_cp, "-->");
+	if (cp == NULL)
+		return (false);		/* ran out of buffer */
 
-	return (false);		/* ran out of buffer */
+	ctx->poic_cp = cp + 3;
+	return (true);
 }
 
 /*
@@ -389,11 +481,9 @@ _prop_object_internalize_find_tag(struct _prop_object_internalize_context *ctx,
 
 	ctx->poic_tagname = cp;
 
-	while (!_PROP_ISSPACE(*cp) && *cp != '/' && *cp != '>') {
-		if (_PROP_EOF(*cp))
-			return (false);
-		cp++;
-	}
+	cp += strcspn(cp, " \t\n\r/>");
+	if (_PROP_EOF(*cp))
+		return (false);
 
 	ctx->poic_tagname_len = cp - ctx->poic_tagname;
 
@@ -467,9 +557,25 @@ _prop_object_internalize_find_tag(struct _prop_object_internalize_context *ctx,
 	return (true);
 }
 
+static const struct _prop_object_entity {
+	const char	*poe_name;	/* without the leading '&' */
+	size_t		poe_len;
+	char		poe_char;
+} _prop_object_entities[] = {
+	{ "amp;",	4,	'&' },
+	{ "lt;",	3,	'<' },
+	{ "gt;",	3,	'>' },
+	{ "apos;",	5,	'\'' },
+	{ "quot;",	5,	'\"' },
+};
+#define	_PROP_NENTITIES	\
+	(sizeof(_prop_object_entities) / sizeof(_prop_object_entities[0]))
+
 /*
  * _prop_object_internalize_decode_string --
- *	Decode an encoded string.
+ *	Decode an encoded string.  Runs of characters up to the next
+ *	'<' or '&' are located with strcspn(3), which the C library
+ *	vectorizes, and copied at once.
  */
 bool
 _prop_object_internalize_decode_string(
@@ -477,63 +583,46 @@ _prop_object_internalize_decode_string(
 				char *target, size_t targsize, size_t *sizep,
 				const char **cpp)
 {
+	const struct _prop_object_entity *poe;
 	const char *src;
-	size_t tarindex;
-	char c;
+	size_t tarindex, n;
+	unsigned int i;
 	
 	tarindex = 0;
 	src = ctx->poic_cp;
 
 	for (;;) {
-		if (_PROP_EOF(*src))
-			return (false);
-		if (*src == '<') {
-			break;
+		n = strcspn(src, "<&");
+		if (target) {
+			if (n > targsize - tarindex)
+				return (false);
+			memcpy(target + tarindex, src, n);
 		}
+		tarindex += n;
+		src += n;
 
-		if ((c = *src) == '&') {
-			if (src[1] == 'a' &&
-			    src[2] == 'm' &&
-			    src[3] == 'p' &&
-			    src[4] == ';') {
-			    	c = '&';
-				src += 5;
-			} else if (src[1] == 'l' &&
-				   src[2] == 't' &&
-				   src[3] == ';') {
-				c = '<';
-				src += 4;
-			} else if (src[1] == 'g' &&
-				   src[2] == 't' &&
-				   src[3] == ';') {
-				c = '>';
-				src += 4;
-			} else if (src[1] == 'a' &&
-				   src[2] == 'p' &&
-				   src[3] == 'o' &&
-				   src[4] == 's' &&
-				   src[5] == ';') {
-				c = '\'';
-				src += 6;
-			} else if (src[1] == 'q' &&
-				   src[2] == 'u' &&
-				   src[3] == 'o' &&
-				   src[4] == 't' &&
-				   src[5] == ';') {
-				c = '\"';
-				src += 6;
-			} else
-				return (false);
-		} else
-			src++;
+		if (*src != '&')
+			break;
+
+		for (i = 0; i < _PROP_NENTITIES; i++) {
+			poe = &_prop_object_entities[i];
+			if (strncmp(src + 1, poe->poe_name, poe->poe_len) == 0)
+				break;
+		}
+		if (i == _PROP_NENTITIES)
+			return (false);
+		src += 1 + poe->poe_len;
 		if (target) {
 			if (tarindex >= targsize)
 				return (false);
-			target[tarindex] = c;
+			target[tarindex] = poe->poe_char;
 		}
 		tarindex++;
 	}
 
+	if (_PROP_EOF(*src))
+		return (false);
+
 	_PROP_ASSERT(*src == '<');
 	if (sizep != NULL)
 		*sizep = tarindex;
@@ -594,13 +683,21 @@ _prop_object_internalize_by_tag(struct _prop_object_internalize_context *ctx)
 	void *data, *iter;
 	prop_object_internalizer_continue_t iter_func;
 	struct _prop_stack stack;
+	size_t depth = 0;
 
 	_prop_stack_init(&stack);
 
 match_start:
-	for (poi = _prop_object_internalizer_table;
+	/*
+	 * Until the next element is found, one closing tag per open
+	 * container can follow this element.
+	 */
+	if (!_prop_object_internalize_fill(ctx, depth + 8))
+		poi = NULL;
+	else for (poi = _prop_object_internalizer_table;
 	     poi != NULL && poi->poi_tag != NULL; poi++) {
-		if (_prop_object_internalize_match(ctx->poic_tagname,
+		if (poi->poi_tag[0] == ctx->poic_tagname[0] &&
+		    _prop_object_internalize_match(ctx->poic_tagname,
 						   ctx->poic_tagname_len,
 						   poi->poi_tag,
 						   poi->poi_taglen))
@@ -616,29 +713,28 @@ match_start:
 	}
 
 	obj = NULL;
-	if (!(*poi->poi_intern)(&stack, &obj, ctx))
+	if (!(*poi->poi_intern)(&stack, &obj, ctx)) {
+		depth++;
 		goto match_start;
+	}
 
 	parent_obj = obj;
 	while (_prop_stack_pop(&stack, &parent_obj, &iter, &data, NULL)) {
 		iter_func = (prop_object_internalizer_continue_t)iter;
 		if (!(*iter_func)(&stack, &parent_obj, ctx, data, obj))
 			goto match_start;
+		depth--;
 		obj = parent_obj;
 	}
 
 	return (parent_obj);
 }
 
-prop_object_t
-_prop_generic_internalize(const char *xml, const char *master_tag)
+static prop_object_t
+_prop_generic_internalize_ctx(struct _prop_object_internalize_context *ctx,
+			      const char *master_tag)
 {
 	prop_object_t obj = NULL;
-	struct _prop_object_internalize_context *ctx;
-
-	ctx = _prop_object_internalize_context_alloc(xml);
-	if (ctx == NULL)
-		return (NULL);
 
 	/* We start with a <plist> tag. */
 	if (_prop_object_internalize_find_tag(ctx, "plist",
@@ -659,7 +755,8 @@ _prop_generic_internalize(const char *xml, const char *master_tag)
 		goto out;
 
 	/* Next we expect to see opening master_tag. */
-	if (_prop_object_internalize_find_tag(ctx, master_tag,
+	if (_prop_object_internalize_fill(ctx, 2) == false ||
+	    _prop_object_internalize_find_tag(ctx, master_tag,
 					      _PROP_TAG_TYPE_START) == false)
 		goto out;
 
@@ -671,7 +768,8 @@ _prop_generic_internalize(const char *xml, const char *master_tag)
 	 * We've advanced past the closing master_tag.
 	 * Now we want </plist>.
 	 */
-	if (_prop_object_internalize_find_tag(ctx, "plist",
+	if (_prop_object_internalize_fill(ctx, 2) == false ||
+	    _prop_object_internalize_find_tag(ctx, "plist",
 					      _PROP_TAG_TYPE_END) == false) {
 		prop_object_release(obj);
 		obj = NULL;
@@ -682,36 +780,57 @@ _prop_generic_internalize(const char *xml, const char *master_tag)
 	return (obj);
 }
 
+prop_object_t
+_prop_generic_internalize(const char *xml, const char *master_tag)
+{
+	struct _prop_object_internalize_context *ctx;
+
+	ctx = _prop_object_internalize_context_alloc(xml);
+	if (ctx == NULL)
+		return (NULL);
+
+	return (_prop_generic_internalize_ctx(ctx, master_tag));
+}
+
 /*
- * _prop_object_internalize_context_alloc --
- *	Allocate an internalize context.
+ * _prop_generic_internalize_stream --
+ *	Internalize the XML-style representation returned by the read(2)
+ *	like function `readfn', without holding all of it in memory.
  */
-struct _prop_object_internalize_context *
-_prop_object_internalize_context_alloc(const char *xml)
+prop_object_t
+_prop_generic_internalize_stream(ssize_t (*readfn)(void *, void *, size_t),
+				 void *cookie, const char *master_tag)
 {
 	struct _prop_object_internalize_context *ctx;
 
-	if (xml == NULL)
-		return NULL;
-
-	ctx = _PROP_MALLOC(sizeof(struct _prop_object_internalize_context),
-			   M_TEMP);
+	ctx = _prop_object_internalize_context_alloc_stream(readfn, cookie);
 	if (ctx == NULL)
 		return (NULL);
-	
-	ctx->poic_xml = ctx->poic_cp = xml;
 
-	/*
-	 * Skip any whitespace and XML preamble stuff that we don't
-	 * know about / care about.
-	 */
+	return (_prop_generic_internalize_ctx(ctx, master_tag));
+}
+
+/*
+ * _prop_object_internalize_skip_preamble --
+ *	Skip any whitespace and XML preamble stuff that we don't
+ *	know about / care about.
+ */
+static bool
+_prop_object_internalize_skip_preamble(
+				struct _prop_object_internalize_context *ctx)
+{
+	const char *xml;
+
 	for (;;) {
+		if (_prop_object_internalize_fill(ctx, 4) == false)
+			return (false);
+		xml = ctx->poic_cp;
 		if (_PROP_EOF(*xml))
-			goto bad;
+			return (false);
 		while (_PROP_ISSPACE(*xml))
 			xml++;
 		if (_PROP_EOF(*xml) || *xml != '<')
-			goto bad;
+			return (false);
 
 #define	MATCH(str)	(memcmp(&xml[1], str, sizeof(str) - 1) == 0)
 
@@ -724,16 +843,15 @@ _prop_object_internalize_context_alloc(const char *xml)
 			while (*xml != '>' && !_PROP_EOF(*xml))
 				xml++;
 			if (_PROP_EOF(*xml))
-				goto bad;
-			xml++;	/* advance past the '>' */
+				return (false);
+			ctx->poic_cp = xml + 1;	/* advance past the '>' */
 			continue;
 		}
 
 		if (MATCH("<!--")) {
 			ctx->poic_cp = xml + 4;
 			if (_prop_object_internalize_skip_comment(ctx) == false)
-				goto bad;
-			xml = ctx->poic_cp;
+				return (false);
 			continue;
 		}
 
@@ -747,12 +865,160 @@ _prop_object_internalize_context_alloc(const char *xml)
 	}
 
 	ctx->poic_cp = xml;
+	return (true);
+}
+
+/*
+ * _prop_object_internalize_context_alloc --
+ *	Allocate an internalize context.
+ */
+struct _prop_object_internalize_context *
+_prop_object_internalize_context_alloc(const char *xml)
+{
+	struct _prop_object_internalize_context *ctx;
+
+	if (xml == NULL)
+		return NULL;
+
+	ctx = _PROP_MALLOC(sizeof(struct _prop_object_internalize_context),
+			   M_TEMP);
+	if (ctx == NULL)
+		return (NULL);
+	memset(ctx, 0, sizeof(*ctx));
+	
+	ctx->poic_xml = ctx->poic_cp = xml;
+	if (_prop_object_internalize_skip_preamble(ctx) == false) {
+		_PROP_FREE(ctx, M_TEMP);
+		return (NULL);
+	}
 	return (ctx);
- bad:
-	_PROP_FREE(ctx, M_TEMP);
-	return (NULL);
 }
 
+#define	_PROP_INTERNALIZE_BUFSIZE	65536
+
+/*
+ * _prop_object_internalize_context_alloc_stream --
+ *	Allocate an internalize context reading its input from `readfn'.
+ */
+struct _prop_object_internalize_context *
+_prop_object_internalize_context_alloc_stream(
+				ssize_t (*readfn)(void *, void *, size_t),
+				void *cookie)
+{
+	struct _prop_object_internalize_context *ctx;
+
+	ctx = _PROP_MALLOC(sizeof(struct _prop_object_internalize_context),
+			   M_TEMP);
+	if (ctx == NULL)
+		return (NULL);
+	memset(ctx, 0, sizeof(*ctx));
+
+	ctx->poic_buf = _PROP_MALLOC(_PROP_INTERNALIZE_BUFSIZE, M_TEMP);
+	if (ctx->poic_buf == NULL) {
+		_PROP_FREE(ctx, M_TEMP);
+		return (NULL);
+	}
+	ctx->poic_buf[0] = '\0';
+	ctx->poic_bufsize = _PROP_INTERNALIZE_BUFSIZE;
+	ctx->poic_read = readfn;
+	ctx->poic_cookie = cookie;
+	ctx->poic_xml = ctx->poic_cp = ctx->poic_buf;
+
+	if (_prop_object_internalize_skip_preamble(ctx) == false) {
+		_prop_object_internalize_context_free(ctx);
+		return (NULL);
+	}
+	return (ctx);
+}
+
+#define	_PROP_REBASE(p, from, to)				\
+	((p) = (p) != NULL && (p) >= (from) ? (to) + ((p) - (from)) : NULL)
+
+/*
+ * _prop_object_internalize_fill --
+ *	Make sure that the buffer of a context reading its input in
+ *	blocks holds at least `ntags' complete tags past the current
+ *	position, or the rest of the input.  Text cannot contain a '<',
+ *	so a tag is complete once the start of the following tag has
+ *	been read.  Input before the current tag is discarded.
+ */
+bool
+_prop_object_internalize_fill(struct _prop_object_internalize_context *ctx,
+			      size_t ntags)
+{
+	const char *cp, *lt, *end, *keep;
+	char *buf;
+	size_t n = 0, off, size;
+	ssize_t rd;
+
+	if (ctx->poic_read == NULL)
+		return (true);
+
+	cp = ctx->poic_cp;
+	for (;;) {
+		end = ctx->poic_buf + ctx->poic_buflen;
+		while ((lt = memchr(cp, '<', end - cp)) != NULL) {
+			if (++n > ntags)
+				return (true);
+			cp = lt + 1;
+		}
+		cp = end;
+		if (ctx->poic_eof)
+			return (true);
+
+		/*
+		 * Discard the consumed input, keeping the current tag
+		 * which is still referenced by the context, and grow
+		 * the buffer if that was not enough.
+		 */
+		keep = ctx->poic_cp;
+		if (ctx->poic_tag_start != NULL &&
+		    ctx->poic_tag_start >= ctx->poic_buf &&
+		    ctx->poic_tag_start < keep)
+			keep = ctx->poic_tag_start;
+		off = keep - ctx->poic_buf;
+		size = ctx->poic_bufsize;
+		if (ctx->poic_buflen - off >= size / 2)
+			size *= 2;
+		if (size != ctx->poic_bufsize) {
+			buf = _PROP_MALLOC(size, M_TEMP);
+			if (buf == NULL)
+				return (false);
+			memcpy(buf, keep, ctx->poic_buflen - off);
+		} else {
+			buf = ctx->poic_buf;
+			memmove(buf, keep, ctx->poic_buflen - off);
+		}
+		_PROP_REBASE(ctx->poic_tag_start, keep, buf);
+		_PROP_REBASE(ctx->poic_tagname, keep, buf);
+		_PROP_REBASE(ctx->poic_tagattr, keep, buf);
+		_PROP_REBASE(ctx->poic_tagattrval, keep, buf);
+		ctx->poic_cp = buf + (ctx->poic_cp - keep);
+		cp = buf + (cp - keep);
+		if (buf != ctx->poic_buf)
+			_PROP_FREE(ctx->poic_buf, M_TEMP);
+		ctx->poic_xml = ctx->poic_buf = buf;
+		ctx->poic_buflen -= off;
+		ctx->poic_bufsize = size;
+
+		rd = (*ctx->poic_read)(ctx->poic_cookie,
+		    ctx->poic_buf + ctx->poic_buflen,
+		    ctx->poic_bufsize - ctx->poic_buflen - 1);
+		if (rd <= 0) {
+			ctx->poic_eof = true;
+			rd = 0;
+		}
+		ctx->poic_buflen += rd;
+		ctx->poic_buf[ctx->poic_buflen] = '\0';
+		/* Input with a NUL character ends there. */
+		if (memchr(ctx->poic_buf + ctx->poic_buflen - rd, '\0',
+		    rd) != NULL)
+			ctx->poic_eof = true;
+	}
+}
+
+#undef	_PROP_REBASE
+
 /*
  * _prop_object_internalize_context_free --
  *	Free an internalize context.
@@ -762,6 +1028,8 @@ _prop_object_internalize_context_free(
 		struct _prop_object_internalize_context *ctx)
 {
 
+	if (ctx->poic_buf != NULL)
+		_PROP_FREE(ctx->poic_buf, M_TEMP);
 	_PROP_FREE(ctx, M_TEMP);
 }
 
@@ -811,30 +1079,44 @@ _prop_object_externalize_file_dirname(const char *path, char *result)
 	strcpy(result, ".");
 }
 
+struct _prop_object_externalize_file {
+	int	poef_fd;
+	gzFile	poef_gzf;
+};
+
+static ssize_t
+_prop_object_externalize_file_write(void *cookie, const void *buf, size_t len)
+{
+	struct _prop_object_externalize_file *poef = cookie;
+
+	if (poef->poef_gzf != NULL)
+		return (gzwrite(poef->poef_gzf, buf, len));
+	return (write(poef->poef_fd, buf, len));
+}
+
 /*
  * _prop_object_externalize_write_file --
- *	Write an externalized dictionary to the specified file.
+ *	Externalize an object to the specified file.
  *	The file is written atomically from the caller's perspective,
  *	and the mode set to 0666 modified by the caller's umask.
+ *	The document is written out through a fixed-size buffer rather
+ *	than built in memory first.
  *
  *	The 'compress' argument enables gzip (via zlib) compression
  *	for the file to be written.
  */
 bool
-_prop_object_externalize_write_file(const char *fname, const char *xml,
-    size_t len, bool do_compress)
+_prop_object_externalize_write_file(const char *fname, prop_object_t obj,
+    bool do_compress)
 {
-	gzFile gzf = NULL;
+	struct _prop_object_externalize_context *ctx = NULL;
+	struct _prop_object_externalize_file poef;
+	struct _prop_object *po = obj;
 	char tname[PATH_MAX];
 	int fd;
 	int save_errno;
 	mode_t myumask;
 
-	if (len > SSIZE_MAX) {
-		errno = EFBIG;
-		return (false);
-	}
-
 	/*
 	 * Get the directory name where the file is to be written
 	 * and create the temporary file.
@@ -855,20 +1137,34 @@ _prop_object_externalize_write_file(const char *fname, const char *xml,
 	}
 	umask(myumask);
 
+	poef.poef_fd = fd;
+	poef.poef_gzf = NULL;
 	if (do_compress) {
-		if ((gzf = gzdopen(fd, "a")) == NULL)
+		if ((poef.poef_gzf = gzdopen(fd, "a")) == NULL)
 			goto bad;
 
-		if (gzsetparams(gzf, Z_BEST_COMPRESSION, Z_DEFAULT_STRATEGY))
-			goto bad;
-
-		if (gzwrite(gzf, xml, len) != (ssize_t)len)
-			goto bad;
-	} else {
-		if (write(fd, xml, len) != (ssize_t)len)
+		if (gzsetparams(poef.poef_gzf, Z_BEST_COMPRESSION,
+		    Z_DEFAULT_STRATEGY))
 			goto bad;
 	}
 
+	ctx = _prop_object_externalize_context_alloc_stream(
+	    _prop_object_externalize_file_write, &poef);
+	if (ctx == NULL)
+		goto bad;
+	if (_prop_object_externalize_header(ctx) == false ||
+	    (*po->po_type->pot_extern)(ctx, po) == false ||
+	    _prop_object_externalize_footer(ctx) == false)
+		goto bad;
+	/* The NUL terminating the document is not written to the file. */
+	_PROP_ASSERT(ctx->poec_len != 0);
+	ctx->poec_len--;
+	if (_prop_object_externalize_flush(ctx) == false)
+		goto bad;
+	_PROP_FREE(ctx->poec_buf, M_TEMP);
+	_prop_object_externalize_context_free(ctx);
+	ctx = NULL;
+
 #ifdef HAVE_FDATASYNC
 	if (fdatasync(fd) == -1)
 #else
@@ -882,8 +1178,8 @@ _prop_object_externalize_write_file(const char *fname, const char *xml,
 		goto bad;
 
 	if (do_compress) {
-		(void)gzclose(gzf);
-		gzf = NULL;
+		(void)gzclose(poef.poef_gzf);
+		poef.poef_gzf = NULL;
 	} else {
 		(void)close(fd);
 	}
@@ -896,8 +1192,12 @@ _prop_object_externalize_write_file(const char *fname, const char *xml,
 
  bad:
 	save_errno = errno;
-	if (do_compress && gzf != NULL)
-		(void)gzclose(gzf);
+	if (ctx != NULL) {
+		_PROP_FREE(ctx->poec_buf, M_TEMP);
+		_prop_object_externalize_context_free(ctx);
+	}
+	if (do_compress && poef.poef_gzf != NULL)
+		(void)gzclose(poef.poef_gzf);
 	else if (fd != -1)
 		(void)close(fd);
 	(void) unlink(tname);
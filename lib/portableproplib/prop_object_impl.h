@@ -40,6 +40,13 @@ struct _prop_object_externalize_context {
 	size_t		poec_capacity;		/* capacity of buffer */
 	size_t		poec_len;		/* current length of string */
 	unsigned int	poec_depth;		/* nesting depth */
+
+	/*
+	 * Streaming: a full buffer is written out with poec_write
+	 * instead of being expanded.
+	 */
+	ssize_t		(*poec_write)(void *, const void *, size_t);
+	void *		poec_cookie;
 };
 
 bool		_prop_object_externalize_start_tag(
@@ -67,6 +74,12 @@ bool		_prop_object_externalize_footer(
 
 struct _prop_object_externalize_context *
 	_prop_object_externalize_context_alloc(void);
+struct _prop_object_externalize_context *
+	_prop_object_externalize_context_alloc_stream(
+				ssize_t (*)(void *, const void *, size_t),
+				void *);
+bool	_prop_object_externalize_flush(
+				struct _prop_object_externalize_context *);
 void	_prop_object_externalize_context_free(
 				struct _prop_object_externalize_context *);
 
@@ -91,6 +104,14 @@ struct _prop_object_internalize_context {
 
 	bool   poic_is_empty_element;
 	_prop_tag_type_t poic_tag_type;
+
+	/* Input read in blocks, see _prop_object_internalize_fill(). */
+	ssize_t	  (*poic_read)(void *, void *, size_t);
+	void	   *poic_cookie;
+	char	   *poic_buf;
+	size_t	    poic_buflen;
+	size_t	    poic_bufsize;
+	bool	    poic_eof;
 };
 
 typedef enum {
@@ -109,10 +130,10 @@ typedef enum {
 #define	_PROP_ISSPACE(c)	\
 	((c) == ' ' || (c) == '\t' || (c) == '\n' || (c) == '\r')
 
+/* Tags are matched for every element, let strlen() of literals fold. */
 #define	_PROP_TAG_MATCH(ctx, t)					\
-	_prop_object_internalize_match((ctx)->poic_tagname,	\
-				       (ctx)->poic_tagname_len,	\
-				       (t), strlen(t))
+	((ctx)->poic_tagname_len == strlen(t) &&		\
+	 memcmp((ctx)->poic_tagname, (t), strlen(t)) == 0)
 
 #define	_PROP_TAGATTR_MATCH(ctx, a)				\
 	_prop_object_internalize_match((ctx)->poic_tagattr,	\
@@ -135,14 +156,23 @@ bool		_prop_object_internalize_decode_string(
 				struct _prop_object_internalize_context *,
 				char *, size_t, size_t *, const char **);
 prop_object_t	_prop_generic_internalize(const char *, const char *);
+prop_object_t	_prop_generic_internalize_stream(
+				ssize_t (*)(void *, void *, size_t), void *,
+				const char *);
 
 struct _prop_object_internalize_context *
 		_prop_object_internalize_context_alloc(const char *);
+struct _prop_object_internalize_context *
+		_prop_object_internalize_context_alloc_stream(
+				ssize_t (*)(void *, void *, size_t), void *);
+bool		_prop_object_internalize_fill(
+				struct _prop_object_internalize_context *,
+				size_t);
 void		_prop_object_internalize_context_free(
 				struct _prop_object_internalize_context *);
 
 bool		_prop_object_externalize_write_file(const char *,
-						    const char *, size_t, bool);
+						    prop_object_t, bool);
 
 struct _prop_object_internalize_mapped_file {
 	char *	poimf_xml;
@@ -261,9 +291,11 @@ struct _prop_object_iterator {
  */
 #include <pthread.h>
 #define	_PROP_MUTEX_DECL_STATIC(x)	static pthread_mutex_t x;
+#define	_PROP_MUTEX_DECL(x)		pthread_mutex_t x;
 #define	_PROP_MUTEX_INIT(x)		pthread_mutex_init(&(x), NULL)
 #define	_PROP_MUTEX_LOCK(x)		pthread_mutex_lock(&(x))
 #define	_PROP_MUTEX_UNLOCK(x)		pthread_mutex_unlock(&(x))
+#define	_PROP_MUTEX_DESTROY(x)		pthread_mutex_destroy(&(x))
 
 #define	_PROP_RWLOCK_DECL(x)		pthread_rwlock_t x ;
 #define	_PROP_RWLOCK_INIT(x)		pthread_rwlock_init(&(x), NULL)
@@ -303,6 +335,25 @@ struct _prop_object_iterator {
 		v = --(*(x)); \
 		pthread_mutex_unlock(&_prop_refcnt_mtx); \
 	} while (/*CONSTCOND*/0)
+#define _PROP_ATOMIC_CAS32(x, o, n, v) \
+	do { \
+		pthread_mutex_lock(&_prop_refcnt_mtx); \
+		if ((v = (*(x) == (o)))) \
+			*(x) = (n); \
+		pthread_mutex_unlock(&_prop_refcnt_mtx); \
+	} while (/*CONSTCOND*/0)
+#define _PROP_ATOMIC_LOAD_PTR(x, v) \
+	do { \
+		pthread_mutex_lock(&_prop_refcnt_mtx); \
+		v = *(x); \
+		pthread_mutex_unlock(&_prop_refcnt_mtx); \
+	} while (/*CONSTCOND*/0)
+#define _PROP_ATOMIC_STORE_PTR(x, v) \
+	do { \
+		pthread_mutex_lock(&_prop_refcnt_mtx); \
+		*(x) = v; \
+		pthread_mutex_unlock(&_prop_refcnt_mtx); \
+	} while (/*CONSTCOND*/0)
 
 #else /* GCC ATOMIC BUILTINS */
 
@@ -326,8 +377,45 @@ do {									\
 	v = __sync_sub_and_fetch(x, 1);					\
 } while (/*CONSTCOND*/0)
 
+#define _PROP_ATOMIC_CAS32(x, o, n, v)					\
+do {									\
+	v = __sync_bool_compare_and_swap(x, o, n);			\
+} while (/*CONSTCOND*/0)
+
+/*
+ * Pointer publication: a plain load paired with a barrier is enough,
+ * readers must not bounce the cache line with a locked instruction.
+ */
+#if defined(__ATOMIC_ACQUIRE)
+#define _PROP_ATOMIC_LOAD_PTR(x, v)					\
+do {									\
+	v = __atomic_load_n(x, __ATOMIC_ACQUIRE);			\
+} while (/*CONSTCOND*/0)
+
+#define _PROP_ATOMIC_STORE_PTR(x, v)					\
+do {									\
+	__atomic_store_n(x, v, __ATOMIC_RELEASE);			\
+} while (/*CONSTCOND*/0)
+#else
+#define _PROP_ATOMIC_LOAD_PTR(x, v)					\
+do {									\
+	v = *(volatile __typeof__(v) *)(x);				\
+	__sync_synchronize();						\
+} while (/*CONSTCOND*/0)
+
+#define _PROP_ATOMIC_STORE_PTR(x, v)					\
+do {									\
+	__sync_synchronize();						\
+	*(volatile __typeof__(v) *)(x) = v;				\
+} while (/*CONSTCOND*/0)
+#endif
+
 #endif /* !HAVE_ATOMICS */
 
+/* Flags of an object that are read without its lock. */
+#define _PROP_ATOMIC_LOAD_INT(x, v)	_PROP_ATOMIC_LOAD_PTR(x, v)
+#define _PROP_ATOMIC_STORE_INT(x, v)	_PROP_ATOMIC_STORE_PTR(x, v)
+
 /*
  * Language features.
  */
@@ -31,6 +31,7 @@
 
 #include <prop/prop_string.h>
 #include "prop_object_impl.h"
+#include "prop_rb_impl.h"
 
 struct _prop_string {
 	struct _prop_object	ps_obj;
@@ -45,9 +46,210 @@ struct _prop_string {
 };
 
 #define	PS_F_NOCOPY		0x01
+#define	PS_F_INTERNED		0x02
 
 _PROP_POOL_INIT(_prop_string_pool, sizeof(struct _prop_string), "propstng")
 
+/*
+ * Internalized strings are likely to be duplicated, e.g. architectures,
+ * licenses and dependencies, so short ones share their storage the same
+ * way dictionary key symbols do.  A string with interned storage is
+ * still mutable, its storage is replaced when it is modified.
+ *
+ * Strings are internalized and released by many threads at once, so the
+ * shared storage is split in PS_INTERN_SHARDS trees by the hash of the
+ * string, each with its own lock.  References are counted atomically, the
+ * lock is only taken to look up storage or to drop its last reference.
+ */
+struct _prop_string_intern {
+	struct rb_node		psi_link;
+	uint32_t		psi_refcnt;
+	unsigned int		psi_shard;
+	char			psi_str[1];
+	/* actually variable length */
+};
+
+#define	PS_INTERN_MAXLEN	32
+#define	PS_INTERN_SHARDS	32
+
+static struct _prop_string_intern_shard {
+	struct rb_tree		psis_tree;
+	_PROP_MUTEX_DECL(psis_mutex)
+} _prop_string_intern_shards[PS_INTERN_SHARDS];
+
+_PROP_ONCE_DECL(_prop_string_init_once)
+
+static int
+/*ARGSUSED*/
+_prop_string_intern_rb_compare_nodes(void *ctx _PROP_ARG_UNUSED,
+				     const void *n1, const void *n2)
+{
+	const struct _prop_string_intern *psi1 = n1;
+	const struct _prop_string_intern *psi2 = n2;
+
+	return strcmp(psi1->psi_str, psi2->psi_str);
+}
+
+static int
+/*ARGSUSED*/
+_prop_string_intern_rb_compare_key(void *ctx _PROP_ARG_UNUSED,
+				   const void *n, const void *v)
+{
+	const struct _prop_string_intern *psi = n;
+	const char *cp = v;
+
+	return strcmp(psi->psi_str, cp);
+}
+
+static const rb_tree_ops_t _prop_string_intern_rb_tree_ops = {
+	.rbto_compare_nodes = _prop_string_intern_rb_compare_nodes,
+	.rbto_compare_key = _prop_string_intern_rb_compare_key,
+	.rbto_node_offset = offsetof(struct _prop_string_intern, psi_link),
+	.rbto_context = NULL
+};
+
+static int
+_prop_string_init(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < PS_INTERN_SHARDS; i++) {
+		_PROP_MUTEX_INIT(_prop_string_intern_shards[i].psis_mutex);
+		_prop_rb_tree_init(&_prop_string_intern_shards[i].psis_tree,
+				   &_prop_string_intern_rb_tree_ops);
+	}
+	return 0;
+}
+
+/*
+ * _prop_string_intern_hash --
+ *	Return the shard of the shared storage for `str'.
+ */
+static unsigned int
+_prop_string_intern_hash(const char *str, size_t len)
+{
+	uint32_t h = 2166136261U;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char)str[i];
+		h *= 16777619U;
+	}
+	return (h % PS_INTERN_SHARDS);
+}
+
+/*
+ * _prop_string_intern_get --
+ *	Return the shared storage for `str', creating it if necessary.
+ */
+static const char *
+_prop_string_intern_get(const char *str, size_t len)
+{
+	struct _prop_string_intern_shard *psis;
+	struct _prop_string_intern *psi, *rpsi;
+	unsigned int shard;
+
+	_PROP_ONCE_RUN(_prop_string_init_once, _prop_string_init);
+
+	shard = _prop_string_intern_hash(str, len);
+	psis = &_prop_string_intern_shards[shard];
+	_PROP_MUTEX_LOCK(psis->psis_mutex);
+	psi = _prop_rb_tree_find(&psis->psis_tree, str);
+	if (psi != NULL) {
+		_PROP_ATOMIC_INC32(&psi->psi_refcnt);
+		_PROP_MUTEX_UNLOCK(psis->psis_mutex);
+		return (psi->psi_str);
+	}
+	_PROP_MUTEX_UNLOCK(psis->psis_mutex);
+
+	psi = _PROP_MALLOC(sizeof(*psi) + len, M_PROP_STRING);
+	if (psi == NULL)
+		return (NULL);
+	memcpy(psi->psi_str, str, len + 1);
+	psi->psi_refcnt = 1;
+	psi->psi_shard = shard;
+
+	/*
+	 * We dropped the mutex when we allocated the new storage, so
+	 * we have to check again if it is in the tree.
+	 */
+	_PROP_MUTEX_LOCK(psis->psis_mutex);
+	rpsi = _prop_rb_tree_insert_node(&psis->psis_tree, psi);
+	if (rpsi != psi)
+		_PROP_ATOMIC_INC32(&rpsi->psi_refcnt);
+	_PROP_MUTEX_UNLOCK(psis->psis_mutex);
+	if (rpsi != psi)
+		_PROP_FREE(psi, M_PROP_STRING);
+	return (rpsi->psi_str);
+}
+
+/*
+ * _prop_string_intern_retain --
+ *	Add a reference to shared storage.  The caller holds one, so the
+ *	storage can't be freed meanwhile.
+ */
+static void
+_prop_string_intern_retain(const char *str)
+{
+	struct _prop_string_intern *psi;
+
+	psi = (void *)(uintptr_t)(str -
+	    offsetof(struct _prop_string_intern, psi_str));
+	_PROP_ATOMIC_INC32(&psi->psi_refcnt);
+}
+
+/*
+ * _prop_string_intern_put --
+ *	Drop a reference to shared storage, freeing it with the last one.
+ *	Only the last reference is dropped with the lock held, so that
+ *	_prop_string_intern_get() can't find the storage being freed.
+ */
+static void
+_prop_string_intern_put(const char *str)
+{
+	struct _prop_string_intern_shard *psis;
+	struct _prop_string_intern *psi;
+	uint32_t ncnt;
+	bool done;
+
+	psi = (void *)(uintptr_t)(str -
+	    offsetof(struct _prop_string_intern, psi_str));
+	for (;;) {
+		ncnt = *(volatile uint32_t *)&psi->psi_refcnt;
+		if (ncnt == 1)
+			break;
+		_PROP_ATOMIC_CAS32(&psi->psi_refcnt, ncnt, ncnt - 1, done);
+		if (done)
+			return;
+	}
+	psis = &_prop_string_intern_shards[psi->psi_shard];
+	_PROP_MUTEX_LOCK(psis->psis_mutex);
+	_PROP_ATOMIC_DEC32_NV(&psi->psi_refcnt, ncnt);
+	if (ncnt == 0)
+		_prop_rb_tree_remove_node(&psis->psis_tree, psi);
+	else
+		psi = NULL;
+	_PROP_MUTEX_UNLOCK(psis->psis_mutex);
+	if (psi != NULL)
+		_PROP_FREE(psi, M_PROP_STRING);
+}
+
+/*
+ * _prop_string_release_storage --
+ *	Release the storage of a string.
+ */
+static void
+_prop_string_release_storage(prop_string_t ps)
+{
+
+	if (ps->ps_mutable == NULL || (ps->ps_flags & PS_F_NOCOPY))
+		return;
+	if (ps->ps_flags & PS_F_INTERNED)
+		_prop_string_intern_put(ps->ps_immutable);
+	else
+		_PROP_FREE(ps->ps_mutable, M_PROP_STRING);
+}
+
 
 static _prop_object_free_rv_t
 		_prop_string_free(prop_stack_t, prop_object_t *);
@@ -76,8 +278,7 @@ _prop_string_free(prop_stack_t stack, prop_object_t *obj)
 {
 	prop_string_t ps = *obj;
 
-	if ((ps->ps_flags & PS_F_NOCOPY) == 0 && ps->ps_mutable != NULL)
-	    	_PROP_FREE(ps->ps_mutable, M_PROP_STRING);
+	_prop_string_release_storage(ps);
 	_PROP_POOL_PUT(_prop_string_pool, ps);
 
 	return (_PROP_OBJECT_FREE_DONE);
@@ -212,7 +413,10 @@ prop_string_copy(prop_string_t ops)
 		ps->ps_flags = ops->ps_flags;
 		if (ops->ps_flags & PS_F_NOCOPY)
 			ps->ps_immutable = ops->ps_immutable;
-		else {
+		else if (ops->ps_flags & PS_F_INTERNED) {
+			_prop_string_intern_retain(ops->ps_immutable);
+			ps->ps_immutable = ops->ps_immutable;
+		} else {
 			char *cp = _PROP_MALLOC(ps->ps_size + 1, M_PROP_STRING);
 			if (cp == NULL) {
 				prop_object_release(ps);
@@ -241,6 +445,12 @@ prop_string_copy_mutable(prop_string_t ops)
 	ps = _prop_string_alloc();
 	if (ps != NULL) {
 		ps->ps_size = ops->ps_size;
+		if (ops->ps_flags & PS_F_INTERNED) {
+			_prop_string_intern_retain(ops->ps_immutable);
+			ps->ps_immutable = ops->ps_immutable;
+			ps->ps_flags = PS_F_INTERNED;
+			return (ps);
+		}
 		cp = _PROP_MALLOC(ps->ps_size + 1, M_PROP_STRING);
 		if (cp == NULL) {
 			prop_object_release(ps);
@@ -323,7 +533,7 @@ prop_string_cstring_nocopy(prop_string_t ps)
 bool
 prop_string_append(prop_string_t dst, prop_string_t src)
 {
-	char *ocp, *cp;
+	char *cp;
 	size_t len;
 
 	if (! (prop_object_is_string(dst) &&
@@ -339,11 +549,10 @@ prop_string_append(prop_string_t dst, prop_string_t src)
 		return (false);
 	snprintf(cp, len + 1, "%s%s", prop_string_contents(dst),
 		prop_string_contents(src));
-	ocp = dst->ps_mutable;
+	_prop_string_release_storage(dst);
 	dst->ps_mutable = cp;
 	dst->ps_size = len;
-	if (ocp != NULL)
-		_PROP_FREE(ocp, M_PROP_STRING);
+	dst->ps_flags &= ~PS_F_INTERNED;
 	
 	return (true);
 }
@@ -356,7 +565,7 @@ prop_string_append(prop_string_t dst, prop_string_t src)
 bool
 prop_string_append_cstring(prop_string_t dst, const char *src)
 {
-	char *ocp, *cp;
+	char *cp;
 	size_t len;
 
 	if (! prop_object_is_string(dst))
@@ -372,11 +581,10 @@ prop_string_append_cstring(prop_string_t dst, const char *src)
 	if (cp == NULL)
 		return (false);
 	snprintf(cp, len + 1, "%s%s", prop_string_contents(dst), src);
-	ocp = dst->ps_mutable;
+	_prop_string_release_storage(dst);
 	dst->ps_mutable = cp;
 	dst->ps_size = len;
-	if (ocp != NULL)
-		_PROP_FREE(ocp, M_PROP_STRING);
+	dst->ps_flags &= ~PS_F_INTERNED;
 	
 	return (true);
 }
@@ -419,7 +627,9 @@ bool
 _prop_string_internalize(prop_stack_t stack, prop_object_t *obj,
     struct _prop_object_internalize_context *ctx)
 {
+	char buf[PS_INTERN_MAXLEN + 1];
 	prop_string_t string;
+	const char *istr = NULL, *end;
 	char *str;
 	size_t len, alen;
 
@@ -434,36 +644,49 @@ _prop_string_internalize(prop_stack_t stack, prop_object_t *obj,
 
 	/* Compute the length of the result. */
 	if (_prop_object_internalize_decode_string(ctx, NULL, 0, &len,
-						   NULL) == false)
+						   &end) == false)
 		return (true);
 	
-	str = _PROP_MALLOC(len + 1, M_PROP_STRING);
-	if (str == NULL)
+	if (len <= PS_INTERN_MAXLEN)
+		str = buf;
+	else if ((str = _PROP_MALLOC(len + 1, M_PROP_STRING)) == NULL)
 		return (true);
 	
-	if (_prop_object_internalize_decode_string(ctx, str, len, &alen,
-						   &ctx->poic_cp) == false ||
-	    alen != len) {
-		_PROP_FREE(str, M_PROP_STRING);
-		return (true);
-	}
+	if ((size_t)(end - ctx->poic_cp) == len) {
+		/* Nothing to decode, which is the common case. */
+		memcpy(str, ctx->poic_cp, len);
+		ctx->poic_cp = end;
+	} else if (_prop_object_internalize_decode_string(ctx, str, len,
+				&alen, &ctx->poic_cp) == false || alen != len)
+		goto bad;
 	str[len] = '\0';
 
 	if (_prop_object_internalize_find_tag(ctx, "string",
-					      _PROP_TAG_TYPE_END) == false) {
-		_PROP_FREE(str, M_PROP_STRING);
-		return (true);
-	}
+					      _PROP_TAG_TYPE_END) == false)
+		goto bad;
+
+	if (str == buf && (istr = _prop_string_intern_get(str, len)) == NULL)
+		goto bad;
 
 	string = _prop_string_alloc();
 	if (string == NULL) {
-		_PROP_FREE(str, M_PROP_STRING);
-		return (true);
+		if (istr != NULL)
+			_prop_string_intern_put(istr);
+		goto bad;
 	}
 
-	string->ps_mutable = str;
+	if (istr != NULL) {
+		string->ps_immutable = istr;
+		string->ps_flags |= PS_F_INTERNED;
+	} else
+		string->ps_mutable = str;
 	string->ps_size = len;
 	*obj = string;
 
 	return (true);
+
+ bad:
+	if (str != buf)
+		_PROP_FREE(str, M_PROP_STRING);
+	return (true);
 }
@@ -35,21 +35,11 @@
 bool											\
 prop ## type ## _externalize_to_zfile(prop ## type ## _t obj, const char *fname)	\
 {											\
-	char *xml;									\
-	bool rv;									\
-	int save_errno = 0;								\
 											\
-	xml = prop ## type ## _externalize(obj);					\
-	if (xml == NULL)								\
+	if (prop_object_type(obj) != PROP_TYPE_## objtype)					\
 		return false;								\
-	rv = _prop_object_externalize_write_file(fname, xml, strlen(xml), true);	\
-	if (rv == false)								\
-		save_errno = errno;							\
-	_PROP_FREE(xml, M_TEMP);							\
-	if (rv == false)								\
-		errno = save_errno;							\
 											\
-	return rv;									\
+	return _prop_object_externalize_write_file(fname, obj, true);			\
 }											\
 											\
 prop ## type ## _t									\
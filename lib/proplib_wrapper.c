@@ -512,6 +512,18 @@ xbps_dictionary_set(xbps_dictionary_t d, const char *s, xbps_object_t o)
 	return prop_dictionary_set(d, s, o);
 }
 
+bool
+xbps_dictionary_append(xbps_dictionary_t d, const char *s, xbps_object_t o)
+{
+	return prop_dictionary_append(d, s, o);
+}
+
+bool
+xbps_dictionary_sort(xbps_dictionary_t d)
+{
+	return prop_dictionary_sort(d);
+}
+
 void
 xbps_dictionary_remove(xbps_dictionary_t d, const char *s)
 {
@@ -555,6 +567,41 @@ xbps_dictionary_internalize(const char *s)
 	return prop_dictionary_internalize(s);
 }
 
+char *
+xbps_dictionary_externalize_indexed(xbps_dictionary_t d, void **idx,
+		size_t *idxlen)
+{
+	return prop_dictionary_externalize_indexed(d, idx, idxlen);
+}
+
+xbps_dictionary_t
+xbps_dictionary_internalize_indexed(char *s, size_t len, const void *idx,
+		size_t idxlen)
+{
+	return prop_dictionary_internalize_indexed(s, len, idx, idxlen);
+}
+
+xbps_dictionary_t
+xbps_dictionary_internalize_stream(ssize_t (*fn)(void *, void *, size_t),
+		void *arg)
+{
+	return prop_dictionary_internalize_stream(fn, arg);
+}
+
+xbps_dictionary_t
+xbps_dictionary_internalize_lazy(char *s, size_t len)
+{
+	return prop_dictionary_internalize_lazy(s, len);
+}
+
+xbps_dictionary_t
+xbps_dictionary_internalize_mapped(const char *s, size_t len, const void *idx,
+		size_t idxlen, void (*release)(void *), void *arg)
+{
+	return prop_dictionary_internalize_mapped(s, len, idx, idxlen,
+	    release, arg);
+}
+
 bool
 xbps_dictionary_externalize_to_file(xbps_dictionary_t d, const char *s)
 {
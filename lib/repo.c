@@ -25,6 +25,7 @@
  */
 
 #include <sys/file.h>
+#include <sys/stat.h>
 
 #include <errno.h>
 #include <fcntl.h>
@@ -118,12 +119,15 @@ repo_read_next(struct xbps_repo *repo, struct archive *ar, struct archive_entry
 }
 
 static int
-repo_read_index(struct xbps_repo *repo, struct archive *ar)
+repo_read_index(struct xbps_repo *repo, struct archive *ar, char **bufp,
+		size_t *lenp)
 {
 	struct archive_entry *entry;
-	char *buf;
 	int r;
 
+	*bufp = NULL;
+	*lenp = 0;
+
 	r = repo_read_next(repo, ar, &entry);
 	if (r < 0)
 		return r;
@@ -147,14 +151,66 @@ repo_read_index(struct xbps_repo *repo, struct archive *ar)
 		return 0;
 	}
 
-	buf = xbps_archive_get_file(ar, entry);
-	if (!buf) {
+	/*
+	 * The index is parsed once the remaining members have been read,
+	 * the lookup index might follow them.
+	 */
+	*bufp = xbps_archive_get_file(ar, entry);
+	if (!*bufp) {
 		r = -errno;
 		xbps_error_printf(
 		    "failed to open repository: %s: failed to read index: %s\n",
 		    repo->uri, strerror(-r));
 		return r;
 	}
+	*lenp = archive_entry_size(entry);
+	return 0;
+}
+
+/*
+ * Where a repodata file read from metadir came from, to keep its cache
+ * up to date.
+ */
+struct repo_src {
+	const char *path;
+	struct stat st;
+};
+
+static int
+repo_parse_index(struct xbps_repo *repo, char *buf, size_t len,
+		const char *idx, size_t idxlen, const struct repo_src *src)
+{
+	int r;
+
+	if (idx) {
+		repo->index = xbps_dictionary_internalize_indexed(buf, len,
+		    idx, idxlen);
+		if (repo->index) {
+			if (src)
+				xbps_repo_cache_write(repo, src->path, &src->st,
+				    buf, len, idx, idxlen);
+			xbps_dictionary_make_immutable(repo->index);
+			return 0;
+		}
+		xbps_dbg_printf("[repo] %s: ignoring invalid %s\n", repo->uri,
+		    XBPS_REPODATA_INDEX_IDX);
+	}
+
+	/*
+	 * Only locate the packages in the index, their dictionaries are
+	 * parsed when accessed.
+	 */
+	repo->index = xbps_dictionary_internalize_lazy(buf, len);
+	if (repo->index) {
+		/* buf is kept alive by the index. */
+		if (src)
+			xbps_repo_cache_write(repo, src->path, &src->st,
+			    buf, len, NULL, 0);
+		xbps_dictionary_make_immutable(repo->index);
+		return 0;
+	}
+
+	errno = 0;
 	repo->index = xbps_dictionary_internalize(buf);
 	r = -errno;
 	free(buf);
@@ -171,6 +227,70 @@ repo_read_index(struct xbps_repo *repo, struct archive *ar)
 	return 0;
 }
 
+static void
+repo_read_map(struct xbps_repo *repo, struct archive *ar,
+		struct archive_entry *entry, xbps_dictionary_t *mapp)
+{
+	if (archive_entry_size(entry) == 0)
+		*mapp = xbps_dictionary_create();
+	else
+		*mapp = xbps_archive_get_dictionary(ar, entry);
+	if (!*mapp) {
+		xbps_dbg_printf("[repo] %s: ignoring invalid %s\n",
+		    repo->uri, archive_entry_pathname(entry));
+		return;
+	}
+	xbps_dictionary_make_immutable(*mapp);
+}
+
+/*
+ * Repositories written by newer versions of xbps-rindex(1) carry a lookup
+ * index of the packages in index.plist, which saves scanning the index
+ * for them, and maps of the virtual packages and dependencies in the
+ * index to their providers and reverse dependencies.  They follow the
+ * stage, members that are missing are not an error and unknown members
+ * are skipped.
+ */
+static int
+repo_read_extra(struct xbps_repo *repo, struct archive *ar, char **idxp,
+		size_t *idxlenp)
+{
+	struct archive_entry *entry;
+	const char *name;
+	int r;
+
+	for (;;) {
+		r = repo_read_next(repo, ar, &entry);
+		if (r == -EIO)
+			return 0;
+		else if (r < 0)
+			return r;
+
+		name = archive_entry_pathname(entry);
+		if (strcmp(name, XBPS_REPODATA_INDEX_IDX) == 0 && !*idxp) {
+			*idxp = xbps_archive_get_file(ar, entry);
+			if (!*idxp) {
+				r = -errno;
+				xbps_error_printf(
+				    "failed to open repository: %s: failed to read index: %s\n",
+				    repo->uri, strerror(-r));
+				return r;
+			}
+			*idxlenp = archive_entry_size(entry);
+		} else if (strcmp(name, XBPS_REPODATA_PROVIDES) == 0 &&
+		    !repo->provides) {
+			repo_read_map(repo, ar, entry, &repo->provides);
+		} else if (strcmp(name, XBPS_REPODATA_REVDEPS) == 0 &&
+		    !repo->revdeps) {
+			repo_read_map(repo, ar, entry, &repo->revdeps);
+		} else if (archive_read_data_skip(ar) == ARCHIVE_FATAL) {
+			xbps_error_printf("failed to read repository: %s: archive error: %s\n",
+			    repo->uri, archive_error_string(ar));
+			return -xbps_archive_errno(ar);
+		}
+	}
+}
+
 static int
 repo_read_meta(struct xbps_repo *repo, struct archive *ar)
 {
@@ -271,27 +391,39 @@ repo_read_stage(struct xbps_repo *repo, struct archive *ar)
 }
 
 static int
-repo_read(struct xbps_repo *repo, struct archive *ar)
+repo_read(struct xbps_repo *repo, struct archive *ar,
+		const struct repo_src *src)
 {
+	char *buf, *idx = NULL;
+	size_t len, idxlen = 0;
 	int r;
 
-	r = repo_read_index(repo, ar);
+	r = repo_read_index(repo, ar, &buf, &len);
 	if (r < 0)
 		return r;
 	r = repo_read_meta(repo, ar);
 	if (r < 0)
-		return r;
+		goto err;
 	r = repo_read_stage(repo, ar);
 	if (r < 0)
-		return r;
-
+		goto err;
+	if (!buf)
+		return 0;
+	r = repo_read_extra(repo, ar, &idx, &idxlen);
+	if (r < 0)
+		goto err;
+	r = repo_parse_index(repo, buf, len, idx, idxlen, src);
+	free(idx);
+	return r;
+err:
+	free(idx);
+	free(buf);
 	return r;
 }
 
 static int
-repo_open_local(struct xbps_repo *repo, struct archive *ar)
+repo_local_path(struct xbps_repo *repo, char *path, size_t pathlen)
 {
-	char path[PATH_MAX];
 	int r;
 
 	if (repo->is_remote) {
@@ -303,18 +435,27 @@ repo_open_local(struct xbps_repo *repo, struct archive *ar)
 			    repo->uri);
 			goto err;
 		}
-		r = snprintf(path, sizeof(path), "%s/%s/%s-repodata",
+		r = snprintf(path, pathlen, "%s/%s/%s-repodata",
 		    repo->xhp->metadir, cachedir, repo->arch);
 		free(cachedir);
 	} else {
-		r = snprintf(path, sizeof(path), "%s/%s-repodata", repo->uri, repo->arch);
+		r = snprintf(path, pathlen, "%s/%s-repodata", repo->uri, repo->arch);
 	}
-	if (r < 0 || (size_t)r >= sizeof(path)) {
+	if (r < 0 || (size_t)r >= pathlen) {
 		r = -ENAMETOOLONG;
 		xbps_error_printf("failed to open repository: %s: repository path too long\n",
 		    repo->uri);
 		goto err;
 	}
+	return 0;
+err:
+	return r;
+}
+
+static int
+repo_open_local(struct archive *ar, const char *path)
+{
+	int r;
 
 	r = xbps_archive_read_open(ar, path);
 	if (r < 0) {
@@ -355,9 +496,29 @@ repo_open_remote(struct xbps_repo *repo, struct archive *ar)
 static int
 repo_open(struct xbps_handle *xhp, struct xbps_repo *repo)
 {
+	char path[PATH_MAX];
+	struct repo_src src, *srcp = NULL;
 	struct archive *ar;
+	bool memsync;
 	int r;
 
+	memsync = repo->is_remote && (xhp->flags & XBPS_FLAG_REPOS_MEMSYNC);
+	if (!memsync) {
+		r = repo_local_path(repo, path, sizeof(path));
+		if (r < 0)
+			return r;
+	}
+	/*
+	 * Synchronized repodata files are cached decompressed, use the
+	 * cache if it is up to date.
+	 */
+	if (!memsync && repo->is_remote && stat(path, &src.st) == 0) {
+		if (xbps_repo_cache_open(repo, path, &src.st) == 0)
+			return 0;
+		src.path = path;
+		srcp = &src;
+	}
+
 	ar = xbps_archive_read_new();
 	if (!ar) {
 		r = -errno;
@@ -365,14 +526,14 @@ repo_open(struct xbps_handle *xhp, struct xbps_repo *repo)
 		return r;
 	}
 
-	if (repo->is_remote && (xhp->flags & XBPS_FLAG_REPOS_MEMSYNC))
+	if (memsync)
 		r = repo_open_remote(repo, ar);
 	else
-		r = repo_open_local(repo, ar);
+		r = repo_open_local(ar, path);
 	if (r < 0)
 		goto err;
 
-	r = repo_read(repo, ar);
+	r = repo_read(repo, ar, srcp);
 	if (r < 0)
 		goto err;
 
@@ -557,9 +718,48 @@ xbps_repo_release(struct xbps_repo *repo)
 		xbps_object_release(repo->idxmeta);
 		repo->idxmeta = NULL;
 	}
+	if (repo->provides) {
+		xbps_object_release(repo->provides);
+		repo->provides = NULL;
+	}
+	if (repo->revdeps) {
+		xbps_object_release(repo->revdeps);
+		repo->revdeps = NULL;
+	}
 	free(repo);
 }
 
+/*
+ * Finds the first package in the index that provides `pkg', looking only
+ * at the packages the map of virtual packages lists as its providers.
+ * The map does not cover the stage.
+ */
+static xbps_dictionary_t
+repo_find_virtualpkg(struct xbps_repo *repo, const char *pkg)
+{
+	char vpkgname[XBPS_NAME_SIZE];
+	xbps_array_t providers;
+	xbps_dictionary_t pkgd;
+	const char *pkgname;
+
+	if (!repo->provides || repo->idx != repo->index ||
+	    vpkg_user_conf(repo->xhp, pkg) ||
+	    !xbps_vpkg_name(vpkgname, sizeof(vpkgname), pkg))
+		return xbps_find_virtualpkg_in_dict(repo->xhp, repo->idx, pkg);
+
+	providers = xbps_dictionary_get(repo->provides, vpkgname);
+	for (unsigned int i = 0; i < xbps_array_count(providers); i++) {
+		pkgname = NULL;
+		xbps_array_get_cstring_nocopy(providers, i, &pkgname);
+		if (!pkgname)
+			continue;
+		pkgd = xbps_dictionary_get(repo->idx, pkgname);
+		if (pkgd && xbps_match_virtual_pkg_in_dict(pkgd, pkg))
+			return pkgd;
+	}
+	return NULL;
+}
+
 xbps_dictionary_t
 xbps_repo_get_virtualpkg(struct xbps_repo *repo, const char *pkg)
 {
@@ -570,7 +770,7 @@ xbps_repo_get_virtualpkg(struct xbps_repo *repo, const char *pkg)
 	if (!repo || !repo->idx || !pkg) {
 		return NULL;
 	}
-	pkgd = xbps_find_virtualpkg_in_dict(repo->xhp, repo->idx, pkg);
+	pkgd = repo_find_virtualpkg(repo, pkg);
 	if (!pkgd) {
 		return NULL;
 	}
@@ -633,92 +833,164 @@ add:
 	return pkgd;
 }
 
+static void
+revdeps_add(struct xbps_repo *repo, xbps_dictionary_t pkgd,
+		xbps_array_t *revdepsp)
+{
+	const char *arch = NULL, *pkgver = NULL;
+
+	xbps_dictionary_get_cstring_nocopy(pkgd, "architecture", &arch);
+	if (!xbps_pkg_arch_match(repo->xhp, arch, NULL))
+		return;
+
+	xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver);
+	/* match */
+	if (*revdepsp == NULL)
+		*revdepsp = xbps_array_create();
+
+	if (!xbps_match_string_in_array(*revdepsp, pkgver))
+		xbps_array_add_cstring_nocopy(*revdepsp, pkgver);
+}
+
+/*
+ * Adds `pkgd' to `revdepsp' if it depends on `str' or, without `str', on
+ * tpkgd or any virtual package it provides.
+ */
+static void
+revdeps_match_pkg(struct xbps_repo *repo, xbps_dictionary_t tpkgd,
+		const char *str, xbps_dictionary_t pkgd, xbps_array_t *revdepsp)
+{
+	xbps_array_t pkgdeps, provides;
+	const char *pkgver = NULL, *vpkg = NULL;
+
+	if (xbps_dictionary_equals(pkgd, tpkgd))
+		return;
+
+	pkgdeps = xbps_dictionary_get(pkgd, "run_depends");
+	if (!xbps_array_count(pkgdeps))
+		return;
+	/*
+	 * Try to match passed in string.
+	 */
+	if (str) {
+		if (xbps_match_pkgdep_in_array(pkgdeps, str))
+			revdeps_add(repo, pkgd, revdepsp);
+		return;
+	}
+	/*
+	 * Try to match any virtual package.
+	 */
+	provides = xbps_dictionary_get(tpkgd, "provides");
+	for (unsigned int i = 0; i < xbps_array_count(provides); i++) {
+		xbps_array_get_cstring_nocopy(provides, i, &vpkg);
+		if (xbps_match_pkgdep_in_array(pkgdeps, vpkg))
+			revdeps_add(repo, pkgd, revdepsp);
+	}
+	/*
+	 * Try to match by pkgver.
+	 */
+	xbps_dictionary_get_cstring_nocopy(tpkgd, "pkgver", &pkgver);
+	if (!xbps_match_pkgdep_in_array(pkgdeps, pkgver))
+		return;
+	revdeps_add(repo, pkgd, revdepsp);
+}
+
+static bool
+revdeps_candidates_add(xbps_dictionary_t candidates, xbps_array_t pkgs)
+{
+	const char *pkgname;
+
+	for (unsigned int i = 0; i < xbps_array_count(pkgs); i++) {
+		pkgname = NULL;
+		xbps_array_get_cstring_nocopy(pkgs, i, &pkgname);
+		if (pkgname && !xbps_dictionary_set_bool(candidates, pkgname, true))
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Collects the names of the packages that can depend on `str' or, without
+ * `str', on tpkgd or the virtual packages it provides from the map of
+ * dependencies in the repository, sorted like the index.
+ */
+static xbps_dictionary_t
+revdeps_candidates(struct xbps_repo *repo, xbps_dictionary_t tpkgd,
+		const char *str)
+{
+	char name[XBPS_NAME_SIZE];
+	xbps_dictionary_t candidates;
+	xbps_array_t provides;
+	const char *pkgver = NULL, *vpkg;
+
+	candidates = xbps_dictionary_create();
+	if (!candidates)
+		return NULL;
+	if (!revdeps_candidates_add(candidates,
+	    xbps_dictionary_get(repo->revdeps, "*")))
+		goto err;
+
+	if (str) {
+		if (!xbps_pkg_name(name, sizeof(name), str))
+			goto err;
+		if (!revdeps_candidates_add(candidates,
+		    xbps_dictionary_get(repo->revdeps, name)))
+			goto err;
+		return candidates;
+	}
+
+	provides = xbps_dictionary_get(tpkgd, "provides");
+	for (unsigned int i = 0; i < xbps_array_count(provides); i++) {
+		vpkg = NULL;
+		xbps_array_get_cstring_nocopy(provides, i, &vpkg);
+		if (!vpkg || !xbps_pkg_name(name, sizeof(name), vpkg))
+			goto err;
+		if (!revdeps_candidates_add(candidates,
+		    xbps_dictionary_get(repo->revdeps, name)))
+			goto err;
+	}
+	if (!xbps_dictionary_get_cstring_nocopy(tpkgd, "pkgver", &pkgver) ||
+	    !xbps_pkg_name(name, sizeof(name), pkgver))
+		goto err;
+	if (!revdeps_candidates_add(candidates,
+	    xbps_dictionary_get(repo->revdeps, name)))
+		goto err;
+	return candidates;
+err:
+	xbps_object_release(candidates);
+	return NULL;
+}
+
 static xbps_array_t
 revdeps_match(struct xbps_repo *repo, xbps_dictionary_t tpkgd, const char *str)
 {
-	xbps_dictionary_t pkgd;
-	xbps_array_t revdeps = NULL, pkgdeps, provides;
+	xbps_dictionary_t pkgd, candidates = NULL;
+	xbps_array_t revdeps = NULL;
 	xbps_object_iterator_t iter;
 	xbps_object_t obj;
-	const char *pkgver = NULL, *tpkgver = NULL, *arch = NULL, *vpkg = NULL;
 
-	iter = xbps_dictionary_iterator(repo->idx);
+	/*
+	 * Only look at the packages the map of dependencies lists, it does
+	 * not cover the stage.
+	 */
+	if (repo->revdeps && repo->idx == repo->index)
+		candidates = revdeps_candidates(repo, tpkgd, str);
+
+	iter = xbps_dictionary_iterator(candidates ? candidates : repo->idx);
 	assert(iter);
 
 	while ((obj = xbps_object_iterator_next(iter))) {
-		pkgd = xbps_dictionary_get_keysym(repo->idx, obj);
-		if (xbps_dictionary_equals(pkgd, tpkgd))
-			continue;
-
-		pkgdeps = xbps_dictionary_get(pkgd, "run_depends");
-		if (!xbps_array_count(pkgdeps))
-			continue;
-		/*
-		 * Try to match passed in string.
-		 */
-		if (str) {
-			if (!xbps_match_pkgdep_in_array(pkgdeps, str))
-				continue;
-			xbps_dictionary_get_cstring_nocopy(pkgd,
-			    "architecture", &arch);
-			if (!xbps_pkg_arch_match(repo->xhp, arch, NULL))
-				continue;
-
-			xbps_dictionary_get_cstring_nocopy(pkgd,
-			    "pkgver", &tpkgver);
-			/* match */
-			if (revdeps == NULL)
-				revdeps = xbps_array_create();
-
-			if (!xbps_match_string_in_array(revdeps, tpkgver))
-				xbps_array_add_cstring_nocopy(revdeps, tpkgver);
-
-			continue;
-		}
-		/*
-		 * Try to match any virtual package.
-		 */
-		provides = xbps_dictionary_get(tpkgd, "provides");
-		for (unsigned int i = 0; i < xbps_array_count(provides); i++) {
-			xbps_array_get_cstring_nocopy(provides, i, &vpkg);
-			if (!xbps_match_pkgdep_in_array(pkgdeps, vpkg))
-				continue;
-
-			xbps_dictionary_get_cstring_nocopy(pkgd,
-			    "architecture", &arch);
-			if (!xbps_pkg_arch_match(repo->xhp, arch, NULL))
-				continue;
-
-			xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver",
-			    &tpkgver);
-			/* match */
-			if (revdeps == NULL)
-				revdeps = xbps_array_create();
-
-			if (!xbps_match_string_in_array(revdeps, tpkgver))
-				xbps_array_add_cstring_nocopy(revdeps, tpkgver);
-		}
-		/*
-		 * Try to match by pkgver.
-		 */
-		xbps_dictionary_get_cstring_nocopy(tpkgd, "pkgver", &pkgver);
-		if (!xbps_match_pkgdep_in_array(pkgdeps, pkgver))
-			continue;
-
-		xbps_dictionary_get_cstring_nocopy(pkgd,
-		    "architecture", &arch);
-		if (!xbps_pkg_arch_match(repo->xhp, arch, NULL))
-			continue;
-
-		xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &tpkgver);
-		/* match */
-		if (revdeps == NULL)
-			revdeps = xbps_array_create();
-
-		if (!xbps_match_string_in_array(revdeps, tpkgver))
-			xbps_array_add_cstring_nocopy(revdeps, tpkgver);
+		if (candidates)
+			pkgd = xbps_dictionary_get(repo->idx,
+			    xbps_dictionary_keysym_cstring_nocopy(obj));
+		else
+			pkgd = xbps_dictionary_get_keysym(repo->idx, obj);
+		if (pkgd)
+			revdeps_match_pkg(repo, tpkgd, str, pkgd, &revdeps);
 	}
 	xbps_object_iterator_release(iter);
+	if (candidates)
+		xbps_object_release(candidates);
 	return revdeps;
 }
 
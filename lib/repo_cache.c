@@ -0,0 +1,366 @@
+/*-
+ * Copyright (c) 2026 xbps contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "xbps_api_impl.h"
+
+/*
+ * Cache of the decompressed contents of a synchronized repodata file,
+ * stored next to it in metadir as <arch>-repodata.cache.
+ *
+ * The cache records the size, modification time and inode of the
+ * repodata it was created from and is ignored once they change.  It is
+ * mapped into memory and the index is internalized from the mapping,
+ * package dictionaries are parsed when accessed.
+ *
+ * The file is the header followed by the index, its lookup index,
+ * metadata, stage, map of virtual packages and map of dependencies, each
+ * followed by a NUL byte.  The cache is only
+ * ever replaced by rename(2), so a mapping is never modified.
+ */
+#define REPO_CACHE_MAGIC	"XBPSRDC"
+#define REPO_CACHE_VERSION	3
+#define REPO_CACHE_BYTEORDER	0x01020304
+
+struct repo_cache_hdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteorder;
+	uint64_t src_size;
+	int64_t src_mtime;
+	int64_t src_mtime_nsec;
+	uint64_t src_ino;
+	uint64_t index_size;
+	uint64_t idx_size;
+	uint64_t meta_size;
+	uint64_t stage_size;
+	uint64_t provides_size;
+	uint64_t revdeps_size;
+};
+
+struct repo_cache_map {
+	void *addr;
+	size_t len;
+};
+
+static void
+repo_cache_unmap(void *arg)
+{
+	struct repo_cache_map *map = arg;
+
+	(void)munmap(map->addr, map->len);
+	free(map);
+}
+
+static void
+repo_cache_hdr_init(struct repo_cache_hdr *hdr, const struct stat *st)
+{
+	memset(hdr, 0, sizeof(*hdr));
+	memcpy(hdr->magic, REPO_CACHE_MAGIC, sizeof(REPO_CACHE_MAGIC));
+	hdr->version = REPO_CACHE_VERSION;
+	hdr->byteorder = REPO_CACHE_BYTEORDER;
+	hdr->src_size = st->st_size;
+	hdr->src_mtime = st->st_mtim.tv_sec;
+	hdr->src_mtime_nsec = st->st_mtim.tv_nsec;
+	hdr->src_ino = st->st_ino;
+}
+
+static int
+repo_cache_path(char *path, size_t pathlen, const char *repodata)
+{
+	int r;
+
+	r = snprintf(path, pathlen, "%s.cache", repodata);
+	if (r < 0 || (size_t)r >= pathlen)
+		return -ENAMETOOLONG;
+	return 0;
+}
+
+/*
+ * Sets up repo->index, repo->stage, repo->idxmeta, repo->provides and
+ * repo->revdeps from the cache of the repodata file at `repodata', if it
+ * is up to date.  Returns 0 on success or a negative errno, in which case
+ * the repodata has to be read instead.
+ */
+int HIDDEN
+xbps_repo_cache_open(struct xbps_repo *repo, const char *repodata,
+		const struct stat *st)
+{
+	char path[PATH_MAX];
+	struct repo_cache_hdr hdr, *fhdr;
+	struct repo_cache_map *map;
+	struct stat cst;
+	const char *index, *idx, *meta, *stage, *provides, *revdeps;
+	xbps_dictionary_t d;
+	size_t size;
+	void *addr;
+	int fd, r;
+
+	r = repo_cache_path(path, sizeof(path), repodata);
+	if (r < 0)
+		return r;
+
+	fd = open(path, O_RDONLY|O_CLOEXEC);
+	if (fd == -1)
+		return -errno;
+	if (fstat(fd, &cst) == -1) {
+		r = -errno;
+		close(fd);
+		return r;
+	}
+	if ((uint64_t)cst.st_size < sizeof(hdr) ||
+	    (uint64_t)cst.st_size > SIZE_MAX) {
+		close(fd);
+		return -EINVAL;
+	}
+	size = cst.st_size;
+	addr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	r = -errno;
+	close(fd);
+	if (addr == MAP_FAILED)
+		return r;
+
+	fhdr = addr;
+	repo_cache_hdr_init(&hdr, st);
+	if (memcmp(fhdr, &hdr, offsetof(struct repo_cache_hdr, index_size)) != 0) {
+		xbps_dbg_printf("[repo] %s: stale cache\n", repo->uri);
+		r = -ESTALE;
+		goto err;
+	}
+	/* Every member is followed by a NUL byte. */
+	if (fhdr->index_size > size || fhdr->idx_size > size ||
+	    fhdr->meta_size > size || fhdr->stage_size > size ||
+	    fhdr->provides_size > size || fhdr->revdeps_size > size ||
+	    sizeof(hdr) + fhdr->index_size + fhdr->idx_size +
+	    fhdr->meta_size + fhdr->stage_size + fhdr->provides_size +
+	    fhdr->revdeps_size + 6 != size) {
+		r = -EINVAL;
+		goto err;
+	}
+	index = (const char *)addr + sizeof(hdr);
+	idx = index + fhdr->index_size + 1;
+	meta = idx + fhdr->idx_size + 1;
+	stage = meta + fhdr->meta_size + 1;
+	provides = stage + fhdr->stage_size + 1;
+	revdeps = provides + fhdr->provides_size + 1;
+	if (index[fhdr->index_size] != '\0' || idx[fhdr->idx_size] != '\0' ||
+	    meta[fhdr->meta_size] != '\0' || stage[fhdr->stage_size] != '\0' ||
+	    provides[fhdr->provides_size] != '\0' ||
+	    revdeps[fhdr->revdeps_size] != '\0') {
+		r = -EINVAL;
+		goto err;
+	}
+
+	if (fhdr->meta_size) {
+		repo->idxmeta = xbps_dictionary_internalize(meta);
+		if (!repo->idxmeta) {
+			r = -EINVAL;
+			goto err;
+		}
+		repo->is_signed = true;
+		xbps_dictionary_make_immutable(repo->idxmeta);
+	}
+
+	if (fhdr->stage_size)
+		repo->stage = xbps_dictionary_internalize(stage);
+	else
+		repo->stage = xbps_dictionary_create();
+	if (!repo->stage) {
+		r = -EINVAL;
+		goto err;
+	}
+	xbps_dictionary_make_immutable(repo->stage);
+
+	if (fhdr->provides_size) {
+		repo->provides = xbps_dictionary_internalize(provides);
+		if (!repo->provides) {
+			r = -EINVAL;
+			goto err;
+		}
+		xbps_dictionary_make_immutable(repo->provides);
+	}
+	if (fhdr->revdeps_size) {
+		repo->revdeps = xbps_dictionary_internalize(revdeps);
+		if (!repo->revdeps) {
+			r = -EINVAL;
+			goto err;
+		}
+		xbps_dictionary_make_immutable(repo->revdeps);
+	}
+
+	if (fhdr->index_size == 0) {
+		repo->index = xbps_dictionary_create();
+		if (!repo->index) {
+			r = -errno;
+			goto err;
+		}
+		(void)munmap(addr, size);
+		return 0;
+	}
+
+	map = malloc(sizeof(*map));
+	if (!map) {
+		r = -errno;
+		goto err;
+	}
+	map->addr = addr;
+	map->len = size;
+	d = xbps_dictionary_internalize_mapped(index, fhdr->index_size,
+	    fhdr->idx_size ? idx : NULL, fhdr->idx_size,
+	    repo_cache_unmap, map);
+	if (!d) {
+		free(map);
+		r = -EINVAL;
+		goto err;
+	}
+	/* From here on the mapping is owned by the index. */
+	repo->index = d;
+	xbps_dictionary_make_immutable(repo->index);
+	xbps_dbg_printf("[repo] %s: using cache\n", repo->uri);
+	return 0;
+
+err:
+	if (repo->idxmeta) {
+		xbps_object_release(repo->idxmeta);
+		repo->idxmeta = NULL;
+		repo->is_signed = false;
+	}
+	if (repo->stage) {
+		xbps_object_release(repo->stage);
+		repo->stage = NULL;
+	}
+	if (repo->provides) {
+		xbps_object_release(repo->provides);
+		repo->provides = NULL;
+	}
+	if (repo->revdeps) {
+		xbps_object_release(repo->revdeps);
+		repo->revdeps = NULL;
+	}
+	(void)munmap(addr, size);
+	return r;
+}
+
+/*
+ * Replaces the cache of the repodata file at `repodata' with the given
+ * index and lookup index, along with the already internalized metadata,
+ * stage and maps of virtual packages and dependencies of `repo'.  The
+ * cache is synced before it replaces the previous one, so that a crash
+ * can't leave it truncated.  Failing to write the cache is not an error,
+ * the repodata is simply read again next time.
+ */
+void HIDDEN
+xbps_repo_cache_write(struct xbps_repo *repo, const char *repodata,
+		const struct stat *st, const char *index, size_t indexlen,
+		const void *idx, size_t idxlen)
+{
+	char path[PATH_MAX], tmp[PATH_MAX];
+	struct repo_cache_hdr hdr;
+	char *meta = NULL, *stage = NULL, *provides = NULL, *revdeps = NULL;
+	int fd = -1, r;
+
+	if (repo_cache_path(path, sizeof(path), repodata) < 0)
+		return;
+	r = snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+	if (r < 0 || (size_t)r >= sizeof(tmp))
+		return;
+
+	if (repo->idxmeta &&
+	    (meta = xbps_dictionary_externalize(repo->idxmeta)) == NULL) {
+		r = -ENOMEM;
+		goto out;
+	}
+	if (xbps_dictionary_count(repo->stage) > 0 &&
+	    (stage = xbps_dictionary_externalize(repo->stage)) == NULL) {
+		r = -ENOMEM;
+		goto out;
+	}
+	if (repo->provides &&
+	    (provides = xbps_dictionary_externalize(repo->provides)) == NULL) {
+		r = -ENOMEM;
+		goto out;
+	}
+	if (repo->revdeps &&
+	    (revdeps = xbps_dictionary_externalize(repo->revdeps)) == NULL) {
+		r = -ENOMEM;
+		goto out;
+	}
+
+	repo_cache_hdr_init(&hdr, st);
+	hdr.index_size = indexlen;
+	hdr.idx_size = idxlen;
+	hdr.meta_size = meta ? strlen(meta) : 0;
+	hdr.stage_size = stage ? strlen(stage) : 0;
+	hdr.provides_size = provides ? strlen(provides) : 0;
+	hdr.revdeps_size = revdeps ? strlen(revdeps) : 0;
+
+	fd = mkstemp(tmp);
+	if (fd == -1) {
+		r = -errno;
+		goto out;
+	}
+	if ((r = xbps_write_all(fd, &hdr, sizeof(hdr))) < 0 ||
+	    (r = xbps_write_member(fd, index, indexlen)) < 0 ||
+	    (r = xbps_write_member(fd, idx, idxlen)) < 0 ||
+	    (r = xbps_write_member(fd, meta, hdr.meta_size)) < 0 ||
+	    (r = xbps_write_member(fd, stage, hdr.stage_size)) < 0 ||
+	    (r = xbps_write_member(fd, provides, hdr.provides_size)) < 0 ||
+	    (r = xbps_write_member(fd, revdeps, hdr.revdeps_size)) < 0)
+		goto out;
+	if (fchmod(fd, 0644) == -1 || fsync(fd) == -1 ||
+	    rename(tmp, path) == -1) {
+		r = -errno;
+		goto out;
+	}
+	close(fd);
+	fd = -1;
+	r = 0;
+
+out:
+	if (fd != -1) {
+		close(fd);
+		unlink(tmp);
+	}
+	if (r < 0) {
+		xbps_dbg_printf("[repo] %s: failed to write cache: %s\n",
+		    repo->uri, strerror(-r));
+	}
+	free(meta);
+	free(stage);
+	free(provides);
+	free(revdeps);
+}
@@ -0,0 +1,434 @@
+/*-
+ * Copyright (c) 2026 xbps contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/mman.h>
+
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <archive.h>
+#include <archive_entry.h>
+#include <openssl/evp.h>
+
+#include "xbps_api_impl.h"
+
+/*
+ * Repodata deltas let clients update their copy of the repodata by
+ * downloading the packages that changed since they last synchronized,
+ * instead of the whole repodata.  Every time xbps-rindex writes the
+ * repodata of a repository it also writes a delta from the previous
+ * generation, named after the identifier of the previous repodata:
+ *
+ * 	<arch>-repodata.<from>.delta
+ *
+ * Repodata written this way also stores its own identifier, in the
+ * XBPS_REPODATA_ID member.  Once clients download such a repodata they
+ * record the identifier, along with the size and modification time of
+ * their copy, in <arch>-repodata.id, and only look for deltas while that
+ * record is up to date.  Repositories without deltas cost no more than
+ * the request for the repodata.
+ *
+ * Clients follow the chain of deltas starting at the identifier of
+ * their copy and fall back to downloading the whole repodata if a
+ * delta is missing or does not produce the expected repodata.
+ */
+
+static int
+repodata_id_update(EVP_MD_CTX *md, struct archive *ar)
+{
+	char buf[65536];
+	ssize_t rd;
+
+	while ((rd = archive_read_data(ar, buf, sizeof(buf))) > 0)
+		EVP_DigestUpdate(md, buf, rd);
+	if (rd < 0)
+		return -xbps_archive_errno(ar);
+	EVP_DigestUpdate(md, "", 1);
+	return 0;
+}
+
+int HIDDEN
+xbps_repodata_id(const char *path, char *dst, size_t len)
+{
+	static const char *const members[] = {
+		XBPS_REPODATA_INDEX, XBPS_REPODATA_META, XBPS_REPODATA_STAGE,
+	};
+	unsigned char digest[XBPS_SHA256_DIGEST_SIZE];
+	struct archive_entry *entry;
+	struct archive *ar;
+	EVP_MD_CTX *md;
+	int r;
+
+	assert(path);
+	assert(dst);
+
+	if (len < XBPS_SHA256_SIZE)
+		return -ENOBUFS;
+
+	if ((md = EVP_MD_CTX_new()) == NULL)
+		return -ENOMEM;
+	if (EVP_DigestInit_ex(md, EVP_sha256(), NULL) != 1) {
+		EVP_MD_CTX_free(md);
+		return -EINVAL;
+	}
+	ar = xbps_archive_read_new();
+	if (!ar) {
+		r = -errno;
+		EVP_MD_CTX_free(md);
+		return r;
+	}
+	r = xbps_archive_read_open(ar, path);
+	if (r < 0)
+		goto out;
+
+	for (size_t i = 0; i < __arraycount(members); i++) {
+		r = archive_read_next_header(ar, &entry);
+		if (r == ARCHIVE_FATAL) {
+			r = -xbps_archive_errno(ar);
+			goto out;
+		} else if (r == ARCHIVE_EOF ||
+		    strcmp(archive_entry_pathname(entry), members[i]) != 0) {
+			r = -EINVAL;
+			goto out;
+		}
+		r = repodata_id_update(md, ar);
+		if (r < 0)
+			goto out;
+	}
+	if (EVP_DigestFinal_ex(md, digest, NULL) != 1) {
+		r = -EINVAL;
+		goto out;
+	}
+	xbps_digest2string(digest, dst, sizeof(digest));
+	r = 0;
+out:
+	archive_read_free(ar);
+	EVP_MD_CTX_free(md);
+	return r;
+}
+
+/*
+ * Reads the identifier stored by the writer of the repodata `path',
+ * returns -ENOENT if it does not publish deltas.
+ */
+static int
+repodata_read_id(const char *path, char *id, size_t len)
+{
+	struct archive_entry *entry;
+	struct archive *ar;
+	ssize_t rd;
+	int r;
+
+	ar = xbps_archive_read_new();
+	if (!ar)
+		return -errno;
+	r = xbps_archive_read_open(ar, path);
+	if (r < 0)
+		goto out;
+	for (;;) {
+		r = archive_read_next_header(ar, &entry);
+		if (r == ARCHIVE_EOF) {
+			r = -ENOENT;
+			goto out;
+		} else if (r == ARCHIVE_FATAL) {
+			r = -xbps_archive_errno(ar);
+			goto out;
+		}
+		if (strcmp(archive_entry_pathname(entry), XBPS_REPODATA_ID) == 0)
+			break;
+		if (archive_read_data_skip(ar) == ARCHIVE_FATAL) {
+			r = -xbps_archive_errno(ar);
+			goto out;
+		}
+	}
+	rd = archive_read_data(ar, id, len - 1);
+	if (rd < 0) {
+		r = -xbps_archive_errno(ar);
+		goto out;
+	}
+	id[rd] = '\0';
+	r = (size_t)rd == len - 1 ? 0 : -EINVAL;
+out:
+	archive_read_free(ar);
+	return r;
+}
+
+/*
+ * Reads the identifier of the local copy `repodata' recorded in `file',
+ * if the copy has not changed since.
+ */
+static int
+delta_id_read(const char *repodata, const char *file, char *id, size_t len)
+{
+	char buf[XBPS_SHA256_SIZE + 64];
+	struct stat st;
+	intmax_t size, mtime;
+	FILE *fp;
+	int r = -EINVAL;
+
+	if (stat(repodata, &st) == -1)
+		return -errno;
+	if ((fp = fopen(file, "r")) == NULL)
+		return -errno;
+	if (fgets(buf, sizeof(buf), fp) &&
+	    sscanf(buf, "%64s %jd %jd", id, &size, &mtime) == 3 &&
+	    strlen(id) == len - 1 &&
+	    size == (intmax_t)st.st_size && mtime == (intmax_t)st.st_mtime)
+		r = 0;
+	fclose(fp);
+	return r;
+}
+
+static void
+delta_id_write(const char *repodata, const char *file, const char *id)
+{
+	struct stat st;
+	FILE *fp;
+
+	if (stat(repodata, &st) == -1 || (fp = fopen(file, "w")) == NULL) {
+		(void)unlink(file);
+		return;
+	}
+	fprintf(fp, "%s %jd %jd\n", id, (intmax_t)st.st_size,
+	    (intmax_t)st.st_mtime);
+	if (fclose(fp) == EOF)
+		(void)unlink(file);
+}
+
+/*
+ * Reads the dictionary in the first member of the archive `path', which
+ * must be named `name'.  Empty members are empty dictionaries.
+ */
+static xbps_dictionary_t
+read_dictionary(const char *path, const char *name)
+{
+	struct archive_entry *entry;
+	struct archive *ar;
+	xbps_dictionary_t d = NULL;
+	int r;
+
+	ar = xbps_archive_read_new();
+	if (!ar)
+		return NULL;
+	r = xbps_archive_read_open(ar, path);
+	if (r < 0) {
+		errno = -r;
+		goto out;
+	}
+	r = archive_read_next_header(ar, &entry);
+	if (r == ARCHIVE_FATAL || r == ARCHIVE_EOF ||
+	    strcmp(archive_entry_pathname(entry), name) != 0) {
+		errno = EINVAL;
+		goto out;
+	}
+	if (archive_entry_size(entry) == 0)
+		d = xbps_dictionary_create();
+	else
+		d = xbps_archive_get_dictionary(ar, entry);
+out:
+	archive_read_free(ar);
+	return d;
+}
+
+/*
+ * Applies the delta `file' to the repodata `repodata' identified by `id'
+ * and stores the identifier of the resulting repodata in `id'.
+ */
+static int
+delta_apply(const char *repodata, const char *file, const char *arch,
+		char *id, size_t idlen)
+{
+	char newid[XBPS_SHA256_SIZE];
+	struct timespec ts[2];
+	xbps_object_iterator_t iter;
+	xbps_object_t keysym;
+	xbps_dictionary_t delta, index = NULL, changed;
+	xbps_array_t removed;
+	const char *from = NULL, *to = NULL, *pkgname;
+	uint64_t mtime = 0;
+	int r;
+
+	errno = 0;
+	delta = read_dictionary(file, XBPS_REPODATA_DELTA);
+	if (!delta)
+		return errno ? -errno : -EINVAL;
+	if (!xbps_dictionary_get_cstring_nocopy(delta, "from", &from) ||
+	    !xbps_dictionary_get_cstring_nocopy(delta, "to", &to) ||
+	    !xbps_dictionary_get_uint64(delta, "mtime", &mtime) ||
+	    strcmp(from, id) != 0 || strlen(to) >= idlen) {
+		r = -EINVAL;
+		goto out;
+	}
+	changed = xbps_dictionary_get(delta, "index");
+	removed = xbps_dictionary_get(delta, "removed");
+
+	errno = 0;
+	index = read_dictionary(repodata, XBPS_REPODATA_INDEX);
+	if (!index) {
+		r = errno ? -errno : -EINVAL;
+		goto out;
+	}
+	for (unsigned int i = 0; i < xbps_array_count(removed); i++) {
+		pkgname = NULL;
+		xbps_array_get_cstring_nocopy(removed, i, &pkgname);
+		if (pkgname)
+			xbps_dictionary_remove(index, pkgname);
+	}
+	iter = xbps_dictionary_iterator(changed);
+	if (iter) {
+		while ((keysym = xbps_object_iterator_next(iter))) {
+			if (!xbps_dictionary_set_keysym(index, keysym,
+			    xbps_dictionary_get_keysym(changed, keysym))) {
+				xbps_object_iterator_release(iter);
+				r = -ENOMEM;
+				goto out;
+			}
+		}
+		xbps_object_iterator_release(iter);
+	}
+
+	/*
+	 * The local copy is not compressed, it is written once per
+	 * generation and read every time the repository is opened.
+	 */
+	r = xbps_repodata_flush(".", arch, NULL, index,
+	    xbps_dictionary_get(delta, "stage"),
+	    xbps_dictionary_get(delta, "meta"), "none");
+	if (r < 0)
+		goto out;
+	r = xbps_repodata_id(repodata, newid, sizeof(newid));
+	if (r < 0 || strcmp(newid, to) != 0) {
+		xbps_dbg_printf("[reposync] delta `%s' did not produce `%s', "
+		    "discarding `%s'\n", file, to, repodata);
+		(void)unlink(repodata);
+		r = -EINVAL;
+		goto out;
+	}
+	/*
+	 * Set the modification time of the repodata the delta was
+	 * created from, so that the following request for the repodata
+	 * is not answered if it is still up to date.
+	 */
+	ts[0].tv_sec = ts[1].tv_sec = (time_t)mtime;
+	ts[0].tv_nsec = ts[1].tv_nsec = 0;
+	if (utimensat(AT_FDCWD, repodata, ts, 0) == -1) {
+		r = -errno;
+		goto out;
+	}
+	xbps_strlcpy(id, to, idlen);
+	r = 0;
+out:
+	if (index)
+		xbps_object_release(index);
+	xbps_object_release(delta);
+	return r;
+}
+
+void HIDDEN
+xbps_repo_sync_delta(struct xbps_handle *xhp, const char *uri,
+		const char *arch)
+{
+	char id[XBPS_SHA256_SIZE];
+	char repodata[PATH_MAX], idfile[PATH_MAX], file[PATH_MAX], part[PATH_MAX];
+	char *url;
+	int r;
+
+	r = snprintf(repodata, sizeof(repodata), "%s-repodata", arch);
+	if (r < 0 || (size_t)r >= sizeof(repodata))
+		return;
+	r = snprintf(idfile, sizeof(idfile), "%s.id", repodata);
+	if (r < 0 || (size_t)r >= sizeof(idfile))
+		return;
+	r = snprintf(file, sizeof(file), "%s-repodata.delta", arch);
+	if (r < 0 || (size_t)r >= sizeof(file))
+		return;
+	r = snprintf(part, sizeof(part), "%s.part", file);
+	if (r < 0 || (size_t)r >= sizeof(part))
+		return;
+
+	/* only repositories that published their repodata with deltas */
+	if (delta_id_read(repodata, idfile, id, sizeof(id)) < 0)
+		return;
+
+	for (int i = 0; i < XBPS_REPODATA_DELTA_MAX; i++) {
+		(void)unlink(file);
+		(void)unlink(part);
+		url = xbps_xasprintf("%s/%s-repodata.%s.delta", uri, arch, id);
+		r = xbps_fetch_file_dest(xhp, url, file, NULL);
+		free(url);
+		if (r == -1)
+			break;
+		r = delta_apply(repodata, file, arch, id, sizeof(id));
+		(void)unlink(file);
+		if (r < 0) {
+			xbps_dbg_printf("[reposync] %s: failed to apply delta: "
+			    "%s\n", uri, strerror(-r));
+			(void)unlink(idfile);
+			break;
+		}
+		delta_id_write(repodata, idfile, id);
+		xbps_dbg_printf("[reposync] %s: updated %s to `%s'\n", uri,
+		    repodata, id);
+	}
+	(void)unlink(part);
+}
+
+/*
+ * Records the identifier of the repodata just downloaded, if the
+ * repository publishes deltas.
+ */
+void HIDDEN
+xbps_repo_sync_delta_update(const char *uri, const char *arch)
+{
+	char id[XBPS_SHA256_SIZE];
+	char repodata[PATH_MAX], idfile[PATH_MAX];
+	int r;
+
+	r = snprintf(repodata, sizeof(repodata), "%s-repodata", arch);
+	if (r < 0 || (size_t)r >= sizeof(repodata))
+		return;
+	r = snprintf(idfile, sizeof(idfile), "%s.id", repodata);
+	if (r < 0 || (size_t)r >= sizeof(idfile))
+		return;
+
+	r = repodata_read_id(repodata, id, sizeof(id));
+	if (r < 0) {
+		if (r != -ENOENT) {
+			xbps_dbg_printf("[reposync] %s/%s: cannot identify "
+			    "repodata: %s\n", uri, repodata, strerror(-r));
+		}
+		(void)unlink(idfile);
+		return;
+	}
+	delta_id_write(repodata, idfile, id);
+}
@@ -0,0 +1,816 @@
+/*-
+ * Copyright (c) 2013-2019 Juan Romero Pardines.
+ * Copyright (c) 2023 Duncan Overbruck <mail@duncano.de>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/stat.h>
+
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <archive.h>
+#include <archive_entry.h>
+#include <openssl/evp.h>
+
+#include "xbps_api_impl.h"
+
+static struct archive *
+open_archive(int fd, const char *compression)
+{
+	struct archive *ar;
+	int r;
+
+	ar = archive_write_new();
+	if (!ar)
+		return NULL;
+	/*
+	 * Set compression format, zstd by default.
+	 */
+	if (compression == NULL || strcmp(compression, "zstd") == 0) {
+		archive_write_add_filter_zstd(ar);
+		archive_write_set_options(ar, "compression-level=9");
+	} else if (strcmp(compression, "gzip") == 0) {
+		archive_write_add_filter_gzip(ar);
+		archive_write_set_options(ar, "compression-level=9");
+	} else if (strcmp(compression, "bzip2") == 0) {
+		archive_write_add_filter_bzip2(ar);
+		archive_write_set_options(ar, "compression-level=9");
+	} else if (strcmp(compression, "lz4") == 0) {
+		archive_write_add_filter_lz4(ar);
+		archive_write_set_options(ar, "compression-level=9");
+	} else if (strcmp(compression, "xz") == 0) {
+		archive_write_add_filter_xz(ar);
+		archive_write_set_options(ar, "compression-level=9");
+	} else if (strcmp(compression, "none") == 0) {
+		/* empty */
+	} else {
+		archive_write_free(ar);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	archive_write_set_format_pax_restricted(ar);
+	r = archive_write_open_fd(ar, fd);
+	if (r != ARCHIVE_OK) {
+		r = -archive_errno(ar);
+		if (r == 1)
+			r = -EINVAL;
+		archive_write_free(ar);
+		errno = -r;
+		return NULL;
+	}
+
+	return ar;
+}
+
+/*
+ * Adds a member to the identifier of the repodata being written, as
+ * computed by xbps_repodata_id() from the data read back.
+ */
+static void
+repodata_id_update(EVP_MD_CTX *md, const void *buf, size_t len)
+{
+	if (md == NULL)
+		return;
+	EVP_DigestUpdate(md, buf, len);
+	EVP_DigestUpdate(md, "", 1);
+}
+
+static int
+archive_dict(struct archive *ar, const char *filename, xbps_dictionary_t dict,
+		EVP_MD_CTX *md)
+{
+	char *buf;
+	int r;
+
+	if (xbps_dictionary_count(dict) == 0) {
+		r = xbps_archive_append_buf(ar, "", 0, filename, 0644,
+		    "root", "root");
+		if (r < 0)
+			return r;
+		repodata_id_update(md, "", 0);
+		return 0;
+	}
+
+	errno = 0;
+	buf = xbps_dictionary_externalize(dict);
+	if (!buf) {
+		r = -errno;
+		xbps_error_printf("failed to externalize dictionary for: %s\n",
+		    filename);
+		if (r == 0)
+			return -EINVAL;
+		return 0;
+	}
+
+	r = xbps_archive_append_buf(ar, buf, strlen(buf), filename, 0644,
+	    "root", "root");
+	if (r == 0)
+		repodata_id_update(md, buf, strlen(buf));
+
+	free(buf);
+
+	if (r < 0) {
+		xbps_error_printf("failed to write archive entry: %s: %s\n",
+		    filename, strerror(-r));
+	}
+	return r;
+}
+
+/*
+ * Writes the index along with a lookup index of its packages, which lets
+ * clients defer parsing package dictionaries until they are accessed.
+ * The lookup index is written last, after the members older clients
+ * expect to find.
+ */
+static int
+archive_index(struct archive *ar, xbps_dictionary_t index,
+		void **idx, size_t *idxlen, EVP_MD_CTX *md)
+{
+	char *buf;
+	int r;
+
+	*idx = NULL;
+	*idxlen = 0;
+	if (xbps_dictionary_count(index) == 0)
+		return archive_dict(ar, XBPS_REPODATA_INDEX, index, md);
+
+	errno = 0;
+	buf = xbps_dictionary_externalize_indexed(index, idx, idxlen);
+	if (!buf) {
+		r = -errno;
+		xbps_error_printf("failed to externalize dictionary for: %s\n",
+		    XBPS_REPODATA_INDEX);
+		if (r == 0)
+			return -EINVAL;
+		return r;
+	}
+
+	r = xbps_archive_append_buf(ar, buf, strlen(buf), XBPS_REPODATA_INDEX,
+	    0644, "root", "root");
+	if (r == 0)
+		repodata_id_update(md, buf, strlen(buf));
+
+	free(buf);
+
+	if (r < 0) {
+		xbps_error_printf("failed to write archive entry: %s: %s\n",
+		    XBPS_REPODATA_INDEX, strerror(-r));
+		free(*idx);
+		*idx = NULL;
+	}
+	return r;
+}
+
+/*
+ * Adds `pkgname' to the array of package names stored as `key' in `map'.
+ * Packages are added in index order, so duplicates are adjacent.
+ */
+static bool
+map_add(xbps_dictionary_t map, const char *key, const char *pkgname)
+{
+	xbps_array_t pkgs;
+	const char *last = NULL;
+	unsigned int n;
+
+	pkgs = xbps_dictionary_get(map, key);
+	if (!pkgs) {
+		pkgs = xbps_array_create();
+		if (!pkgs)
+			return false;
+		if (!xbps_dictionary_set(map, key, pkgs)) {
+			xbps_object_release(pkgs);
+			return false;
+		}
+		xbps_object_release(pkgs);
+	}
+	n = xbps_array_count(pkgs);
+	if (n > 0 && xbps_array_get_cstring_nocopy(pkgs, n - 1, &last) &&
+	    strcmp(last, pkgname) == 0)
+		return true;
+	return xbps_array_add_cstring_nocopy(pkgs, pkgname);
+}
+
+/*
+ * Maps every virtual package provided in the index to the names of its
+ * providers, in index order.  Returns NULL with errno set to EINVAL if
+ * a package provides something that is not a valid pkgver, clients
+ * search the index for providers then.
+ */
+static xbps_dictionary_t
+index_provides(xbps_dictionary_t index)
+{
+	char vpkgname[XBPS_NAME_SIZE];
+	xbps_object_iterator_t iter;
+	xbps_object_t keysym;
+	xbps_dictionary_t provides, pkgd;
+	xbps_array_t pkgprovides;
+	const char *pkgname, *vpkg;
+
+	provides = xbps_dictionary_create();
+	if (!provides)
+		return NULL;
+	iter = xbps_dictionary_iterator(index);
+	if (!iter)
+		goto err;
+
+	while ((keysym = xbps_object_iterator_next(iter))) {
+		pkgname = xbps_dictionary_keysym_cstring_nocopy(keysym);
+		pkgd = xbps_dictionary_get_keysym(index, keysym);
+		pkgprovides = xbps_dictionary_get(pkgd, "provides");
+		for (unsigned int i = 0; i < xbps_array_count(pkgprovides); i++) {
+			vpkg = NULL;
+			xbps_array_get_cstring_nocopy(pkgprovides, i, &vpkg);
+			if (!vpkg || xbps_pkgpattern_version(vpkg) ||
+			    !xbps_pkg_name(vpkgname, sizeof(vpkgname), vpkg)) {
+				xbps_dbg_printf("%s: invalid virtual package "
+				    "`%s'\n", pkgname, vpkg ? vpkg : "");
+				errno = EINVAL;
+				goto err;
+			}
+			if (!map_add(provides, vpkgname, pkgname))
+				goto err;
+		}
+	}
+	xbps_object_iterator_release(iter);
+	return provides;
+err:
+	if (iter)
+		xbps_object_iterator_release(iter);
+	xbps_object_release(provides);
+	return NULL;
+}
+
+/*
+ * Maps the names of the run time dependencies in the index to the names
+ * of the packages depending on them, in index order.  Packages with a
+ * dependency that can match more than one name, a glob pattern, are
+ * listed under "*".
+ */
+static xbps_dictionary_t
+index_revdeps(xbps_dictionary_t index)
+{
+	char depname[XBPS_NAME_SIZE];
+	xbps_object_iterator_t iter;
+	xbps_object_t keysym;
+	xbps_dictionary_t revdeps, pkgd;
+	xbps_array_t rundeps;
+	const char *pkgname, *dep, *key;
+	bool valid;
+
+	revdeps = xbps_dictionary_create();
+	if (!revdeps)
+		return NULL;
+	iter = xbps_dictionary_iterator(index);
+	if (!iter)
+		goto err;
+
+	while ((keysym = xbps_object_iterator_next(iter))) {
+		pkgname = xbps_dictionary_keysym_cstring_nocopy(keysym);
+		pkgd = xbps_dictionary_get_keysym(index, keysym);
+		rundeps = xbps_dictionary_get(pkgd, "run_depends");
+		for (unsigned int i = 0; i < xbps_array_count(rundeps); i++) {
+			dep = NULL;
+			xbps_array_get_cstring_nocopy(rundeps, i, &dep);
+			if (!dep)
+				continue;
+			if (strpbrk(dep, "*?[]"))
+				valid = false;
+			else if (xbps_pkgpattern_version(dep))
+				valid = xbps_pkgpattern_name(depname,
+				    sizeof(depname), dep);
+			else if (xbps_pkg_version(dep))
+				valid = xbps_pkg_name(depname, sizeof(depname), dep);
+			else
+				valid = xbps_strlcpy(depname, dep,
+				    sizeof(depname)) < sizeof(depname);
+			key = valid ? depname : "*";
+			if (!map_add(revdeps, key, pkgname))
+				goto err;
+		}
+	}
+	xbps_object_iterator_release(iter);
+	return revdeps;
+err:
+	if (iter)
+		xbps_object_iterator_release(iter);
+	xbps_object_release(revdeps);
+	return NULL;
+}
+
+/*
+ * Writes the map of virtual packages to their providers and the map of
+ * dependencies to the packages depending on them, which save clients
+ * from looking at every package to find a provider or reverse
+ * dependencies.
+ */
+static int
+archive_maps(struct archive *ar, xbps_dictionary_t index)
+{
+	xbps_dictionary_t map;
+	int r;
+
+	errno = 0;
+	map = index_provides(index);
+	if (map) {
+		r = archive_dict(ar, XBPS_REPODATA_PROVIDES, map, NULL);
+		xbps_object_release(map);
+		if (r < 0)
+			return r;
+	} else if (errno != EINVAL) {
+		r = errno ? -errno : -ENOMEM;
+		xbps_error_printf("failed to create %s: %s\n",
+		    XBPS_REPODATA_PROVIDES, strerror(-r));
+		return r;
+	}
+
+	errno = 0;
+	map = index_revdeps(index);
+	if (!map) {
+		r = errno ? -errno : -ENOMEM;
+		xbps_error_printf("failed to create %s: %s\n",
+		    XBPS_REPODATA_REVDEPS, strerror(-r));
+		return r;
+	}
+	r = archive_dict(ar, XBPS_REPODATA_REVDEPS, map, NULL);
+	xbps_object_release(map);
+	return r;
+}
+
+static int
+repodata_write(const char *repodir,
+		const char *arch,
+		xbps_dictionary_t index,
+		xbps_dictionary_t stage,
+		xbps_dictionary_t meta,
+		const char *compression)
+{
+	char path[PATH_MAX];
+	char tmp[PATH_MAX];
+	char id[XBPS_SHA256_SIZE];
+	unsigned char digest[XBPS_SHA256_DIGEST_SIZE];
+	struct archive *ar = NULL;
+	EVP_MD_CTX *md = NULL;
+	void *idx = NULL;
+	size_t idxlen = 0;
+	mode_t prevumask;
+	int r;
+	int fd;
+
+	r = snprintf(path, sizeof(path), "%s/%s-repodata", repodir, arch);
+	if (r < 0 || (size_t)r >= sizeof(tmp)) {
+		xbps_error_printf("repodata path too long: %s: %s\n", path,
+		    strerror(ENAMETOOLONG));
+		return -ENAMETOOLONG;
+	}
+
+	r = snprintf(tmp, sizeof(tmp), "%s.XXXXXXX", path);
+	if (r < 0 || (size_t)r >= sizeof(tmp)) {
+		xbps_error_printf("repodata tmp path too long: %s: %s\n", path,
+		    strerror(ENAMETOOLONG));
+		return -ENAMETOOLONG;
+	}
+
+	prevumask = umask(S_IXUSR|S_IRWXG|S_IRWXO);
+	fd = mkstemp(tmp);
+	if (fd == -1) {
+		r = -errno;
+		xbps_error_printf("failed to open temp file: %s: %s", tmp, strerror(-r));
+		umask(prevumask);
+		goto err;
+	}
+	umask(prevumask);
+
+	ar = open_archive(fd, compression);
+	if (!ar) {
+		r = -errno;
+		goto err;
+	}
+
+	md = EVP_MD_CTX_new();
+	if (!md || EVP_DigestInit_ex(md, EVP_sha256(), NULL) != 1) {
+		r = -ENOMEM;
+		goto err;
+	}
+	r = archive_index(ar, index, &idx, &idxlen, md);
+	if (r < 0)
+		goto err;
+	r = archive_dict(ar, XBPS_REPODATA_META, meta, md);
+	if (r < 0)
+		goto err;
+	r = archive_dict(ar, XBPS_REPODATA_STAGE, stage, md);
+	if (r < 0)
+		goto err;
+	if (EVP_DigestFinal_ex(md, digest, NULL) != 1) {
+		r = -EINVAL;
+		goto err;
+	}
+	EVP_MD_CTX_free(md);
+	md = NULL;
+	xbps_digest2string(digest, id, sizeof(digest));
+	if (idx) {
+		r = xbps_archive_append_buf(ar, idx, idxlen,
+		    XBPS_REPODATA_INDEX_IDX, 0644, "root", "root");
+		if (r < 0) {
+			xbps_error_printf("failed to write archive entry: %s: %s\n",
+			    XBPS_REPODATA_INDEX_IDX, strerror(-r));
+			goto err;
+		}
+		free(idx);
+		idx = NULL;
+		r = archive_maps(ar, index);
+		if (r < 0)
+			goto err;
+	}
+	/*
+	 * The identifier tells clients that deltas to the following
+	 * generations are published, see xbps_repo_sync_delta().
+	 */
+	r = xbps_archive_append_buf(ar, id, strlen(id), XBPS_REPODATA_ID,
+	    0644, "root", "root");
+	if (r < 0) {
+		xbps_error_printf("failed to write archive entry: %s: %s\n",
+		    XBPS_REPODATA_ID, strerror(-r));
+		goto err;
+	}
+
+	/* Write data to tempfile and rename */
+	if (archive_write_close(ar) == ARCHIVE_FATAL) {
+		r = -archive_errno(ar);
+		if (r == 1)
+			r = -EINVAL;
+		xbps_error_printf("failed to close archive: %s\n", archive_error_string(ar));
+		goto err;
+	}
+	if (archive_write_free(ar) == ARCHIVE_FATAL) {
+		r = -errno;
+		xbps_error_printf("failed to free archive: %s\n", strerror(-r));
+		goto err;
+	}
+
+#ifdef HAVE_FDATASYNC
+	fdatasync(fd);
+#else
+	fsync(fd);
+#endif
+
+	if (fchmod(fd, 0664) == -1) {
+		errno = -r;
+		xbps_error_printf("failed to set mode: %s: %s\n",
+		   tmp, strerror(-r));
+		close(fd);
+		unlink(tmp);
+		return r;
+	}
+	close(fd);
+
+	if (rename(tmp, path) == -1) {
+		r = -errno;
+		xbps_error_printf("failed to rename repodata: %s: %s: %s\n",
+		   tmp, path, strerror(-r));
+		unlink(tmp);
+		return r;
+	}
+	return 0;
+
+err:
+	free(idx);
+	if (md)
+		EVP_MD_CTX_free(md);
+	if (ar) {
+		archive_write_close(ar);
+		archive_write_free(ar);
+	}
+	if (fd != -1)
+		close(fd);
+	unlink(tmp);
+	return r;
+}
+
+/*
+ * Collects the packages that were added or changed since `oldindex' and
+ * the names of the packages that were removed.
+ */
+static xbps_dictionary_t
+delta_create(const char *from, const char *to, time_t mtime,
+		xbps_dictionary_t oldindex, xbps_dictionary_t index,
+		xbps_dictionary_t stage, xbps_dictionary_t meta)
+{
+	xbps_object_iterator_t iter;
+	xbps_object_t keysym;
+	xbps_dictionary_t delta, changed, pkgd, oldpkgd;
+	xbps_array_t removed;
+	const char *pkgname;
+
+	delta = xbps_dictionary_create();
+	changed = xbps_dictionary_create();
+	removed = xbps_array_create();
+	if (!delta || !changed || !removed)
+		goto err;
+
+	iter = xbps_dictionary_iterator(index);
+	if (!iter)
+		goto err;
+	while ((keysym = xbps_object_iterator_next(iter))) {
+		pkgname = xbps_dictionary_keysym_cstring_nocopy(keysym);
+		pkgd = xbps_dictionary_get_keysym(index, keysym);
+		oldpkgd = xbps_dictionary_get(oldindex, pkgname);
+		if (oldpkgd && xbps_dictionary_equals(oldpkgd, pkgd))
+			continue;
+		if (!xbps_dictionary_set(changed, pkgname, pkgd)) {
+			xbps_object_iterator_release(iter);
+			goto err;
+		}
+	}
+	xbps_object_iterator_release(iter);
+
+	iter = xbps_dictionary_iterator(oldindex);
+	if (!iter)
+		goto err;
+	while ((keysym = xbps_object_iterator_next(iter))) {
+		pkgname = xbps_dictionary_keysym_cstring_nocopy(keysym);
+		if (xbps_dictionary_get(index, pkgname))
+			continue;
+		if (!xbps_array_add_cstring(removed, pkgname)) {
+			xbps_object_iterator_release(iter);
+			goto err;
+		}
+	}
+	xbps_object_iterator_release(iter);
+
+	if (!xbps_dictionary_set_cstring(delta, "from", from) ||
+	    !xbps_dictionary_set_cstring(delta, "to", to) ||
+	    !xbps_dictionary_set_uint64(delta, "mtime", (uint64_t)mtime) ||
+	    !xbps_dictionary_set(delta, "index", changed) ||
+	    !xbps_dictionary_set(delta, "removed", removed))
+		goto err;
+	if (stage && !xbps_dictionary_set(delta, "stage", stage))
+		goto err;
+	if (meta && !xbps_dictionary_set(delta, "meta", meta))
+		goto err;
+
+	xbps_object_release(changed);
+	xbps_object_release(removed);
+	return delta;
+err:
+	if (delta)
+		xbps_object_release(delta);
+	if (changed)
+		xbps_object_release(changed);
+	if (removed)
+		xbps_object_release(removed);
+	errno = ENOMEM;
+	return NULL;
+}
+
+struct delta_file {
+	char name[NAME_MAX+1];
+	time_t mtime;
+};
+
+static int
+delta_file_cmp(const void *a, const void *b)
+{
+	const struct delta_file *da = a, *db = b;
+
+	if (da->mtime > db->mtime)
+		return -1;
+	if (da->mtime < db->mtime)
+		return 1;
+	return strcmp(da->name, db->name);
+}
+
+/*
+ * Removes all but the XBPS_REPODATA_DELTA_MAX most recent deltas.
+ */
+static void
+delta_prune(const char *repodir, const char *arch)
+{
+	char prefix[PATH_MAX], path[PATH_MAX];
+	struct delta_file *files = NULL, *tmp;
+	struct dirent *dp;
+	struct stat st;
+	size_t nfiles = 0, sz = 0, prefixlen, len;
+	DIR *dirp;
+
+	prefixlen = snprintf(prefix, sizeof(prefix), "%s-repodata.", arch);
+	if (prefixlen >= sizeof(prefix))
+		return;
+	if ((dirp = opendir(repodir)) == NULL)
+		return;
+	while ((dp = readdir(dirp))) {
+		len = strlen(dp->d_name);
+		if (len <= prefixlen + sizeof(".delta") - 1 ||
+		    strncmp(dp->d_name, prefix, prefixlen) != 0 ||
+		    strcmp(dp->d_name + len - sizeof(".delta") + 1, ".delta") != 0)
+			continue;
+		if (snprintf(path, sizeof(path), "%s/%s", repodir,
+		    dp->d_name) >= (int)sizeof(path) || stat(path, &st) == -1)
+			continue;
+		if (nfiles == sz) {
+			sz = sz ? sz * 2 : 64;
+			tmp = realloc(files, sz * sizeof(*files));
+			if (!tmp)
+				goto out;
+			files = tmp;
+		}
+		xbps_strlcpy(files[nfiles].name, dp->d_name,
+		    sizeof(files[nfiles].name));
+		files[nfiles].mtime = st.st_mtime;
+		nfiles++;
+	}
+	if (nfiles <= XBPS_REPODATA_DELTA_MAX)
+		goto out;
+
+	qsort(files, nfiles, sizeof(*files), delta_file_cmp);
+	for (size_t i = XBPS_REPODATA_DELTA_MAX; i < nfiles; i++) {
+		snprintf(path, sizeof(path), "%s/%s", repodir, files[i].name);
+		if (unlink(path) == -1)
+			xbps_dbg_printf("failed to remove delta: %s: %s\n",
+			    path, strerror(errno));
+	}
+out:
+	free(files);
+	closedir(dirp);
+}
+
+/*
+ * Writes a delta from the repodata identified by `from', which had the
+ * index `oldindex', to the repodata that was just written.
+ */
+static int
+delta_write(const char *repodir,
+		const char *arch,
+		const char *from,
+		xbps_dictionary_t oldindex,
+		xbps_dictionary_t index,
+		xbps_dictionary_t stage,
+		xbps_dictionary_t meta,
+		const char *compression)
+{
+	char to[XBPS_SHA256_SIZE];
+	char path[PATH_MAX];
+	char tmp[PATH_MAX];
+	struct archive *ar = NULL;
+	struct stat st;
+	xbps_dictionary_t delta = NULL;
+	mode_t prevumask;
+	int fd = -1;
+	int r;
+
+	r = snprintf(path, sizeof(path), "%s/%s-repodata", repodir, arch);
+	if (r < 0 || (size_t)r >= sizeof(path))
+		return -ENAMETOOLONG;
+	if (stat(path, &st) == -1)
+		return -errno;
+	r = xbps_repodata_id(path, to, sizeof(to));
+	if (r < 0)
+		return r;
+	if (strcmp(from, to) == 0)
+		return 0;
+
+	r = snprintf(path, sizeof(path), "%s/%s-repodata.%s.delta", repodir,
+	    arch, from);
+	if (r < 0 || (size_t)r >= sizeof(path))
+		return -ENAMETOOLONG;
+	r = snprintf(tmp, sizeof(tmp), "%s.XXXXXXX", path);
+	if (r < 0 || (size_t)r >= sizeof(tmp))
+		return -ENAMETOOLONG;
+
+	delta = delta_create(from, to, st.st_mtime, oldindex, index, stage,
+	    meta);
+	if (!delta)
+		return -errno;
+
+	prevumask = umask(S_IXUSR|S_IRWXG|S_IRWXO);
+	fd = mkstemp(tmp);
+	umask(prevumask);
+	if (fd == -1) {
+		r = -errno;
+		xbps_error_printf("failed to open temp file: %s: %s\n", tmp,
+		    strerror(-r));
+		xbps_object_release(delta);
+		return r;
+	}
+
+	ar = open_archive(fd, compression);
+	if (!ar) {
+		r = -errno;
+		goto err;
+	}
+	r = archive_dict(ar, XBPS_REPODATA_DELTA, delta, NULL);
+	if (r < 0)
+		goto err;
+	if (archive_write_close(ar) == ARCHIVE_FATAL) {
+		r = -xbps_archive_errno(ar);
+		xbps_error_printf("failed to close archive: %s\n",
+		    archive_error_string(ar));
+		goto err;
+	}
+	archive_write_free(ar);
+	ar = NULL;
+
+	if (fchmod(fd, 0664) == -1) {
+		r = -errno;
+		xbps_error_printf("failed to set mode: %s: %s\n",
+		   tmp, strerror(-r));
+		goto err;
+	}
+	close(fd);
+	fd = -1;
+
+	if (rename(tmp, path) == -1) {
+		r = -errno;
+		xbps_error_printf("failed to rename delta: %s: %s: %s\n",
+		   tmp, path, strerror(-r));
+		goto err;
+	}
+	xbps_object_release(delta);
+
+	/*
+	 * A delta from the current repodata would be from an older
+	 * generation, which would take clients back in time.
+	 */
+	if (snprintf(path, sizeof(path), "%s/%s-repodata.%s.delta", repodir,
+	    arch, to) < (int)sizeof(path))
+		(void)unlink(path);
+	delta_prune(repodir, arch);
+	return 0;
+
+err:
+	if (ar) {
+		archive_write_close(ar);
+		archive_write_free(ar);
+	}
+	if (fd != -1)
+		close(fd);
+	unlink(tmp);
+	xbps_object_release(delta);
+	return r;
+}
+
+int
+xbps_repodata_flush(const char *repodir,
+		const char *arch,
+		xbps_dictionary_t oldindex,
+		xbps_dictionary_t index,
+		xbps_dictionary_t stage,
+		xbps_dictionary_t meta,
+		const char *compression)
+{
+	char from[XBPS_SHA256_SIZE];
+	char path[PATH_MAX];
+	bool delta = false;
+	int r;
+
+	/*
+	 * Identify the repodata being replaced, to publish a delta
+	 * from it to the new repodata.
+	 */
+	if (oldindex) {
+		r = snprintf(path, sizeof(path), "%s/%s-repodata", repodir, arch);
+		if (r > 0 && (size_t)r < sizeof(path))
+			delta = xbps_repodata_id(path, from, sizeof(from)) == 0;
+	}
+
+	r = repodata_write(repodir, arch, index, stage, meta, compression);
+	if (r < 0 || !delta)
+		return r;
+
+	r = delta_write(repodir, arch, from, oldindex, index, stage, meta,
+	    compression);
+	if (r < 0) {
+		xbps_warn_printf("failed to write repodata delta: %s\n",
+		    strerror(-r));
+	}
+	return 0;
+}
@@ -134,6 +134,12 @@ xbps_repo_sync(struct xbps_handle *xhp, const char *uri)
 
 	/* reposync start cb */
 	xbps_set_cb_state(xhp, XBPS_STATE_REPOSYNC, 0, repodata, NULL);
+	/*
+	 * Bring the local copy up to date with the deltas published
+	 * by the repository, if the repository is still at the same
+	 * generation the following request does not transfer anything.
+	 */
+	xbps_repo_sync_delta(xhp, uri, arch);
 	/*
 	 * Download plist index file from repository.
 	 */
@@ -144,8 +150,10 @@ xbps_repo_sync(struct xbps_handle *xhp, const char *uri)
 		    fetchLastErrCode != 0 ? fetchLastErrCode : errno, NULL,
 		    "[reposync] failed to fetch file `%s': %s",
 		    repodata, fetchstr ? fetchstr : strerror(errno));
-	} else if (rv == 1)
+	} else if (rv == 1) {
+		xbps_repo_sync_delta_update(uri, arch);
 		rv = 0;
+	}
 	umask(prev_umask);
 
 	free(repodata);
@@ -24,12 +24,14 @@
  */
 
 #include <sys/utsname.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <libgen.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
 
 #include "xbps_api_impl.h"
 #include "fetch.h"
@@ -49,9 +51,46 @@ typedef enum {
 	REVDEPS_PKG
 } pkg_repo_type_t;
 
+struct rpool_open {
+	const char *uri;
+	struct xbps_repo *repo;
+};
+
+struct rpool_open_thread {
+	pthread_t thread;
+	struct xbps_handle *xhp;
+	struct rpool_open *repos;
+	unsigned int nrepos;
+	unsigned int *next;
+	pthread_mutex_t *next_lock;
+};
+
 static SIMPLEQ_HEAD(rpool_head, xbps_repo) rpool_queue =
     SIMPLEQ_HEAD_INITIALIZER(rpool_queue);
 
+/*
+ * Index of the package names in the pool: maps every package name to
+ * a bitmask of the repositories, in xhp->repositories order, that have
+ * a package by that name.  The map of virtual packages to the
+ * repositories with a provider is built on the first virtual package
+ * lookup, from the maps of virtual packages in the repositories or, for
+ * repositories without one, by looking into every package dictionary.
+ *
+ * The index is built on the first lookup and rebuilt whenever the list
+ * of repositories changed.  Pools with more than RPOOL_INDEX_MAX
+ * repositories are not indexed.
+ */
+#define RPOOL_INDEX_MAX	64
+
+static struct {
+	struct xbps_repo *repos[RPOOL_INDEX_MAX];
+	unsigned int nrepos;
+	xbps_dictionary_t names;
+	xbps_dictionary_t vpkgs;
+	/* repositories with providers that could not be indexed */
+	uint64_t vpkgs_any;
+} rpool_index;
+
 /**
  * @file lib/rpool.c
  * @brief Repository pool routines
@@ -120,11 +159,22 @@ xbps_rpool_get_repo(const char *url)
 	return NULL;
 }
 
+static void
+rpool_index_release(void)
+{
+	if (rpool_index.names)
+		xbps_object_release(rpool_index.names);
+	if (rpool_index.vpkgs)
+		xbps_object_release(rpool_index.vpkgs);
+	memset(&rpool_index, 0, sizeof(rpool_index));
+}
+
 void
 xbps_rpool_release(struct xbps_handle *xhp)
 {
 	struct xbps_repo *repo;
 
+	rpool_index_release();
 	while ((repo = SIMPLEQ_FIRST(&rpool_queue))) {
 	       SIMPLEQ_REMOVE(&rpool_queue, repo, xbps_repo, entries);
 	       xbps_repo_release(repo);
@@ -135,6 +185,107 @@ xbps_rpool_release(struct xbps_handle *xhp)
 	}
 }
 
+static void *
+rpool_open_thread(void *arg)
+{
+	struct rpool_open_thread *thd = arg;
+	unsigned int i;
+
+	for (;;) {
+		pthread_mutex_lock(thd->next_lock);
+		i = (*thd->next)++;
+		pthread_mutex_unlock(thd->next_lock);
+		if (i >= thd->nrepos)
+			break;
+		thd->repos[i].repo = xbps_repo_open(thd->xhp, thd->repos[i].uri);
+	}
+	return NULL;
+}
+
+/*
+ * Opens all registered repositories that are not in the pool yet, using
+ * up to one thread per CPU, and adds them to the pool in the order they
+ * were registered.  Repositories that cannot be opened are removed, as
+ * xbps_rpool_foreach() would do.
+ *
+ * Repositories read from the network are left to xbps_rpool_foreach(),
+ * libfetch is not thread safe.
+ */
+static void
+rpool_open_all(struct xbps_handle *xhp)
+{
+	struct rpool_open *repos;
+	struct rpool_open_thread *thd;
+	pthread_mutex_t next_lock = PTHREAD_MUTEX_INITIALIZER;
+	const char *repouri = NULL;
+	unsigned int i, nrepos = 0, next = 0;
+	int maxthreads, nthreads, r;
+
+	repos = calloc(xbps_array_count(xhp->repositories) + 1, sizeof(*repos));
+	if (!repos)
+		return;
+	for (i = 0; i < xbps_array_count(xhp->repositories); i++) {
+		xbps_array_get_cstring_nocopy(xhp->repositories, i, &repouri);
+		if (xbps_rpool_get_repo(repouri))
+			continue;
+		if ((xhp->flags & XBPS_FLAG_REPOS_MEMSYNC) &&
+		    xbps_repository_is_remote(repouri))
+			continue;
+		repos[nrepos++].uri = repouri;
+	}
+
+	maxthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (nrepos <= 1 || maxthreads <= 1) {
+		/* nothing to gain, leave it to xbps_rpool_foreach() */
+		free(repos);
+		return;
+	}
+	if ((unsigned int)maxthreads > nrepos)
+		maxthreads = nrepos;
+
+	thd = calloc(maxthreads, sizeof(*thd));
+	if (!thd) {
+		free(repos);
+		return;
+	}
+	for (nthreads = 0; nthreads < maxthreads; nthreads++) {
+		thd[nthreads].xhp = xhp;
+		thd[nthreads].repos = repos;
+		thd[nthreads].nrepos = nrepos;
+		thd[nthreads].next = &next;
+		thd[nthreads].next_lock = &next_lock;
+		r = -pthread_create(&thd[nthreads].thread, NULL,
+		    rpool_open_thread, &thd[nthreads]);
+		if (r < 0) {
+			xbps_dbg_printf("[rpool] failed to create thread: %s\n",
+			    strerror(-r));
+			break;
+		}
+	}
+	/* open what is left, or everything if no thread could be created */
+	if (nthreads == 0) {
+		struct rpool_open_thread self = {
+			.xhp = xhp, .repos = repos, .nrepos = nrepos,
+			.next = &next, .next_lock = &next_lock,
+		};
+		rpool_open_thread(&self);
+	}
+	for (int c = 0; c < nthreads; c++)
+		pthread_join(thd[c].thread, NULL);
+	pthread_mutex_destroy(&next_lock);
+	free(thd);
+
+	for (i = 0; i < nrepos; i++) {
+		if (!repos[i].repo) {
+			xbps_repo_remove(xhp, repos[i].uri);
+			continue;
+		}
+		SIMPLEQ_INSERT_TAIL(&rpool_queue, repos[i].repo, entries);
+		xbps_dbg_printf("[rpool] `%s' registered.\n", repos[i].uri);
+	}
+	free(repos);
+}
+
 int
 xbps_rpool_foreach(struct xbps_handle *xhp,
 	int (*fn)(struct xbps_repo *, void *, bool *),
@@ -148,6 +299,7 @@ xbps_rpool_foreach(struct xbps_handle *xhp,
 
 	assert(fn != NULL);
 
+	rpool_open_all(xhp);
 again:
 	for (unsigned int i = n; i < xbps_array_count(xhp->repositories); i++, n++) {
 		xbps_array_get_cstring_nocopy(xhp->repositories, i, &repouri);
@@ -172,6 +324,221 @@ again:
 	return rv;
 }
 
+static int
+rpool_open_cb(struct xbps_repo *repo UNUSED, void *arg UNUSED, bool *done UNUSED)
+{
+	return 0;
+}
+
+static bool
+rpool_index_add(xbps_dictionary_t d, const char *name, uint64_t bit)
+{
+	uint64_t mask = 0;
+
+	xbps_dictionary_get_uint64(d, name, &mask);
+	if (mask & bit)
+		return true;
+	return xbps_dictionary_set_uint64(d, name, mask | bit);
+}
+
+static bool
+rpool_index_valid(struct xbps_handle *xhp)
+{
+	const char *repouri = NULL;
+
+	if (!rpool_index.names ||
+	    rpool_index.nrepos != xbps_array_count(xhp->repositories))
+		return false;
+	for (unsigned int i = 0; i < rpool_index.nrepos; i++) {
+		xbps_array_get_cstring_nocopy(xhp->repositories, i, &repouri);
+		if (rpool_index.repos[i]->uri != repouri)
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Opens all repositories and indexes their package names.  Returns 0 on
+ * success, ENOTSUP if there are no repositories or -1 if the pool
+ * cannot be indexed.
+ */
+static int
+rpool_index_build(struct xbps_handle *xhp)
+{
+	xbps_object_iterator_t iter;
+	xbps_object_t obj;
+	struct xbps_repo *repo;
+	const char *repouri = NULL;
+	unsigned int nrepos;
+	int rv;
+
+	if (rpool_index_valid(xhp))
+		return 0;
+	rpool_index_release();
+
+	rv = xbps_rpool_foreach(xhp, rpool_open_cb, NULL);
+	if (rv != 0)
+		return rv;
+	nrepos = xbps_array_count(xhp->repositories);
+	if (nrepos > RPOOL_INDEX_MAX)
+		return -1;
+
+	rpool_index.names = xbps_dictionary_create();
+	if (!rpool_index.names)
+		return -1;
+	for (unsigned int i = 0; i < nrepos; i++) {
+		xbps_array_get_cstring_nocopy(xhp->repositories, i, &repouri);
+		if ((repo = xbps_rpool_get_repo(repouri)) == NULL)
+			goto err;
+		rpool_index.repos[i] = repo;
+
+		iter = xbps_dictionary_iterator(repo->idx);
+		if (!iter)
+			goto err;
+		while ((obj = xbps_object_iterator_next(iter))) {
+			if (!rpool_index_add(rpool_index.names,
+			    xbps_dictionary_keysym_cstring_nocopy(obj),
+			    UINT64_C(1) << i)) {
+				xbps_object_iterator_release(iter);
+				goto err;
+			}
+		}
+		xbps_object_iterator_release(iter);
+	}
+	rpool_index.nrepos = nrepos;
+	xbps_dbg_printf("[rpool] indexed %u packages in %u repositories\n",
+	    xbps_dictionary_count(rpool_index.names), nrepos);
+	return 0;
+err:
+	rpool_index_release();
+	return -1;
+}
+
+static bool
+rpool_index_build_vpkgs(void)
+{
+	xbps_object_iterator_t iter;
+	xbps_object_t obj;
+	xbps_dictionary_t pkgd;
+	xbps_array_t provides;
+	const char *vpkg;
+	char vpkgname[XBPS_NAME_SIZE];
+	uint64_t bit;
+
+	rpool_index.vpkgs = xbps_dictionary_create();
+	if (!rpool_index.vpkgs)
+		return false;
+	for (unsigned int i = 0; i < rpool_index.nrepos; i++) {
+		struct xbps_repo *repo = rpool_index.repos[i];
+
+		bit = UINT64_C(1) << i;
+		if (repo->provides && repo->idx == repo->index) {
+			/* the repository already has a map of virtual packages */
+			iter = xbps_dictionary_iterator(repo->provides);
+			if (!iter)
+				goto err;
+			while ((obj = xbps_object_iterator_next(iter))) {
+				if (!rpool_index_add(rpool_index.vpkgs,
+				    xbps_dictionary_keysym_cstring_nocopy(obj), bit)) {
+					xbps_object_iterator_release(iter);
+					goto err;
+				}
+			}
+			xbps_object_iterator_release(iter);
+			continue;
+		}
+		iter = xbps_dictionary_iterator(repo->idx);
+		if (!iter)
+			goto err;
+		while ((obj = xbps_object_iterator_next(iter))) {
+			pkgd = xbps_dictionary_get_keysym(repo->idx, obj);
+			provides = xbps_dictionary_get(pkgd, "provides");
+			for (unsigned int j = 0; j < xbps_array_count(provides); j++) {
+				vpkg = NULL;
+				xbps_array_get_cstring_nocopy(provides, j, &vpkg);
+				if (!vpkg || xbps_pkgpattern_version(vpkg) ||
+				    !xbps_pkg_name(vpkgname, sizeof(vpkgname), vpkg)) {
+					rpool_index.vpkgs_any |= bit;
+					continue;
+				}
+				if (!rpool_index_add(rpool_index.vpkgs, vpkgname, bit)) {
+					xbps_object_iterator_release(iter);
+					goto err;
+				}
+			}
+		}
+		xbps_object_iterator_release(iter);
+	}
+	return true;
+err:
+	xbps_object_release(rpool_index.vpkgs);
+	rpool_index.vpkgs = NULL;
+	rpool_index.vpkgs_any = 0;
+	return false;
+}
+
+/*
+ * Like xbps_rpool_foreach() but only calls `fn' for the repositories
+ * that have a package named like `pkg', or for `virtual' a provider of
+ * it.  Returns false if the lookup cannot be answered from the index.
+ */
+static bool
+rpool_index_foreach(struct xbps_handle *xhp, const char *pkg, bool virtual,
+	int (*fn)(struct xbps_repo *, void *, bool *), void *arg, int *rvp)
+{
+	char name[XBPS_NAME_SIZE];
+	uint64_t mask = 0;
+	bool done = false;
+	int rv;
+
+	if (virtual) {
+		if (!xbps_vpkg_name(name, sizeof(name), pkg))
+			return false;
+	} else if (xbps_pkgpattern_version(pkg)) {
+		if (!xbps_pkgpattern_name(name, sizeof(name), pkg) &&
+		    !xbps_pkg_name(name, sizeof(name), pkg))
+			return false;
+	} else if (xbps_pkg_version(pkg)) {
+		if (!xbps_pkg_name(name, sizeof(name), pkg))
+			return false;
+	} else if (xbps_strlcpy(name, pkg, sizeof(name)) >= sizeof(name)) {
+		return false;
+	}
+	/* virtual packages from configuration files can be anything */
+	if (virtual && vpkg_user_conf(xhp, pkg))
+		return false;
+	if (!virtual && xhp->vpkgd_conf && xbps_dictionary_get(xhp->vpkgd_conf, pkg))
+		return false;
+
+	rv = rpool_index_build(xhp);
+	if (rv < 0)
+		return false;
+	if (rv > 0) {
+		*rvp = rv;
+		return true;
+	}
+	if (virtual) {
+		if (!rpool_index.vpkgs && !rpool_index_build_vpkgs())
+			return false;
+		xbps_dictionary_get_uint64(rpool_index.vpkgs, name, &mask);
+		mask |= rpool_index.vpkgs_any;
+	} else {
+		xbps_dictionary_get_uint64(rpool_index.names, name, &mask);
+	}
+
+	for (unsigned int i = 0; i < rpool_index.nrepos && !done; i++) {
+		if ((mask & (UINT64_C(1) << i)) == 0)
+			continue;
+		rv = (*fn)(rpool_index.repos[i], arg, &done);
+		if (rv != 0) {
+			*rvp = rv;
+			return true;
+		}
+	}
+	*rvp = 0;
+	return true;
+}
+
 static int
 find_virtualpkg_cb(struct xbps_repo *repo, void *arg, bool *done)
 {
@@ -282,19 +649,22 @@ repo_find_pkg(struct xbps_handle *xhp,
 		/*
 		 * Find best pkg version.
 		 */
-		rv = xbps_rpool_foreach(xhp, find_best_pkg_cb, &rpf);
+		if (!rpool_index_foreach(xhp, pkg, false, find_best_pkg_cb, &rpf, &rv))
+			rv = xbps_rpool_foreach(xhp, find_best_pkg_cb, &rpf);
 		break;
 	case VIRTUAL_PKG:
 		/*
 		 * Find virtual pkg.
 		 */
-		rv = xbps_rpool_foreach(xhp, find_virtualpkg_cb, &rpf);
+		if (!rpool_index_foreach(xhp, pkg, true, find_virtualpkg_cb, &rpf, &rv))
+			rv = xbps_rpool_foreach(xhp, find_virtualpkg_cb, &rpf);
 		break;
 	case REAL_PKG:
 		/*
 		 * Find real pkg.
 		 */
-		rv = xbps_rpool_foreach(xhp, find_pkg_cb, &rpf);
+		if (!rpool_index_foreach(xhp, pkg, false, find_pkg_cb, &rpf, &rv))
+			rv = xbps_rpool_foreach(xhp, find_pkg_cb, &rpf);
 		break;
 	case REVDEPS_PKG:
 		/*
@@ -86,7 +86,7 @@ pkg_conflicts_trans(struct xbps_handle *xhp, xbps_array_t array,
 			 * If there's a pkg for the conflict in transaction,
 			 * ignore it.
 			 */
-			if ((tpkgd = xbps_find_pkg_in_array(array, pkgname, 0))) {
+			if ((tpkgd = xbps_transaction_find_pkg(xhp, array, pkgname, 0))) {
 				ttype = xbps_transaction_pkg_type(tpkgd);
 				if (ttype == XBPS_TRANS_INSTALL ||
 				    ttype == XBPS_TRANS_UPDATE ||
@@ -108,8 +108,8 @@ pkg_conflicts_trans(struct xbps_handle *xhp, xbps_array_t array,
 		/*
 		 * Check if current pkg conflicts with any pkg in transaction.
 		 */
-		if ((pkgd = xbps_find_pkg_in_array(array, cfpkg, 0)) ||
-		    (pkgd = xbps_find_virtualpkg_in_array(xhp, array, cfpkg, 0))) {
+		if ((pkgd = xbps_transaction_find_pkg(xhp, array, cfpkg, 0)) ||
+		    (pkgd = xbps_transaction_find_virtualpkg(xhp, array, cfpkg, 0))) {
 			/* ignore pkgs to be removed or on hold */
 			ttype = xbps_transaction_pkg_type(pkgd);
 			if (ttype == XBPS_TRANS_REMOVE || ttype == XBPS_TRANS_HOLD)
@@ -156,9 +156,8 @@ pkgdb_conflicts_cb(struct xbps_handle *xhp, xbps_object_t obj,
 	if (!xbps_dictionary_get_cstring_nocopy(obj, "pkgname", &repopkgname))
 		abort();
 
-	// XXX: this should really be a hashtable/dictionary lookup
 	/* if a pkg is in the transaction, ignore the one from pkgdb */
-	if (xbps_find_pkg_in_array(pkgs, repopkgname, 0))
+	if (xbps_transaction_find_pkg(xhp, pkgs, repopkgname, 0))
 		return 0;
 
 	trans_cflicts = xbps_dictionary_get(xhp->transd, "conflicts");
@@ -169,8 +168,8 @@ pkgdb_conflicts_cb(struct xbps_handle *xhp, xbps_object_t obj,
 		if (!xbps_array_get_cstring_nocopy(pkg_cflicts, i, &cfpkg))
 			abort();
 
-		if ((pkgd = xbps_find_pkg_in_array(pkgs, cfpkg, 0)) ||
-		    (pkgd = xbps_find_virtualpkg_in_array(xhp, pkgs, cfpkg, 0))) {
+		if ((pkgd = xbps_transaction_find_pkg(xhp, pkgs, cfpkg, 0)) ||
+		    (pkgd = xbps_transaction_find_virtualpkg(xhp, pkgs, cfpkg, 0))) {
 			/* ignore pkgs to be removed or on hold */
 			ttype = xbps_transaction_pkg_type(pkgd);
 			if (ttype == XBPS_TRANS_REMOVE || ttype == XBPS_TRANS_HOLD) {
@@ -200,6 +199,13 @@ pkgdb_conflicts_cb(struct xbps_handle *xhp, xbps_object_t obj,
 	return 0;
 }
 
+static int
+trans_conflicts_cb(struct xbps_handle *xhp, xbps_object_t obj,
+		const char *key UNUSED, void *arg, bool *done UNUSED)
+{
+	return pkg_conflicts_trans(xhp, arg, obj);
+}
+
 int HIDDEN
 xbps_transaction_check_conflicts(struct xbps_handle *xhp, xbps_array_t pkgs)
 {
@@ -207,11 +213,11 @@ xbps_transaction_check_conflicts(struct xbps_handle *xhp, xbps_array_t pkgs)
 	int r;
 
 	/* find conflicts in transaction */
-	for (unsigned int i = 0; i < xbps_array_count(pkgs); i++) {
-		r = pkg_conflicts_trans(xhp, pkgs, xbps_array_get(pkgs, i));
-		if (r < 0)
-			return r;
-	}
+	r = xbps_array_foreach_cb_multi(xhp, pkgs, NULL, trans_conflicts_cb, pkgs);
+	if (r < 0)
+		return r;
+	else if (r > 0)
+		return -r;
 
 	/* find conflicts in pkgdb */
 	r = xbps_pkgdb_foreach_cb_multi(xhp, pkgdb_conflicts_cb, pkgs);
@@ -221,8 +227,10 @@ xbps_transaction_check_conflicts(struct xbps_handle *xhp, xbps_array_t pkgs)
 		return -r;
 
 	array = xbps_dictionary_get(xhp->transd, "conflicts");
-	if (xbps_array_count(array) == 0)
+	if (xbps_array_count(array) == 0) {
 		xbps_dictionary_remove(xhp->transd, "conflicts");
-
-	return 0;
+		return 0;
+	}
+	/* the callbacks above add the conflicts in any order */
+	return xbps_array_sort_cstrings(array);
 }
@@ -85,7 +85,7 @@ xbps_transaction_check_replaces(struct xbps_handle *xhp, xbps_array_t pkgs)
 			 */
 			if (((instd = xbps_pkgdb_get_pkg(xhp, pattern)) == NULL) &&
 			    ((instd = xbps_pkgdb_get_virtualpkg(xhp, pattern)) == NULL) &&
-			    ((instd = xbps_find_pkg_in_array(pkgs, pattern, XBPS_TRANS_INSTALL)) == NULL))
+			    ((instd = xbps_transaction_find_pkg(xhp, pkgs, pattern, XBPS_TRANS_INSTALL)) == NULL))
 				continue;
 
 			if (!xbps_dictionary_get_cstring_nocopy(instd, "pkgver", &curpkgver)) {
@@ -111,7 +111,7 @@ xbps_transaction_check_replaces(struct xbps_handle *xhp, xbps_array_t pkgs)
 			 * Make sure to not add duplicates.
 			 */
 			xbps_dictionary_get_bool(instd, "automatic-install", &instd_auto);
-			reppkgd = xbps_find_pkg_in_array(pkgs, curpkgname, 0);
+			reppkgd = xbps_transaction_find_pkg(xhp, pkgs, curpkgname, 0);
 			if (reppkgd) {
 				ttype = xbps_transaction_pkg_type(reppkgd);
 				if (ttype == XBPS_TRANS_REMOVE || ttype == XBPS_TRANS_HOLD)
@@ -173,7 +173,7 @@ xbps_transaction_check_replaces(struct xbps_handle *xhp, xbps_array_t pkgs)
 				xbps_object_iterator_release(iter);
 				return false;
 			}
-			if (!xbps_array_add_first(pkgs, instd)) {
+			if (!xbps_transaction_add_pkg_first(xhp, pkgs, instd)) {
 				xbps_object_iterator_release(iter);
 				return false;
 			}
@@ -173,7 +173,7 @@ xbps_transaction_check_revdeps(struct xbps_handle *xhp, xbps_array_t pkgs)
 				goto out;
 			}
 
-			if ((revpkgd = xbps_find_pkg_in_array(pkgs, pkgname, 0))) {
+			if ((revpkgd = xbps_transaction_find_pkg(xhp, pkgs, pkgname, 0))) {
 				if (xbps_transaction_pkg_type(revpkgd) == XBPS_TRANS_REMOVE)
 					continue;
 			}
@@ -191,7 +191,7 @@ xbps_transaction_check_revdeps(struct xbps_handle *xhp, xbps_array_t pkgs)
 				if (xbps_dictionary_get(obj, "replaced")) {
 					continue;
 				}
-				if (xbps_find_pkg_in_array(pkgs, pkgname, XBPS_TRANS_REMOVE)) {
+				if (xbps_transaction_find_pkg(xhp, pkgs, pkgname, XBPS_TRANS_REMOVE)) {
 					continue;
 				}
 				broken_pkg(mdeps, curpkgver, pkgver);
@@ -240,7 +240,7 @@ xbps_transaction_check_revdeps(struct xbps_handle *xhp, xbps_array_t pkgs)
 			 * if a new version of this conflicting package
 			 * is in the transaction.
 			 */
-			if (xbps_find_pkg_in_array(pkgs, pkgname, XBPS_TRANS_UPDATE)) {
+			if (xbps_transaction_find_pkg(xhp, pkgs, pkgname, XBPS_TRANS_UPDATE)) {
 				continue;
 			}
 			broken_pkg(mdeps, curpkgver, pkgver);
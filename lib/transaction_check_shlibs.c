@@ -181,11 +181,40 @@ collect_shlibs(struct shlib_ctx *ctx, xbps_array_t pkgs)
 }
 
 static int
-check_shlibs(struct shlib_ctx *ctx, xbps_array_t pkgs)
+pkgdb_shlibs_cb(struct xbps_handle *xhp UNUSED, xbps_object_t obj,
+		const char *pkgname, void *arg, bool *done UNUSED)
 {
-	xbps_object_iterator_t iter;
-	xbps_object_t obj;
+	struct shlib_ctx *ctx = arg;
+	xbps_array_t array;
+	const char *pkgver = NULL;
+
+	if (xbps_dictionary_get(ctx->seen, pkgname))
+		return 0;
 
+	array = xbps_dictionary_get(obj, "shlib-requires");
+	for (unsigned int i = 0; i < xbps_array_count(array); i++) {
+		const char *shlib = NULL;
+		char *missing;
+		if (!xbps_array_get_cstring_nocopy(array, i, &shlib))
+			return -EINVAL;
+		if (shlib_entry_find(ctx->entries, shlib))
+			continue;
+		if (!xbps_dictionary_get_cstring_nocopy(obj, "pkgver", &pkgver))
+			return -EINVAL;
+		missing = xbps_xasprintf(
+		    "%s: broken, unresolvable shlib `%s'", pkgver,
+		    shlib);
+		if (!xbps_array_add_cstring_nocopy(ctx->missing, missing)) {
+			xbps_error_printf("out of memory\n");
+			return -ENOMEM;
+		}
+	}
+	return 0;
+}
+
+static int
+check_shlibs(struct shlib_ctx *ctx, xbps_array_t pkgs)
+{
 	for (unsigned int i = 0; i < xbps_array_count(pkgs); i++) {
 		xbps_array_t array;
 		xbps_dictionary_t pkgd = xbps_array_get(pkgs, i);
@@ -217,52 +246,8 @@ check_shlibs(struct shlib_ctx *ctx, xbps_array_t pkgs)
 		}
 	}
 
-	iter = xbps_dictionary_iterator(ctx->xhp->pkgdb);
-	if (!iter) {
-		xbps_error_printf("out of memory\n");
-		return -ENOMEM;
-	}
-
-	while ((obj = xbps_object_iterator_next(iter))) {
-		xbps_array_t array;
-		xbps_dictionary_t pkgd;
-		const char *pkgname = NULL;
-
-		pkgname = xbps_dictionary_keysym_cstring_nocopy(obj);
-		/* ignore internal objs */
-		if (strncmp(pkgname, "_XBPS_", 6) == 0)
-			continue;
-
-		pkgd  = xbps_dictionary_get_keysym(ctx->xhp->pkgdb, obj);
-
-		if (xbps_dictionary_get(ctx->seen, pkgname))
-			continue;
-
-		array = xbps_dictionary_get(pkgd, "shlib-requires");
-		if (!array)
-			continue;
-		for (unsigned int i = 0; i < xbps_array_count(array); i++) {
-			const char *pkgver = NULL;
-			const char *shlib = NULL;
-			char *missing;
-			if (!xbps_array_get_cstring_nocopy(array, i, &shlib))
-				return -EINVAL;
-			if (shlib_entry_find(ctx->entries, shlib))
-				continue;
-			if (!xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver))
-				return -EINVAL;
-			missing = xbps_xasprintf(
-			    "%s: broken, unresolvable shlib `%s'", pkgver,
-			    shlib);
-			if (!xbps_array_add_cstring_nocopy(ctx->missing, missing)) {
-				xbps_error_printf("out of memory\n");
-				return -ENOMEM;
-			}
-		}
-	}
-
-	xbps_object_iterator_release(iter);
-	return 0;
+	/* the pkgdb is only read, check its packages in parallel */
+	return xbps_pkgdb_foreach_cb_multi(ctx->xhp, pkgdb_shlibs_cb, ctx);
 }
 
 bool HIDDEN
@@ -284,6 +269,9 @@ xbps_transaction_check_shlibs(struct xbps_handle *xhp, xbps_array_t pkgs)
 
 	if (xbps_array_count(ctx.missing) == 0)
 		xbps_dictionary_remove(xhp->transd, "missing_shlibs");
+	/* the pkgdb callbacks add the missing shlibs in any order */
+	else if ((r = xbps_array_sort_cstrings(ctx.missing)) < 0)
+		goto err;
 
 	r = 0;
 err:
@@ -108,8 +108,8 @@ xbps_transaction_commit(struct xbps_handle *xhp)
 	xbps_object_iterator_t iter;
 	xbps_trans_type_t ttype;
 	const char *pkgver = NULL, *pkgname = NULL;
-	int rv = 0;
-	bool update, replaced;
+	int rv = 0, r;
+	bool update, replaced, journaled = false;
 
 	setlocale(LC_ALL, "");
 
@@ -304,6 +304,17 @@ xbps_transaction_commit(struct xbps_handle *xhp)
 	}
 	xbps_object_iterator_reset(iter);
 
+	/*
+	 * Journal the changes made to the pkgdb while packages are removed,
+	 * unpacked and registered; it is compacted into the pkgdb at the end.
+	 */
+	if ((rv = xbps_pkgdb_journal_begin(xhp)) != 0) {
+		xbps_dbg_printf("[trans] cannot journal pkgdb: %s\n",
+		    strerror(-rv));
+		rv = 0;
+	} else {
+		journaled = true;
+	}
 
 	while ((obj = xbps_object_iterator_next(iter)) != NULL) {
 		xbps_dictionary_get_cstring_nocopy(obj, "pkgver", &pkgver);
@@ -391,8 +402,8 @@ xbps_transaction_commit(struct xbps_handle *xhp)
 	}
 
 	xbps_object_iterator_reset(iter);
-	/* Force a pkgdb write for all unpacked pkgs in transaction */
-	if ((rv = xbps_pkgdb_update(xhp, true, true)) != 0)
+	/* Make the state of all unpacked pkgs in transaction durable */
+	if ((rv = xbps_pkgdb_journal_sync(xhp)) != 0)
 		goto out;
 
 	/*
@@ -446,6 +457,15 @@ out:
 	if (rv == 0) {
 		/* Force a pkgdb write for all unpacked pkgs in transaction */
 		rv = xbps_pkgdb_update(xhp, true, true);
+	} else if (journaled) {
+		/*
+		 * Compact the journal into the pkgdb, so that it records
+		 * the state of the packages changed before the failure.
+		 */
+		if ((r = xbps_pkgdb_update(xhp, true, true)) != 0) {
+			xbps_dbg_printf("[trans] failed to write pkgdb: %s\n",
+			    strerror(r));
+		}
 	}
 	return rv;
 }
@@ -185,7 +185,7 @@ trans_find_pkg(struct xbps_handle *xhp, const char *pkg, bool force)
 	 * in transaction, in that case ignore it.
 	 */
 	if (ttype == XBPS_TRANS_UPDATE) {
-		if (xbps_find_pkg_in_array(pkgs, repopkgver, 0)) {
+		if (xbps_transaction_find_pkg(xhp, pkgs, repopkgver, 0)) {
 			xbps_dbg_printf("[update] `%s' already queued in "
 			    "transaction.\n", repopkgver);
 			return EEXIST;
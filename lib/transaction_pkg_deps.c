@@ -106,6 +106,103 @@ out:
 	return rv;
 }
 
+/*
+ * Dependencies already resolved in the transaction, by pattern, are
+ * kept in the "deps_cache" dictionary of the transaction dictionary
+ * with the decision taken and the package that resolved them, so that
+ * the same pattern is not looked up in the pkgdb and the repository
+ * pool again for every package depending on it.  The packages in the
+ * transaction change meanwhile, so the decisions are checked against
+ * them again by deps_cache_get().
+ */
+enum dep_decision {
+	DEP_UNRESOLVED = 0,
+	DEP_SATISFIED,		/* installed package satisfies it */
+	DEP_QUEUED,		/* package in the transaction satisfies it */
+	DEP_MISSING,		/* added into the missing deps array */
+};
+
+static void
+deps_cache_set(struct xbps_handle *xhp, const char *reqpkg,
+		enum dep_decision decision, xbps_dictionary_t provider)
+{
+	xbps_dictionary_t cache, entry;
+
+	if ((cache = xbps_dictionary_get(xhp->transd, "deps_cache")) == NULL)
+		return;
+	if ((entry = xbps_dictionary_create()) == NULL)
+		return;
+	if (xbps_dictionary_set_uint8(entry, "decision", decision) &&
+	    (provider == NULL || xbps_dictionary_set(entry, "provider", provider)))
+		xbps_dictionary_set(cache, reqpkg, entry);
+	xbps_object_release(entry);
+}
+
+/*
+ * Records the package in the transaction that satisfies `reqpkg', as
+ * found by pass 3 of repo_deps().
+ */
+static void
+deps_cache_set_queued(struct xbps_handle *xhp, xbps_array_t pkgs,
+		const char *reqpkg)
+{
+	xbps_dictionary_t pkgd;
+	xbps_trans_type_t ttype;
+
+	if ((pkgd = xbps_transaction_find_pkg(xhp, pkgs, reqpkg, 0)) == NULL &&
+	    (pkgd = xbps_transaction_find_virtualpkg(xhp, pkgs, reqpkg, 0)) == NULL)
+		return;
+	ttype = xbps_transaction_pkg_type(pkgd);
+	if (ttype == XBPS_TRANS_REMOVE || ttype == XBPS_TRANS_HOLD)
+		return;
+	deps_cache_set(xhp, reqpkg, DEP_QUEUED, pkgd);
+}
+
+static enum dep_decision
+deps_cache_get(struct xbps_handle *xhp, xbps_array_t pkgs, const char *reqpkg,
+		xbps_dictionary_t *providerp)
+{
+	xbps_dictionary_t cache, entry, provider, pkgd;
+	xbps_trans_type_t ttype;
+	const char *pkgname = NULL;
+	uint8_t decision = DEP_UNRESOLVED;
+
+	cache = xbps_dictionary_get(xhp->transd, "deps_cache");
+	if ((entry = xbps_dictionary_get(cache, reqpkg)) == NULL)
+		return DEP_UNRESOLVED;
+	xbps_dictionary_get_uint8(entry, "decision", &decision);
+	provider = xbps_dictionary_get(entry, "provider");
+	if (decision != DEP_QUEUED) {
+		/*
+		 * The decision was taken because no package in the
+		 * transaction satisfied it, one added since then takes
+		 * precedence as in pass 3 of repo_deps().
+		 */
+		if ((pkgd = xbps_transaction_find_pkg(xhp, pkgs, reqpkg, 0)) ||
+		    (pkgd = xbps_transaction_find_virtualpkg(xhp, pkgs, reqpkg, 0))) {
+			ttype = xbps_transaction_pkg_type(pkgd);
+			if (ttype != XBPS_TRANS_REMOVE && ttype != XBPS_TRANS_HOLD) {
+				xbps_dictionary_remove(cache, reqpkg);
+				return DEP_UNRESOLVED;
+			}
+		}
+	} else {
+		/*
+		 * Packages in the transaction can be replaced by a newer
+		 * version, make sure the provider is still there.
+		 */
+		ttype = xbps_transaction_pkg_type(provider);
+		if (!xbps_dictionary_get_cstring_nocopy(provider, "pkgname", &pkgname) ||
+		    xbps_transaction_find_pkg(xhp, pkgs, pkgname, 0) != provider ||
+		    ttype == XBPS_TRANS_REMOVE || ttype == XBPS_TRANS_HOLD) {
+			xbps_dictionary_remove(cache, reqpkg);
+			return DEP_UNRESOLVED;
+		}
+	}
+	*providerp = provider;
+	return decision;
+}
+
 #define MAX_DEPTH	512
 
 static int
@@ -193,16 +290,37 @@ repo_deps(struct xbps_handle *xhp,
 			xbps_dbg_printf_append(" (%s queued %d)\n", pkgver_q, ttype_q);
 			continue;
 		}
+		/*
+		 * Check if the same dependency pattern was already resolved.
+		 */
+		curpkgd = NULL;
+		switch (deps_cache_get(xhp, pkgs, reqpkg, &curpkgd)) {
+		case DEP_SATISFIED:
+			xbps_dictionary_get_cstring_nocopy(curpkgd, "pkgver", &pkgver_q);
+			xbps_dbg_printf_append("installed `%s' (cached).\n", pkgver_q);
+			continue;
+		case DEP_QUEUED:
+			xbps_dictionary_get_cstring_nocopy(curpkgd, "pkgver", &pkgver_q);
+			xbps_dbg_printf_append(" (%s queued %d, cached)\n", pkgver_q,
+			    xbps_transaction_pkg_type(curpkgd));
+			continue;
+		case DEP_MISSING:
+			xbps_dbg_printf_append("missing (cached).\n");
+			continue;
+		case DEP_UNRESOLVED:
+			break;
+		}
 		/*
 		 * Pass 3: check if required dependency has been already added
 		 * in the transaction dictionary.
 		 */
-		if ((curpkgd = xbps_find_pkg_in_array(pkgs, reqpkg, 0)) ||
-		    (curpkgd = xbps_find_virtualpkg_in_array(xhp, pkgs, reqpkg, 0))) {
+		if ((curpkgd = xbps_transaction_find_pkg(xhp, pkgs, reqpkg, 0)) ||
+		    (curpkgd = xbps_transaction_find_virtualpkg(xhp, pkgs, reqpkg, 0))) {
 			xbps_trans_type_t ttype_q = xbps_transaction_pkg_type(curpkgd);
 			xbps_dictionary_get_cstring_nocopy(curpkgd, "pkgver", &pkgver_q);
 			if (ttype_q != XBPS_TRANS_REMOVE && ttype_q != XBPS_TRANS_HOLD) {
 				xbps_dbg_printf_append(" (%s queued %d)\n", pkgver_q, ttype_q);
+				deps_cache_set(xhp, reqpkg, DEP_QUEUED, curpkgd);
 				continue;
 			}
 		}
@@ -254,6 +372,7 @@ repo_deps(struct xbps_handle *xhp,
 				 * by an installed package.
 				 */
 				xbps_dbg_printf_append("[virtual] satisfied by `%s'.\n", pkgver_q);
+				deps_cache_set(xhp, reqpkg, DEP_SATISFIED, curpkgd);
 				continue;
 			}
 			rv = xbps_pkgpattern_match(pkgver_q, reqpkg);
@@ -298,11 +417,11 @@ repo_deps(struct xbps_handle *xhp,
 					} else if (rv == EEXIST) {
 						xbps_dbg_printf("`%s' missing dep already added.\n", reqpkg);
 						rv = 0;
-						continue;
 					} else {
 						xbps_dbg_printf("`%s' added into the missing deps array.\n", reqpkg);
-						continue;
 					}
+					deps_cache_set(xhp, reqpkg, DEP_MISSING, NULL);
+					continue;
 				}
 			} else if (rv == 1) {
 				/*
@@ -322,6 +441,7 @@ repo_deps(struct xbps_handle *xhp,
 					 * skip to next one.
 					 */
 					xbps_dbg_printf_append("installed `%s'.\n", pkgver_q);
+					deps_cache_set(xhp, reqpkg, DEP_SATISFIED, curpkgd);
 					continue;
 				}
 			} else {
@@ -350,6 +470,7 @@ repo_deps(struct xbps_handle *xhp,
 				xbps_dbg_printf("xbps_transaction_store failed for `%s': %s\n", reqpkg, strerror(rv));
 				break;
 			}
+			deps_cache_set_queued(xhp, pkgs, reqpkg);
 			continue;
 		}
 		/*
@@ -387,11 +508,11 @@ repo_deps(struct xbps_handle *xhp,
 			} else if (rv == EEXIST) {
 				xbps_dbg_printf("`%s' missing dep already added.\n", reqpkg);
 				rv = 0;
-				continue;
 			} else {
 				xbps_dbg_printf("`%s' added into the missing deps array.\n", reqpkg);
-				continue;
 			}
+			deps_cache_set(xhp, reqpkg, DEP_MISSING, NULL);
+			continue;
 		}
 
 
@@ -430,7 +551,7 @@ repo_deps(struct xbps_handle *xhp,
 					 * So dependency pattern matching didn't
 					 * succeed... return ENODEV.
 					 */
-					if (xbps_find_pkg_in_array(pkgs, pkgname, XBPS_TRANS_UPDATE)) {
+					if (xbps_transaction_find_pkg(xhp, pkgs, pkgname, XBPS_TRANS_UPDATE)) {
 						error = true;
 						rv = ENODEV;
 					}
@@ -487,6 +608,7 @@ repo_deps(struct xbps_handle *xhp,
 			xbps_dbg_printf("xbps_transaction_store failed for `%s': %s\n", reqpkg, strerror(rv));
 			break;
 		}
+		deps_cache_set_queued(xhp, pkgs, reqpkg);
 	}
 	xbps_object_iterator_release(iter);
 out:
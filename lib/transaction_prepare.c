@@ -28,6 +28,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
 #include <sys/statvfs.h>
 
 #include "xbps_api_impl.h"
@@ -211,6 +213,23 @@ xbps_transaction_init(struct xbps_handle *xhp)
 		return EINVAL;
 	}
 	xbps_object_release(array);
+	if (xbps_transaction_index_pkgs(xhp) != 0) {
+		xbps_object_release(xhp->transd);
+		xhp->transd = NULL;
+		return ENOMEM;
+	}
+
+	if ((dict = xbps_dictionary_create()) == NULL) {
+		xbps_object_release(xhp->transd);
+		xhp->transd = NULL;
+		return xbps_error_oom();
+	}
+	if (!xbps_dictionary_set(xhp->transd, "deps_cache", dict)) {
+		xbps_object_release(xhp->transd);
+		xhp->transd = NULL;
+		return xbps_error_oom();
+	}
+	xbps_object_release(dict);
 
 	if ((array = xbps_array_create()) == NULL) {
 		xbps_object_release(xhp->transd);
@@ -275,15 +294,107 @@ xbps_transaction_init(struct xbps_handle *xhp)
 	return 0;
 }
 
-int
-xbps_transaction_prepare(struct xbps_handle *xhp)
+static int
+check_revdeps(struct xbps_handle *xhp, xbps_array_t pkgs)
+{
+	return xbps_transaction_check_revdeps(xhp, pkgs) ? 0 : -EINVAL;
+}
+
+static int
+check_shlibs(struct xbps_handle *xhp, xbps_array_t pkgs)
+{
+	return xbps_transaction_check_shlibs(xhp, pkgs) ? 0 : -EINVAL;
+}
+
+struct check_thread {
+	pthread_t thread;
+	struct xbps_handle *xhp;
+	xbps_array_t pkgs;
+	int (*fn)(struct xbps_handle *, xbps_array_t);
+	int r;
+	bool started;
+};
+
+static void *
+check_thread(void *arg)
+{
+	struct check_thread *thd = arg;
+
+	thd->r = (*thd->fn)(thd->xhp, thd->pkgs);
+	return NULL;
+}
+
+/*
+ * Runs the reverse dependencies, conflicts and shared libraries checks.
+ * They only read the pkgdb and the packages in the transaction and each
+ * one stores its results in its own array of the transaction dictionary,
+ * so they are run concurrently.
+ */
+static int
+run_checks(struct xbps_handle *xhp, xbps_array_t pkgs, int *rrevdeps,
+		int *rconflicts, int *rshlibs)
+{
+	struct check_thread thd[] = {
+		{ .xhp = xhp, .pkgs = pkgs, .fn = check_revdeps },
+		{ .xhp = xhp, .pkgs = pkgs, .fn = xbps_transaction_check_conflicts },
+		{ .xhp = xhp, .pkgs = pkgs, .fn = check_shlibs },
+	};
+	bool threads = sysconf(_SC_NPROCESSORS_ONLN) > 1;
+	int error = 0;
+
+	for (unsigned int i = 0; threads && i < __arraycount(thd); i++) {
+		int r = pthread_create(&thd[i].thread, NULL, check_thread, &thd[i]);
+		if (r != 0) {
+			xbps_dbg_printf("%s: failed to create thread: %s\n",
+			    __func__, strerror(r));
+			break;
+		}
+		thd[i].started = true;
+	}
+	for (unsigned int i = 0; i < __arraycount(thd); i++) {
+		int r;
+
+		if (!thd[i].started) {
+			check_thread(&thd[i]);
+			continue;
+		}
+		if ((r = pthread_join(thd[i].thread, NULL)) != 0) {
+			xbps_error_printf("failed to wait on thread: %s\n",
+			    strerror(r));
+			error++;
+		}
+	}
+	if (error != 0)
+		return -EAGAIN;
+
+	*rrevdeps = thd[0].r;
+	*rconflicts = thd[1].r;
+	*rshlibs = thd[2].r;
+	return 0;
+}
+
+/*
+ * Removes the lookup tables only used while the transaction is being
+ * prepared from the transaction dictionary.
+ */
+static void
+transaction_prepare_done(struct xbps_handle *xhp)
+{
+	if (xhp->transd == NULL)
+		return;
+	xbps_dictionary_remove(xhp->transd, "packages_index");
+	xbps_dictionary_remove(xhp->transd, "deps_cache");
+}
+
+static int
+transaction_prepare(struct xbps_handle *xhp)
 {
 	xbps_array_t pkgs, edges;
 	xbps_dictionary_t tpkgd;
 	xbps_trans_type_t ttype;
 	unsigned int i, cnt;
 	int rv = 0;
-	int r;
+	int r, rrevdeps, rconflicts, rshlibs;
 	bool all_on_hold = true;
 
 	if ((rv = xbps_transaction_init(xhp)) != 0)
@@ -339,6 +450,9 @@ xbps_transaction_prepare(struct xbps_handle *xhp)
 		xbps_remove_pkg_from_array_by_pkgver(pkgs, pkgver);
 	}
 	xbps_object_release(edges);
+	/* the edges have been moved, update the order of providers */
+	if ((rv = xbps_transaction_index_pkgs(xhp)) != 0)
+		return -rv;
 
 	/*
 	 * Do not perform any checks if XBPS_FLAG_DOWNLOAD_ONLY
@@ -372,13 +486,17 @@ xbps_transaction_prepare(struct xbps_handle *xhp)
 		return EINVAL;
 	}
 	/*
-	 * Check if there are missing revdeps.
+	 * Check for missing revdeps, package conflicts and unresolved
+	 * shared libraries.
 	 */
-	xbps_dbg_printf("%s: checking revdeps\n", __func__);
-	if (!xbps_transaction_check_revdeps(xhp, pkgs)) {
+	xbps_dbg_printf("%s: checking revdeps, conflicts and shlibs\n", __func__);
+	r = run_checks(xhp, pkgs, &rrevdeps, &rconflicts, &rshlibs);
+	if (r == 0)
+		r = rrevdeps < 0 ? rrevdeps : rconflicts < 0 ? rconflicts : rshlibs;
+	if (r < 0) {
 		xbps_object_release(xhp->transd);
 		xhp->transd = NULL;
-		return EINVAL;
+		return -r;
 	}
 	if (xbps_dictionary_get(xhp->transd, "missing_deps")) {
 		if (xhp->flags & XBPS_FLAG_FORCE_REMOVE_REVDEPS) {
@@ -387,28 +505,9 @@ xbps_transaction_prepare(struct xbps_handle *xhp)
 			return ENODEV;
 		}
 	}
-	/*
-	 * Check for package conflicts.
-	 */
-	xbps_dbg_printf("%s: checking conflicts\n", __func__);
-	r = xbps_transaction_check_conflicts(xhp, pkgs);
-	if (r < 0) {
-		xbps_object_release(xhp->transd);
-		xhp->transd = NULL;
-		return -r;
-	}
 	if (xbps_dictionary_get(xhp->transd, "conflicts")) {
 		return EAGAIN;
 	}
-	/*
-	 * Check for unresolved shared libraries.
-	 */
-	xbps_dbg_printf("%s: checking shlibs\n", __func__);
-	if (!xbps_transaction_check_shlibs(xhp, pkgs)) {
-		xbps_object_release(xhp->transd);
-		xhp->transd = NULL;
-		return EINVAL;
-	}
 	if (xbps_dictionary_get(xhp->transd, "missing_shlibs")) {
 		if (xhp->flags & XBPS_FLAG_FORCE_REMOVE_REVDEPS) {
 			xbps_dbg_printf("[trans] continuing with unresolved shared libraries!");
@@ -417,6 +516,7 @@ xbps_transaction_prepare(struct xbps_handle *xhp)
 		}
 	}
 out:
+	transaction_prepare_done(xhp);
 	/*
 	 * Add transaction stats for total download/installed size,
 	 * number of packages to be installed, updated, configured
@@ -433,3 +533,14 @@ out:
 
 	return 0;
 }
+
+int
+xbps_transaction_prepare(struct xbps_handle *xhp)
+{
+	int rv;
+
+	/* the transaction dictionary is kept when a check fails */
+	if ((rv = transaction_prepare(xhp)) != 0)
+		transaction_prepare_done(xhp);
+	return rv;
+}
@@ -30,11 +30,248 @@
 
 #include "xbps_api_impl.h"
 
+/*
+ * The packages in the transaction are indexed in the "packages_index"
+ * dictionary of the transaction dictionary, to look them up without
+ * matching every package in the "packages" array:
+ *
+ * 	- "names": pkgname -> package dictionary.
+ * 	- "vpkgs": virtual pkgname -> array of the package dictionaries
+ * 	  providing it, in the order they appear in "packages".
+ *
+ * The index is maintained by xbps_transaction_store() and the functions
+ * below, every other change to "packages" has to be followed by
+ * xbps_transaction_index_pkgs().
+ */
+static xbps_dictionary_t
+pkgs_index(struct xbps_handle *xhp, xbps_array_t pkgs)
+{
+	if (xhp->transd == NULL ||
+	    xbps_dictionary_get(xhp->transd, "packages") != pkgs)
+		return NULL;
+	return xbps_dictionary_get(xhp->transd, "packages_index");
+}
+
+static bool
+pkgs_index_add(xbps_dictionary_t idx, xbps_dictionary_t pkgd, bool first)
+{
+	xbps_dictionary_t names, vpkgs;
+	xbps_array_t provides;
+	const char *pkgver = NULL;
+	char pkgname[XBPS_NAME_SIZE];
+
+	names = xbps_dictionary_get(idx, "names");
+	vpkgs = xbps_dictionary_get(idx, "vpkgs");
+
+	if (!xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver) ||
+	    !xbps_pkg_name(pkgname, sizeof(pkgname), pkgver))
+		return false;
+	/* the first package in the array wins, as with a linear search */
+	if ((first || !xbps_dictionary_get(names, pkgname)) &&
+	    !xbps_dictionary_set(names, pkgname, pkgd))
+		return false;
+
+	provides = xbps_dictionary_get(pkgd, "provides");
+	for (unsigned int i = 0; i < xbps_array_count(provides); i++) {
+		xbps_array_t providers;
+		const char *vpkg = NULL;
+		char vpkgname[XBPS_NAME_SIZE];
+		bool ok;
+
+		if (!xbps_array_get_cstring_nocopy(provides, i, &vpkg) ||
+		    !xbps_vpkg_name(vpkgname, sizeof(vpkgname), vpkg))
+			continue;
+		if ((providers = xbps_dictionary_get(vpkgs, vpkgname)) == NULL) {
+			if ((providers = xbps_array_create()) == NULL)
+				return false;
+			ok = xbps_dictionary_set(vpkgs, vpkgname, providers);
+			xbps_object_release(providers);
+			if (!ok)
+				return false;
+		}
+		ok = first ? xbps_array_add_first(providers, pkgd) :
+		    xbps_array_add(providers, pkgd);
+		if (!ok)
+			return false;
+	}
+	return true;
+}
+
+static void
+pkgs_index_del(xbps_dictionary_t idx, xbps_dictionary_t pkgd)
+{
+	xbps_dictionary_t names, vpkgs;
+	xbps_array_t provides;
+	const char *pkgver = NULL;
+	char pkgname[XBPS_NAME_SIZE];
+
+	names = xbps_dictionary_get(idx, "names");
+	vpkgs = xbps_dictionary_get(idx, "vpkgs");
+
+	if (xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver) &&
+	    xbps_pkg_name(pkgname, sizeof(pkgname), pkgver) &&
+	    xbps_dictionary_get(names, pkgname) == pkgd)
+		xbps_dictionary_remove(names, pkgname);
+
+	provides = xbps_dictionary_get(pkgd, "provides");
+	for (unsigned int i = 0; i < xbps_array_count(provides); i++) {
+		xbps_array_t providers;
+		const char *vpkg = NULL;
+		char vpkgname[XBPS_NAME_SIZE];
+
+		if (!xbps_array_get_cstring_nocopy(provides, i, &vpkg) ||
+		    !xbps_vpkg_name(vpkgname, sizeof(vpkgname), vpkg))
+			continue;
+		if ((providers = xbps_dictionary_get(vpkgs, vpkgname)) == NULL)
+			continue;
+		for (unsigned int j = 0; j < xbps_array_count(providers); j++) {
+			if (xbps_array_get(providers, j) == pkgd) {
+				xbps_array_remove(providers, j);
+				break;
+			}
+		}
+		if (xbps_array_count(providers) == 0)
+			xbps_dictionary_remove(vpkgs, vpkgname);
+	}
+}
+
+/*
+ * Creates the index of the packages in the transaction from scratch.
+ */
+int HIDDEN
+xbps_transaction_index_pkgs(struct xbps_handle *xhp)
+{
+	xbps_dictionary_t idx, names, vpkgs;
+	xbps_array_t pkgs;
+	bool ok;
+
+	pkgs = xbps_dictionary_get(xhp->transd, "packages");
+	idx = xbps_dictionary_create();
+	names = xbps_dictionary_create();
+	vpkgs = xbps_dictionary_create();
+	ok = idx && names && vpkgs &&
+	    xbps_dictionary_set(idx, "names", names) &&
+	    xbps_dictionary_set(idx, "vpkgs", vpkgs);
+	if (names)
+		xbps_object_release(names);
+	if (vpkgs)
+		xbps_object_release(vpkgs);
+	for (unsigned int i = 0; ok && i < xbps_array_count(pkgs); i++)
+		ok = pkgs_index_add(idx, xbps_array_get(pkgs, i), false);
+	ok = ok && xbps_dictionary_set(xhp->transd, "packages_index", idx);
+	if (idx)
+		xbps_object_release(idx);
+	if (!ok) {
+		xbps_dictionary_remove(xhp->transd, "packages_index");
+		return xbps_error_oom();
+	}
+	return 0;
+}
+
+/*
+ * Adds `pkgd' to the head of the packages in the transaction.
+ */
+bool HIDDEN
+xbps_transaction_add_pkg_first(struct xbps_handle *xhp, xbps_array_t pkgs,
+		xbps_dictionary_t pkgd)
+{
+	xbps_dictionary_t idx;
+
+	if (!xbps_array_add_first(pkgs, pkgd))
+		return false;
+	if ((idx = pkgs_index(xhp, pkgs)) && !pkgs_index_add(idx, pkgd, true)) {
+		xbps_dictionary_remove(xhp->transd, "packages_index");
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Same as xbps_find_pkg_in_array() for the packages in the transaction.
+ */
+xbps_dictionary_t HIDDEN
+xbps_transaction_find_pkg(struct xbps_handle *xhp, xbps_array_t pkgs,
+		const char *pkg, xbps_trans_type_t tt)
+{
+	xbps_dictionary_t idx, pkgd;
+	const char *pkgver = NULL;
+	char pkgname[XBPS_NAME_SIZE];
+
+	if ((idx = pkgs_index(xhp, pkgs)) == NULL ||
+	    !xbps_vpkg_name(pkgname, sizeof(pkgname), pkg))
+		return xbps_find_pkg_in_array(pkgs, pkg, tt);
+
+	pkgd = xbps_dictionary_get(xbps_dictionary_get(idx, "names"), pkgname);
+	if (pkgd == NULL ||
+	    !xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver))
+		goto notfound;
+	if (xbps_pkgpattern_version(pkg)) {
+		if (!xbps_pkgpattern_match(pkgver, pkg))
+			goto notfound;
+	} else if (xbps_pkg_version(pkg)) {
+		if (strcmp(pkgver, pkg) != 0)
+			goto notfound;
+	}
+	if (tt && xbps_transaction_pkg_type(pkgd) != tt)
+		goto notfound;
+	return pkgd;
+
+notfound:
+	errno = ENOENT;
+	return NULL;
+}
+
+static xbps_dictionary_t
+find_virtualpkg(xbps_dictionary_t idx, const char *vpkgname,
+		const char *pkg, xbps_trans_type_t tt)
+{
+	xbps_array_t providers;
+
+	providers = xbps_dictionary_get(xbps_dictionary_get(idx, "vpkgs"),
+	    vpkgname);
+	for (unsigned int i = 0; i < xbps_array_count(providers); i++) {
+		xbps_dictionary_t pkgd = xbps_array_get(providers, i);
+
+		if (!xbps_match_virtual_pkg_in_dict(pkgd, pkg))
+			continue;
+		if (tt && xbps_transaction_pkg_type(pkgd) != tt)
+			break;
+		return pkgd;
+	}
+	errno = ENOENT;
+	return NULL;
+}
+
+/*
+ * Same as xbps_find_virtualpkg_in_array() for the packages in the
+ * transaction.
+ */
+xbps_dictionary_t HIDDEN
+xbps_transaction_find_virtualpkg(struct xbps_handle *xhp, xbps_array_t pkgs,
+		const char *pkg, xbps_trans_type_t tt)
+{
+	xbps_dictionary_t idx, pkgd;
+	const char *vpkg;
+	char vpkgname[XBPS_NAME_SIZE], confname[XBPS_NAME_SIZE];
+
+	if ((idx = pkgs_index(xhp, pkgs)) == NULL ||
+	    !xbps_vpkg_name(vpkgname, sizeof(vpkgname), pkg))
+		return xbps_find_virtualpkg_in_array(xhp, pkgs, pkg, tt);
+
+	if ((vpkg = vpkg_user_conf(xhp, pkg))) {
+		if (!xbps_vpkg_name(confname, sizeof(confname), vpkg))
+			return xbps_find_virtualpkg_in_array(xhp, pkgs, pkg, tt);
+		if ((pkgd = find_virtualpkg(idx, confname, vpkg, tt)))
+			return pkgd;
+	}
+	return find_virtualpkg(idx, vpkgname, pkg, tt);
+}
+
 bool HIDDEN
 xbps_transaction_store(struct xbps_handle *xhp, xbps_array_t pkgs,
 		xbps_dictionary_t pkgrd, bool autoinst)
 {
-	xbps_dictionary_t d, pkgd;
+	xbps_dictionary_t d, idx, pkgd;
 	xbps_array_t replaces;
 	const char *pkgver, *pkgname, *curpkgver, *repo;
 	char *self_replaced;
@@ -50,7 +287,8 @@ xbps_transaction_store(struct xbps_handle *xhp, xbps_array_t pkgs,
 	if (!xbps_dictionary_get_cstring_nocopy(pkgrd, "pkgname", &pkgname)) {
 		return false;
 	}
-	d = xbps_find_pkg_in_array(pkgs, pkgname, 0);
+	idx = pkgs_index(xhp, pkgs);
+	d = xbps_transaction_find_pkg(xhp, pkgs, pkgname, 0);
 	if (xbps_object_type(d) == XBPS_TYPE_DICTIONARY) {
 		/* compare version stored in transaction vs current */
 		if (!xbps_dictionary_get_cstring_nocopy(d, "pkgver", &curpkgver)) {
@@ -65,6 +303,8 @@ xbps_transaction_store(struct xbps_handle *xhp, xbps_array_t pkgs,
 			 * Current version is greater than stored,
 			 * replace stored with current.
 			 */
+			if (idx)
+				pkgs_index_del(idx, d);
 			if (!xbps_remove_pkg_from_array_by_pkgver(pkgs, curpkgver)) {
 				return false;
 			}
@@ -99,6 +339,10 @@ xbps_transaction_store(struct xbps_handle *xhp, xbps_array_t pkgs,
 	 */
 	if (!xbps_array_add(pkgs, pkgd))
 		goto err;
+	if (idx && !pkgs_index_add(idx, pkgd, false)) {
+		xbps_dictionary_remove(xhp->transd, "packages_index");
+		goto err;
+	}
 
 	xbps_dictionary_get_cstring_nocopy(pkgd, "repository", &repo);
 
@@ -745,3 +745,48 @@ xbps_patterns_match(xbps_array_t patterns, const char *path)
 
 	return match;
 }
+
+int HIDDEN
+xbps_write_all(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	ssize_t wr;
+
+	while (len > 0) {
+		wr = write(fd, p, len);
+		if (wr == -1) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		p += wr;
+		len -= wr;
+	}
+	return 0;
+}
+
+/*
+ * Writes a member of a binary cache, which is followed by a NUL byte.
+ */
+int HIDDEN
+xbps_write_member(int fd, const void *buf, size_t len)
+{
+	int r;
+
+	if (len > 0 && (r = xbps_write_all(fd, buf, len)) < 0)
+		return r;
+	return xbps_write_all(fd, "", 1);
+}
+
+/* 64-bit FNV-1a, continuing from `h'. */
+uint64_t HIDDEN
+xbps_checksum64(uint64_t h, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+
+	while (len-- > 0) {
+		h ^= *p++;
+		h *= UINT64_C(0x100000001b3);
+	}
+	return h;
+}
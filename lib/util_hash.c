@@ -44,8 +44,8 @@
  * @brief Utility routines
  * @defgroup util Utility functions
  */
-static void
-digest2string(const uint8_t *digest, char *string, size_t len)
+void HIDDEN
+xbps_digest2string(const uint8_t *digest, char *string, size_t len)
 {
 	while (len--) {
 		if (*digest / 16 < 10)
@@ -158,7 +158,7 @@ xbps_file_sha256(char *dst, size_t dstlen, const char *file)
 	if (!xbps_file_sha256_raw(digest, sizeof digest, file))
 		return false;
 
-	digest2string(digest, dst, XBPS_SHA256_DIGEST_SIZE);
+	xbps_digest2string(digest, dst, XBPS_SHA256_DIGEST_SIZE);
 
 	return true;
 }
@@ -45,6 +45,15 @@ ATF_TC_BODY(cmpver_test, tc)
 	ATF_REQUIRE_EQ(xbps_cmpver("foo-blah-100dpi-21", "foo-blah-100dpi-21_0"), 0);
 	ATF_REQUIRE_EQ(xbps_cmpver("foo-blah-100dpi-21", "foo-blah-100dpi-2.1"), 1);
 	ATF_REQUIRE_EQ(xbps_cmpver("foo-1.0.1", "foo-1.0_1"), 1);
+	ATF_REQUIRE_EQ(xbps_cmpver("foo-1.0", "foo-1.0.0_1"), -1);
+	ATF_REQUIRE_EQ(xbps_cmpver("foo-1.0_2", "foo-1.0.0_1"), 1);
+	ATF_REQUIRE_EQ(xbps_cmpver("foo-1.0alpha", "foo-1.0beta"), -1);
+	ATF_REQUIRE_EQ(xbps_cmpver("foo-1.0rc1", "foo-1.0"), -1);
+	ATF_REQUIRE_EQ(xbps_cmpver("foo-1.0a", "foo-1.0.1"), 0);
+	ATF_REQUIRE_EQ(xbps_cmpver("foo-1.0b", "foo-1.0a"), 1);
+	ATF_REQUIRE_EQ(xbps_cmpver(
+	    "foo-1.2.3.4.5.6.7.8.9.10.11.12.13.14.15.16.17.18.19.20.21.22.23.24.25.26.27.28.29.30.31.32.33.34_1",
+	    "foo-1.2.3.4.5.6.7.8.9.10.11.12.13.14.15.16.17.18.19.20.21.22.23.24.25.26.27.28.29.30.31.32.33.35_1"), -1);
 }
 
 ATF_TP_ADD_TCS(tp)
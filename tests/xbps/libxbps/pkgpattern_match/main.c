@@ -54,8 +54,38 @@ ATF_TC_BODY(pkgpattern_match_test, tc)
 	ATF_REQUIRE_EQ(xbps_pkgpattern_match("foo-1.11", "foo-1.[0-2][2-4]?"), 0);
 }
 
+ATF_TC(pkgpattern_match_repeated_test);
+
+ATF_TC_HEAD(pkgpattern_match_repeated_test, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "Test xbps_pkgpattern_match with the same patterns");
+}
+
+ATF_TC_BODY(pkgpattern_match_repeated_test, tc)
+{
+	const char *longver = "foo-1.2.3.4.5.6.7.8.9.10.11.12.13.14.15.16.17.18"
+	    ".19.20.21.22.23.24.25.26.27.28.29.30.31.32.33.34.35.36_1";
+
+	for (int i = 0; i < 2; i++) {
+		ATF_REQUIRE_EQ(xbps_pkgpattern_match("foo-1.5_1", "foo>=1.2_1<2.0_1"), 1);
+		ATF_REQUIRE_EQ(xbps_pkgpattern_match("foo-2.0_1", "foo>=1.2_1<2.0_1"), 0);
+		ATF_REQUIRE_EQ(xbps_pkgpattern_match("foo-1.1_1", "foo>=1.2_1<2.0_1"), 0);
+		ATF_REQUIRE_EQ(xbps_pkgpattern_match("foobar-1.5_1", "foo>=1.2_1<2.0_1"), 0);
+		ATF_REQUIRE_EQ(xbps_pkgpattern_match("fo-1.5_1", "foo>=1.2_1<2.0_1"), 0);
+		ATF_REQUIRE_EQ(xbps_pkgpattern_match("foo-2.0rc1_1", "foo<2.0_1"), 1);
+		ATF_REQUIRE_EQ(xbps_pkgpattern_match("foo-2.0_2", "foo<=2.0_1"), 0);
+		ATF_REQUIRE_EQ(xbps_pkgpattern_match("foo", "foo>=1.0_1"), 0);
+		ATF_REQUIRE_EQ(xbps_pkgpattern_match("foo", "foo<1.0_1"), 0);
+		ATF_REQUIRE_EQ(xbps_pkgpattern_match(longver, "foo>1.2.3.4.5.6.7.8.9.10.11.12"
+		    ".13.14.15.16.17.18.19.20.21.22.23.24.25.26.27.28.29.30.31.32.33.34.35.36"), 1);
+		ATF_REQUIRE_EQ(xbps_pkgpattern_match(longver, "foo<1.2.3.4.5.6.7.8.9.10.11.12"
+		    ".13.14.15.16.17.18.19.20.21.22.23.24.25.26.27.28.29.30.31.32.33.34.35.37"), 1);
+	}
+}
+
 ATF_TP_ADD_TCS(tp)
 {
 	ATF_TP_ADD_TC(tp, pkgpattern_match_test);
+	ATF_TP_ADD_TC(tp, pkgpattern_match_repeated_test);
 	return atf_no_error();
 }
@@ -0,0 +1,181 @@
+/*-
+ * Copyright (c) 2026 xbps contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *-
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atf-c.h>
+#include <xbps.h>
+
+static const char plist[] =
+"<plist version=\"1.0\">\n"
+"<dict>\n"
+"	<key>foo</key>\n"
+"	<string>1</string>\n"
+"	<key>bar</key>\n"
+"	<string>2</string>\n"
+"	<key>foo</key>\n"
+"	<string>3</string>\n"
+"	<key>baz</key>\n"
+"	<string>4</string>\n"
+"</dict>\n"
+"</plist>\n";
+
+static bool
+append_cstring(xbps_dictionary_t d, const char *key, const char *val)
+{
+	xbps_string_t s;
+	bool rv;
+
+	s = xbps_string_create_cstring(val);
+	rv = xbps_dictionary_append(d, key, s);
+	xbps_object_release(s);
+	return rv;
+}
+
+ATF_TC(dictionary_append_test);
+ATF_TC_HEAD(dictionary_append_test, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "Test appending unsorted keys to a dictionary");
+}
+
+ATF_TC_BODY(dictionary_append_test, tc)
+{
+	xbps_dictionary_t d;
+	xbps_array_t keys;
+	const char *s = NULL;
+	char key[16];
+
+	d = xbps_dictionary_create();
+	ATF_REQUIRE(d != NULL);
+
+	/* keys in order, the dictionary stays sorted */
+	ATF_REQUIRE_EQ(append_cstring(d, "a", "1"), true);
+	ATF_REQUIRE_EQ(append_cstring(d, "b", "2"), true);
+	ATF_REQUIRE_EQ(append_cstring(d, "b", "3"), true);
+	ATF_REQUIRE_EQ(xbps_dictionary_count(d), 2);
+	ATF_REQUIRE_EQ(xbps_dictionary_get_cstring_nocopy(d, "b", &s), true);
+	ATF_REQUIRE_STREQ(s, "3");
+
+	/* keys out of order, sorted once and the last value wins */
+	for (int i = 99; i >= 0; i--) {
+		snprintf(key, sizeof(key), "k%02d", i);
+		ATF_REQUIRE_EQ(append_cstring(d, key, key), true);
+	}
+	ATF_REQUIRE_EQ(append_cstring(d, "a", "4"), true);
+	ATF_REQUIRE_EQ(xbps_dictionary_sort(d), true);
+	ATF_REQUIRE_EQ(xbps_dictionary_count(d), 102);
+	ATF_REQUIRE_EQ(xbps_dictionary_get_cstring_nocopy(d, "a", &s), true);
+	ATF_REQUIRE_STREQ(s, "4");
+	ATF_REQUIRE_EQ(xbps_dictionary_get_cstring_nocopy(d, "k42", &s), true);
+	ATF_REQUIRE_STREQ(s, "k42");
+
+	keys = xbps_dictionary_all_keys(d);
+	ATF_REQUIRE(keys != NULL);
+	for (unsigned int i = 1; i < xbps_array_count(keys); i++) {
+		ATF_REQUIRE(strcmp(
+		    xbps_dictionary_keysym_cstring_nocopy(xbps_array_get(keys, i - 1)),
+		    xbps_dictionary_keysym_cstring_nocopy(xbps_array_get(keys, i))) < 0);
+	}
+	xbps_object_release(keys);
+	xbps_object_release(d);
+}
+
+ATF_TC(lookup_unsorted_test);
+ATF_TC_HEAD(lookup_unsorted_test, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "Test looking up keys appended out of order without sorting");
+}
+
+ATF_TC_BODY(lookup_unsorted_test, tc)
+{
+	xbps_dictionary_t d;
+	const char *s = NULL;
+	char key[16];
+
+	d = xbps_dictionary_create();
+	ATF_REQUIRE(d != NULL);
+	for (int i = 99; i >= 0; i--) {
+		snprintf(key, sizeof(key), "k%02d", i);
+		ATF_REQUIRE_EQ(append_cstring(d, key, key), true);
+	}
+	ATF_REQUIRE_EQ(append_cstring(d, "k50", "last"), true);
+
+	/* the first lookup sorts the dictionary */
+	ATF_REQUIRE_EQ(xbps_dictionary_get_cstring_nocopy(d, "k00", &s), true);
+	ATF_REQUIRE_STREQ(s, "k00");
+	ATF_REQUIRE_EQ(xbps_dictionary_get_cstring_nocopy(d, "k99", &s), true);
+	ATF_REQUIRE_STREQ(s, "k99");
+	ATF_REQUIRE_EQ(xbps_dictionary_get_cstring_nocopy(d, "k50", &s), true);
+	ATF_REQUIRE_STREQ(s, "last");
+	ATF_REQUIRE_EQ(xbps_dictionary_count(d), 100);
+	ATF_REQUIRE(xbps_dictionary_get(d, "k100") == NULL);
+
+	/* and so does freezing it */
+	ATF_REQUIRE_EQ(append_cstring(d, "a", "1"), true);
+	xbps_dictionary_make_immutable(d);
+	ATF_REQUIRE_EQ(xbps_dictionary_get_cstring_nocopy(d, "a", &s), true);
+	ATF_REQUIRE_STREQ(s, "1");
+	ATF_REQUIRE_EQ(xbps_dictionary_count(d), 101);
+	xbps_object_release(d);
+}
+
+ATF_TC(internalize_unsorted_test);
+ATF_TC_HEAD(internalize_unsorted_test, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "Test internalizing a dictionary with unsorted and duplicate keys");
+}
+
+ATF_TC_BODY(internalize_unsorted_test, tc)
+{
+	xbps_dictionary_t d;
+	const char *s = NULL;
+
+	d = xbps_dictionary_internalize(plist);
+	ATF_REQUIRE(d != NULL);
+	ATF_REQUIRE_EQ(xbps_dictionary_count(d), 3);
+	ATF_REQUIRE_EQ(xbps_dictionary_get_cstring_nocopy(d, "foo", &s), true);
+	ATF_REQUIRE_STREQ(s, "3");
+	ATF_REQUIRE_EQ(xbps_dictionary_get_cstring_nocopy(d, "bar", &s), true);
+	ATF_REQUIRE_STREQ(s, "2");
+	ATF_REQUIRE_EQ(xbps_dictionary_get_cstring_nocopy(d, "baz", &s), true);
+	ATF_REQUIRE_STREQ(s, "4");
+
+	/* setting a key keeps working on the sorted dictionary */
+	ATF_REQUIRE_EQ(xbps_dictionary_set_cstring(d, "bat", "5"), true);
+	ATF_REQUIRE_EQ(xbps_dictionary_get_cstring_nocopy(d, "bat", &s), true);
+	ATF_REQUIRE_STREQ(s, "5");
+	xbps_object_release(d);
+}
+
+ATF_TP_ADD_TCS(tp)
+{
+	ATF_TP_ADD_TC(tp, dictionary_append_test);
+	ATF_TP_ADD_TC(tp, lookup_unsorted_test);
+	ATF_TP_ADD_TC(tp, internalize_unsorted_test);
+
+	return atf_no_error();
+}
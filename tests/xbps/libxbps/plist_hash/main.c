@@ -0,0 +1,131 @@
+/*-
+ * Copyright (c) 2026 xbps contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *-
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atf-c.h>
+#include <xbps.h>
+
+#define NKEYS	1000
+
+static xbps_dictionary_t
+create_dict(void)
+{
+	xbps_dictionary_t d;
+	char key[32];
+
+	d = xbps_dictionary_create();
+	ATF_REQUIRE(d != NULL);
+	for (int i = 0; i < NKEYS; i++) {
+		snprintf(key, sizeof(key), "python3-pkg%d", i);
+		ATF_REQUIRE_EQ(xbps_dictionary_set_uint32(d, key, i), true);
+	}
+	return d;
+}
+
+static void
+check_dict(xbps_dictionary_t d, int skip)
+{
+	char key[32];
+	uint32_t v;
+
+	for (int i = 0; i < NKEYS; i++) {
+		snprintf(key, sizeof(key), "python3-pkg%d", i);
+		if (i == skip) {
+			ATF_REQUIRE(xbps_dictionary_get(d, key) == NULL);
+			continue;
+		}
+		ATF_REQUIRE_EQ(xbps_dictionary_get_uint32(d, key, &v), true);
+		ATF_REQUIRE_EQ(v, (uint32_t)i);
+	}
+	ATF_REQUIRE(xbps_dictionary_get(d, "python3-pkg") == NULL);
+	ATF_REQUIRE(xbps_dictionary_get(d, "python3-pkg1000") == NULL);
+	ATF_REQUIRE(xbps_dictionary_get(d, "") == NULL);
+}
+
+ATF_TC(immutable_lookup_test);
+ATF_TC_HEAD(immutable_lookup_test, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "Test lookups in a large immutable dictionary");
+}
+
+ATF_TC_BODY(immutable_lookup_test, tc)
+{
+	xbps_dictionary_t d, d2;
+
+	d = create_dict();
+	xbps_dictionary_make_immutable(d);
+	check_dict(d, -1);
+
+	/* a mutable copy keeps finding keys after being modified */
+	d2 = xbps_dictionary_copy_mutable(d);
+	ATF_REQUIRE(d2 != NULL);
+	check_dict(d2, -1);
+	xbps_dictionary_remove(d2, "python3-pkg500");
+	check_dict(d2, 500);
+	ATF_REQUIRE_EQ(xbps_dictionary_set_uint32(d2, "python3-pkg500", 500), true);
+	check_dict(d2, -1);
+
+	xbps_object_release(d2);
+	xbps_object_release(d);
+}
+
+ATF_TC(internalize_lookup_test);
+ATF_TC_HEAD(internalize_lookup_test, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "Test lookups in a large internalized dictionary");
+}
+
+ATF_TC_BODY(internalize_lookup_test, tc)
+{
+	xbps_dictionary_t d, d2;
+	char *xml;
+
+	d = create_dict();
+	xml = xbps_dictionary_externalize(d);
+	ATF_REQUIRE(xml != NULL);
+	d2 = xbps_dictionary_internalize(xml);
+	ATF_REQUIRE(d2 != NULL);
+	free(xml);
+	check_dict(d2, -1);
+
+	xbps_dictionary_remove(d2, "python3-pkg7");
+	check_dict(d2, 7);
+	ATF_REQUIRE_EQ(xbps_dictionary_set_uint32(d2, "python3-pkg7", 7), true);
+	check_dict(d2, -1);
+
+	xbps_object_release(d2);
+	xbps_object_release(d);
+}
+
+ATF_TP_ADD_TCS(tp)
+{
+	ATF_TP_ADD_TC(tp, immutable_lookup_test);
+	ATF_TP_ADD_TC(tp, internalize_lookup_test);
+
+	return atf_no_error();
+}
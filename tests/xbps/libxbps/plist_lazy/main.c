@@ -0,0 +1,168 @@
+/*-
+ * Copyright (c) 2026 xbps contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *-
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include <atf-c.h>
+#include <xbps.h>
+
+static const char plist[] =
+"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+"<!DOCTYPE plist PUBLIC \"-//Apple Computer//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+"<plist version=\"1.0\">\n"
+"<dict>\n"
+"	<key>bar</key>\n"
+"	<dict>\n"
+"		<key>pkgver</key>\n"
+"		<string>bar-1.0_1</string>\n"
+"		<key>run_depends</key>\n"
+"		<array>\n"
+"			<string>foo&gt;=1.0_1</string>\n"
+"		</array>\n"
+"	</dict>\n"
+"	<!-- comment -->\n"
+"	<key>empty</key>\n"
+"	<dict/>\n"
+"	<key>foo</key>\n"
+"	<dict>\n"
+"		<key>pkgver</key>\n"
+"		<string>foo-1.0_1</string>\n"
+"		<key>preserve</key>\n"
+"		<true/>\n"
+"	</dict>\n"
+"</dict>\n"
+"</plist>\n";
+
+static xbps_dictionary_t
+lazy_internalize(const char *s)
+{
+	xbps_dictionary_t d;
+	char *buf;
+
+	buf = strdup(s);
+	ATF_REQUIRE(buf != NULL);
+	d = xbps_dictionary_internalize_lazy(buf, strlen(buf));
+	if (d == NULL)
+		free(buf);
+	return d;
+}
+
+ATF_TC(internalize_lazy_test);
+ATF_TC_HEAD(internalize_lazy_test, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "Test xbps_dictionary_internalize_lazy");
+}
+
+ATF_TC_BODY(internalize_lazy_test, tc)
+{
+	xbps_dictionary_t d, full, pkgd;
+	const char *pkgver = NULL;
+
+	full = xbps_dictionary_internalize(plist);
+	ATF_REQUIRE(full != NULL);
+	d = lazy_internalize(plist);
+	ATF_REQUIRE(d != NULL);
+	ATF_REQUIRE_EQ(xbps_dictionary_count(d), 3);
+
+	pkgd = xbps_dictionary_get(d, "foo");
+	ATF_REQUIRE(pkgd != NULL);
+	ATF_REQUIRE_EQ(xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver), true);
+	ATF_REQUIRE_STREQ(pkgver, "foo-1.0_1");
+	ATF_REQUIRE_EQ(xbps_dictionary_count(xbps_dictionary_get(d, "empty")), 0);
+	ATF_REQUIRE_EQ(xbps_dictionary_equals(d, full), true);
+
+	xbps_object_release(d);
+	xbps_object_release(full);
+}
+
+ATF_TC(internalize_lazy_fallback_test);
+ATF_TC_HEAD(internalize_lazy_fallback_test, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "Test xbps_dictionary_internalize_lazy rejects documents it cannot scan");
+}
+
+ATF_TC_BODY(internalize_lazy_fallback_test, tc)
+{
+	/* unsorted keys */
+	ATF_REQUIRE_EQ(lazy_internalize("<plist version=\"1.0\"><dict>"
+	    "<key>b</key><true/><key>a</key><true/></dict></plist>"), NULL);
+	/* escaped keys */
+	ATF_REQUIRE_EQ(lazy_internalize("<plist version=\"1.0\"><dict>"
+	    "<key>a&amp;b</key><true/></dict></plist>"), NULL);
+	/* unbalanced value */
+	ATF_REQUIRE_EQ(lazy_internalize("<plist version=\"1.0\"><dict>"
+	    "<key>a</key><array><true/></dict></plist>"), NULL);
+	/* not a dictionary */
+	ATF_REQUIRE_EQ(lazy_internalize("<plist version=\"1.0\"><array>"
+	    "</array></plist>"), NULL);
+}
+
+ATF_TC(internalize_indexed_test);
+ATF_TC_HEAD(internalize_indexed_test, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "Test xbps_dictionary_{ex,in}ternalize_indexed");
+}
+
+ATF_TC_BODY(internalize_indexed_test, tc)
+{
+	xbps_dictionary_t full, d;
+	unsigned char *idx;
+	size_t idxlen;
+	char *buf;
+
+	full = xbps_dictionary_internalize(plist);
+	ATF_REQUIRE(full != NULL);
+	buf = xbps_dictionary_externalize_indexed(full, (void **)&idx, &idxlen);
+	ATF_REQUIRE(buf != NULL);
+
+	d = xbps_dictionary_internalize_indexed(buf, strlen(buf), idx, idxlen);
+	ATF_REQUIRE(d != NULL);
+	ATF_REQUIRE_EQ(xbps_dictionary_equals(d, full), true);
+	xbps_object_release(d);
+
+	/* index does not match the document */
+	buf = xbps_dictionary_externalize(full);
+	ATF_REQUIRE(buf != NULL);
+	ATF_REQUIRE_EQ(xbps_dictionary_internalize_indexed(buf, strlen(buf) - 1,
+	    idx, idxlen), NULL);
+	/* damaged index */
+	idx[0] ^= 1;
+	ATF_REQUIRE_EQ(xbps_dictionary_internalize_indexed(buf, strlen(buf),
+	    idx, idxlen), NULL);
+
+	free(buf);
+	free(idx);
+	xbps_object_release(full);
+}
+
+ATF_TP_ADD_TCS(tp)
+{
+	ATF_TP_ADD_TC(tp, internalize_lazy_test);
+	ATF_TP_ADD_TC(tp, internalize_lazy_fallback_test);
+	ATF_TP_ADD_TC(tp, internalize_indexed_test);
+
+	return atf_no_error();
+}
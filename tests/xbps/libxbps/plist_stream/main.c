@@ -0,0 +1,207 @@
+/*-
+ * Copyright (c) 2026 xbps contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *-
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atf-c.h>
+#include <xbps.h>
+
+static const char plist[] =
+"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+"<!DOCTYPE plist PUBLIC \"-//Apple Computer//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+"<plist version=\"1.0\">\n"
+"<dict>\n"
+"	<key>bar</key>\n"
+"	<dict>\n"
+"		<key>pkgver</key>\n"
+"		<string>bar-1.0_1</string>\n"
+"		<key>run_depends</key>\n"
+"		<array>\n"
+"			<string>foo&gt;=1.0_1</string>\n"
+"			<array>\n"
+"				<array>\n"
+"					<integer>1</integer>\n"
+"				</array>\n"
+"			</array>\n"
+"		</array>\n"
+"	</dict>\n"
+"	<!-- comment -->\n"
+"	<key>empty</key>\n"
+"	<dict/>\n"
+"	<key>foo</key>\n"
+"	<dict>\n"
+"		<key>pkgver</key>\n"
+"		<string>foo-1.0_1</string>\n"
+"		<key>preserve</key>\n"
+"		<true/>\n"
+"	</dict>\n"
+"</dict>\n"
+"</plist>\n";
+
+struct reader {
+	const char *s;
+	size_t len;
+	size_t off;
+	size_t chunk;
+};
+
+static ssize_t
+reader_read(void *arg, void *buf, size_t len)
+{
+	struct reader *rd = arg;
+
+	if (len > rd->chunk)
+		len = rd->chunk;
+	if (len > rd->len - rd->off)
+		len = rd->len - rd->off;
+	memcpy(buf, rd->s + rd->off, len);
+	rd->off += len;
+	return len;
+}
+
+static xbps_dictionary_t
+stream_internalize(const char *s, size_t len, size_t chunk)
+{
+	struct reader rd = { .s = s, .len = len, .chunk = chunk };
+
+	return xbps_dictionary_internalize_stream(reader_read, &rd);
+}
+
+ATF_TC(internalize_stream_test);
+ATF_TC_HEAD(internalize_stream_test, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "Test xbps_dictionary_internalize_stream");
+}
+
+ATF_TC_BODY(internalize_stream_test, tc)
+{
+	static const size_t chunks[] = { 1, 2, 3, 7, 64, 65536 };
+	xbps_dictionary_t d, full;
+
+	full = xbps_dictionary_internalize(plist);
+	ATF_REQUIRE(full != NULL);
+	for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+		d = stream_internalize(plist, strlen(plist), chunks[i]);
+		ATF_REQUIRE(d != NULL);
+		ATF_REQUIRE_EQ(xbps_dictionary_equals(d, full), true);
+		xbps_object_release(d);
+	}
+	/* truncated */
+	ATF_REQUIRE_EQ(stream_internalize(plist, strlen(plist) - 10, 7), NULL);
+	ATF_REQUIRE_EQ(stream_internalize(plist, 0, 7), NULL);
+	xbps_object_release(full);
+}
+
+ATF_TC(internalize_stream_large_test);
+ATF_TC_HEAD(internalize_stream_large_test, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "Test xbps_dictionary_internalize_stream with documents larger than its buffer");
+}
+
+ATF_TC_BODY(internalize_stream_large_test, tc)
+{
+	char key[32];
+	xbps_dictionary_t d, full;
+	char *big, *buf;
+
+	full = xbps_dictionary_create();
+	ATF_REQUIRE(full != NULL);
+	for (int i = 0; i < 10000; i++) {
+		snprintf(key, sizeof(key), "pkg-%05d", i);
+		ATF_REQUIRE_EQ(xbps_dictionary_set_cstring(full, key, key), true);
+	}
+	big = malloc(300000);
+	ATF_REQUIRE(big != NULL);
+	memset(big, 'a', 299999);
+	big[299999] = '\0';
+	ATF_REQUIRE_EQ(xbps_dictionary_set_cstring(full, "pkg-05000-big", big), true);
+	free(big);
+
+	buf = xbps_dictionary_externalize(full);
+	ATF_REQUIRE(buf != NULL);
+	d = stream_internalize(buf, strlen(buf), 4093);
+	ATF_REQUIRE(d != NULL);
+	ATF_REQUIRE_EQ(xbps_dictionary_equals(d, full), true);
+
+	xbps_object_release(d);
+	xbps_object_release(full);
+	free(buf);
+}
+
+ATF_TC(externalize_to_file_test);
+ATF_TC_HEAD(externalize_to_file_test, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "Test writing documents larger than the externalize buffer to files");
+}
+
+ATF_TC_BODY(externalize_to_file_test, tc)
+{
+	char key[32];
+	xbps_dictionary_t d, full;
+	char *buf, *fbuf;
+	FILE *fp;
+	size_t len;
+
+	full = xbps_dictionary_create();
+	ATF_REQUIRE(full != NULL);
+	for (int i = 0; i < 10000; i++) {
+		snprintf(key, sizeof(key), "pkg-%05d", i);
+		ATF_REQUIRE_EQ(xbps_dictionary_set_cstring(full, key, "<&>"), true);
+	}
+
+	/* the file holds the same document as the buffer, without the NUL */
+	ATF_REQUIRE_EQ(xbps_dictionary_externalize_to_file(full, "plist"), true);
+	buf = xbps_dictionary_externalize(full);
+	ATF_REQUIRE(buf != NULL);
+	len = strlen(buf);
+	fbuf = malloc(len + 1);
+	ATF_REQUIRE(fbuf != NULL);
+	fp = fopen("plist", "r");
+	ATF_REQUIRE(fp != NULL);
+	ATF_REQUIRE_EQ(fread(fbuf, 1, len + 1, fp), len);
+	fclose(fp);
+	ATF_REQUIRE(memcmp(buf, fbuf, len) == 0);
+	free(fbuf);
+	free(buf);
+
+	ATF_REQUIRE_EQ(xbps_dictionary_externalize_to_zfile(full, "plist.gz"), true);
+	d = xbps_dictionary_internalize_from_zfile("plist.gz");
+	ATF_REQUIRE(d != NULL);
+	ATF_REQUIRE_EQ(xbps_dictionary_equals(d, full), true);
+	xbps_object_release(d);
+
+	xbps_object_release(full);
+}
+
+ATF_TP_ADD_TCS(tp)
+{
+	ATF_TP_ADD_TC(tp, internalize_stream_test);
+	ATF_TP_ADD_TC(tp, internalize_stream_large_test);
+	ATF_TP_ADD_TC(tp, externalize_to_file_test);
+
+	return atf_no_error();
+}
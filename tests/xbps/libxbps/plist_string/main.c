@@ -0,0 +1,151 @@
+/*-
+ * Copyright (c) 2026 xbps contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *-
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include <atf-c.h>
+#include <xbps.h>
+
+static const char plist[] =
+"<plist version=\"1.0\">\n"
+"<dict>\n"
+"	<key>bar</key>\n"
+"	<dict>\n"
+"		<key>architecture</key>\n"
+"		<string>x86_64</string>\n"
+"		<key>short_desc</key>\n"
+"		<string>a description that is too long to be shared</string>\n"
+"	</dict>\n"
+"	<key>foo</key>\n"
+"	<dict>\n"
+"		<key>architecture</key>\n"
+"		<string>x86_64</string>\n"
+"		<key>short_desc</key>\n"
+"		<string>a description that is too long to be shared</string>\n"
+"	</dict>\n"
+"</dict>\n"
+"</plist>\n";
+
+ATF_TC(internalize_string_shared_test);
+ATF_TC_HEAD(internalize_string_shared_test, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "Test internalized strings sharing their storage");
+}
+
+ATF_TC_BODY(internalize_string_shared_test, tc)
+{
+	xbps_dictionary_t d, bar, foo;
+	xbps_string_t s1, s2, s3;
+
+	d = xbps_dictionary_internalize(plist);
+	ATF_REQUIRE(d != NULL);
+	bar = xbps_dictionary_get(d, "bar");
+	foo = xbps_dictionary_get(d, "foo");
+
+	s1 = xbps_dictionary_get(bar, "architecture");
+	s2 = xbps_dictionary_get(foo, "architecture");
+	ATF_REQUIRE(s1 != s2);
+	ATF_REQUIRE_EQ(xbps_string_cstring_nocopy(s1), xbps_string_cstring_nocopy(s2));
+	ATF_REQUIRE(xbps_string_cstring_nocopy(xbps_dictionary_get(bar, "short_desc")) !=
+	    xbps_string_cstring_nocopy(xbps_dictionary_get(foo, "short_desc")));
+
+	/* modifying a string does not modify the strings sharing its storage */
+	s3 = xbps_string_copy(s1);
+	ATF_REQUIRE(s3 != NULL);
+	ATF_REQUIRE_EQ(xbps_string_mutable(s1), true);
+	ATF_REQUIRE_EQ(xbps_string_append_cstring(s1, "-musl"), true);
+	ATF_REQUIRE_STREQ(xbps_string_cstring_nocopy(s1), "x86_64-musl");
+	ATF_REQUIRE_STREQ(xbps_string_cstring_nocopy(s2), "x86_64");
+	ATF_REQUIRE_STREQ(xbps_string_cstring_nocopy(s3), "x86_64");
+
+	xbps_object_release(d);
+	ATF_REQUIRE_STREQ(xbps_string_cstring_nocopy(s3), "x86_64");
+	xbps_object_release(s3);
+}
+
+static const char plist_entities[] =
+"<plist version=\"1.0\">\n"
+"<!-- a comment -->\n"
+"<dict>\n"
+"	<key>a&amp;b</key>\n"
+"	<string>&lt;foo&gt; &amp; &quot;bar&quot; &apos;baz&apos;</string>\n"
+"	<key>long</key>\n"
+"	<string>a description that is long enough &amp; not shared</string>\n"
+"	<key>plain</key>\n"
+"	<string>a description that is long enough to be allocated</string>\n"
+"</dict>\n"
+"</plist>\n";
+
+ATF_TC(internalize_string_entities_test);
+ATF_TC_HEAD(internalize_string_entities_test, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "Test decoding entities of internalized strings");
+}
+
+ATF_TC_BODY(internalize_string_entities_test, tc)
+{
+	xbps_dictionary_t d;
+	const char *s = NULL;
+	char *xml;
+
+	d = xbps_dictionary_internalize(plist_entities);
+	ATF_REQUIRE(d != NULL);
+	ATF_REQUIRE_EQ(xbps_dictionary_get_cstring_nocopy(d, "a&b", &s), true);
+	ATF_REQUIRE_STREQ(s, "<foo> & \"bar\" 'baz'");
+	ATF_REQUIRE_EQ(xbps_dictionary_get_cstring_nocopy(d, "long", &s), true);
+	ATF_REQUIRE_STREQ(s, "a description that is long enough & not shared");
+	ATF_REQUIRE_EQ(xbps_dictionary_get_cstring_nocopy(d, "plain", &s), true);
+	ATF_REQUIRE_STREQ(s, "a description that is long enough to be allocated");
+	xbps_object_release(d);
+
+	/* unknown entities and unterminated strings are rejected */
+	ATF_REQUIRE(xbps_dictionary_internalize("<plist version=\"1.0\"><dict>"
+	    "<key>a</key><string>&foo;</string></dict></plist>") == NULL);
+	ATF_REQUIRE(xbps_dictionary_internalize("<plist version=\"1.0\"><dict>"
+	    "<key>a</key><string>foo") == NULL);
+
+	/* and survive a round trip */
+	d = xbps_dictionary_create();
+	ATF_REQUIRE(d != NULL);
+	ATF_REQUIRE_EQ(xbps_dictionary_set_cstring(d, "k", "<&>\"'"), true);
+	xml = xbps_dictionary_externalize(d);
+	ATF_REQUIRE(xml != NULL);
+	xbps_object_release(d);
+	d = xbps_dictionary_internalize(xml);
+	free(xml);
+	ATF_REQUIRE(d != NULL);
+	ATF_REQUIRE_EQ(xbps_dictionary_get_cstring_nocopy(d, "k", &s), true);
+	ATF_REQUIRE_STREQ(s, "<&>\"'");
+	xbps_object_release(d);
+}
+
+ATF_TP_ADD_TCS(tp)
+{
+	ATF_TP_ADD_TC(tp, internalize_string_shared_test);
+	ATF_TP_ADD_TC(tp, internalize_string_entities_test);
+
+	return atf_no_error();
+}
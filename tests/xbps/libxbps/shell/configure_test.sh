@@ -31,6 +31,75 @@ EOF
 	atf_check_equal $perms 644
 }
 
+atf_test_case journal
+
+journal_head() {
+	atf_set "descr" "Tests for pkg configuration: pkgdb of a failed transaction"
+}
+
+journal_body() {
+	mkdir -p repo pkg_A
+	cat >>pkg_A/INSTALL<<EOF
+#!/bin/sh
+case "\$1" in
+post)
+	exit 1
+	;;
+esac
+EOF
+	chmod 755 pkg_A/INSTALL
+	cd repo
+	xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+	xbps-install -C empty.conf -r root --repository=$PWD/repo -yd A
+	atf_check_equal $? 1
+	# the journal is compacted into the plist on failure
+	atf_check -s exit:1 -- test -e root/var/db/xbps/pkgdb-0.38.plist.journal
+	atf_check -- grep -q A-1.0_1 root/var/db/xbps/pkgdb-0.38.plist
+	atf_check -o inline:"unpacked\n" -- xbps-query -C empty.conf -r root -p state A
+}
+
+atf_test_case journal_replay
+
+journal_replay_head() {
+	atf_set "descr" "Tests for pkg configuration: pkgdb journal of an interrupted transaction"
+}
+
+journal_replay_body() {
+	mkdir -p repo pkg_A
+	cat >>pkg_A/INSTALL<<EOF
+#!/bin/sh
+case "\$1" in
+post)
+	kill -9 \$PPID
+	;;
+esac
+EOF
+	chmod 755 pkg_A/INSTALL
+	cd repo
+	xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+	xbps-install -C empty.conf -r root --repository=$PWD/repo -yd A
+	# the unpacked pkg is only recorded in the journal
+	atf_check -- test -s root/var/db/xbps/pkgdb-0.38.plist.journal
+	atf_check -s exit:1 -- test -e root/var/db/xbps/pkgdb-0.38.plist
+	atf_check -o inline:"unpacked\n" -- xbps-query -C empty.conf -r root -p state A
+	# flushing the pkgdb compacts the journal
+	xbps-pkgdb -C empty.conf -r root -a
+	atf_check_equal $? 0
+	atf_check -s exit:1 -- test -e root/var/db/xbps/pkgdb-0.38.plist.journal
+	atf_check -- grep -q A-1.0_1 root/var/db/xbps/pkgdb-0.38.plist
+	atf_check -o inline:"unpacked\n" -- xbps-query -C empty.conf -r root -p state A
+}
+
 atf_init_test_cases() {
 	atf_add_test_case filemode
+	atf_add_test_case journal
+	atf_add_test_case journal_replay
 }
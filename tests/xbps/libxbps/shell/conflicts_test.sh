@@ -180,6 +180,40 @@ conflicts_installed_multi_body() {
 	atf_check_equal $(xbps-query -r root -l|wc -l) 1
 }
 
+atf_test_case conflicts_installed_order
+
+conflicts_installed_order_head() {
+	atf_set "descr" "Tests for pkg conflicts: conflicts of multiple installed pkgs are listed in a stable order"
+}
+
+conflicts_installed_order_body() {
+	mkdir some_repo
+	mkdir -p pkg_A pkg_B pkg_C pkg_D pkg_E
+	cd some_repo
+	for p in A B C D; do
+		xbps-create -A noarch -n ${p}-1.0_1 -s "${p} pkg" --conflicts "E>=0" ../pkg_${p}
+		atf_check_equal $? 0
+	done
+	xbps-create -A noarch -n E-1.0_1 -s "E pkg" ../pkg_E
+	atf_check_equal $? 0
+
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+
+	xbps-install -r root --repository=$PWD/some_repo -y D B C A
+	atf_check_equal $? 0
+	for i in 1 2 3 4 5; do
+		xbps-install -r root --repository=$PWD/some_repo -y E 2>err
+		# EAGAIN, conflicts.
+		atf_check_equal $? 11
+		atf_check -o inline:"CONFLICT: A-1.0_1 with E-1.0_1 in transaction (matched by E>=0)
+CONFLICT: B-1.0_1 with E-1.0_1 in transaction (matched by E>=0)
+CONFLICT: C-1.0_1 with E-1.0_1 in transaction (matched by E>=0)
+CONFLICT: D-1.0_1 with E-1.0_1 in transaction (matched by E>=0)\n" -- grep ^CONFLICT err
+	done
+}
+
 atf_test_case conflicts_trans_installed
 
 conflicts_trans_installed_head() {
@@ -361,6 +395,7 @@ atf_init_test_cases() {
 	atf_add_test_case conflicts_trans_installed_multi
 	atf_add_test_case conflicts_installed
 	atf_add_test_case conflicts_installed_multi
+	atf_add_test_case conflicts_installed_order
 	atf_add_test_case conflicts_trans_update
 	atf_add_test_case conflicts_trans_provrep
 }
@@ -55,6 +55,45 @@ install_with_deps_body() {
 	atf_check_equal $? 0
 }
 
+atf_test_case install_shared_deps
+
+install_shared_deps_head() {
+	atf_set "descr" "Tests for pkg installations: install pkgs sharing the same deps"
+}
+
+install_shared_deps_body() {
+	mkdir some_repo
+	mkdir -p pkg_A/usr/bin pkg_B/usr/bin pkg_C/usr/bin pkg_X/usr/bin
+	cd some_repo
+	xbps-create -A noarch -n A-1.0_1 -s "A pkg" --provides "V-1.0_1" ../pkg_A
+	atf_check_equal $? 0
+	xbps-create -A noarch -n B-1.0_1 -s "B pkg" --dependencies "A>=0 V>=0 X>=0" ../pkg_B
+	atf_check_equal $? 0
+	xbps-create -A noarch -n C-1.0_1 -s "C pkg" --dependencies "A>=0 V>=0 X>=0" ../pkg_C
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+
+	# the missing dependency is only reported once
+	atf_check -s exit:19 -e inline:"MISSING: X>=0\nERROR: Transaction aborted due to unresolved dependencies.\n" -- \
+		xbps-install -C empty.conf -r root --repository=$PWD/some_repo -yn B C
+
+	cd some_repo
+	xbps-create -A noarch -n X-1.0_1 -s "X pkg" ../pkg_X
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+
+	printf "A-1.0_1\nX-1.0_1\nB-1.0_1\nC-1.0_1\n" > exp
+	xbps-install -C empty.conf -r root --repository=$PWD/some_repo -yn B C|awk '{print $1}' > out
+	echo "exp: '$(cat exp)'" >&2
+	echo "out: '$(cat out)'" >&2
+	cmp exp out
+	atf_check_equal $? 0
+}
+
 atf_test_case install_with_vpkg_deps
 
 install_with_vpkg_deps_head() {
@@ -775,6 +814,7 @@ update_issue_218_body() {
 atf_init_test_cases() {
 	atf_add_test_case install_empty
 	atf_add_test_case install_with_deps
+	atf_add_test_case install_shared_deps
 	atf_add_test_case install_with_vpkg_deps
 	atf_add_test_case install_if_not_installed_on_update
 	atf_add_test_case install_dups
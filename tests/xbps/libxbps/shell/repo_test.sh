@@ -22,6 +22,172 @@ repo_close_body() {
 	atf_check_equal $? 2
 }
 
+# Serves the test directory over http on a free port, repositories are
+# only synchronized from remote urls.
+httpd_start() {
+	command -v python3 >/dev/null 2>&1 || atf_skip "python3 is not available"
+	python3 -u -m http.server --bind 127.0.0.1 --directory "$PWD" 0 \
+		>httpd.log 2>&1 &
+	echo $! >httpd.pid
+	for i in $(seq 50); do
+		port=$(sed -n 's/.* port \([0-9]*\) .*/\1/p' httpd.log)
+		[ -n "$port" ] && break
+		sleep 0.1
+	done
+	[ -n "$port" ] || atf_fail "failed to start http server"
+	url="http://127.0.0.1:$port/repo"
+}
+
+httpd_stop() {
+	[ -f httpd.pid ] && kill $(cat httpd.pid) 2>/dev/null
+	return 0
+}
+
+atf_test_case delta_sync cleanup
+
+delta_sync_head() {
+	atf_set "descr" "Tests for pkg repos: sync repodata through a chain of deltas"
+}
+
+delta_sync_body() {
+	mkdir -p repo pkg_A
+	httpd_start
+	cd repo
+	atf_check -o ignore -- xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n B-1.0_1 -s "B pkg" ../pkg_A
+	atf_check -o ignore -- xbps-rindex -a $PWD/A-1.0_1.noarch.xbps $PWD/B-1.0_1.noarch.xbps
+	cd ..
+	atf_check -o ignore -- xbps-install -C empty.conf -r root --repository=$url -S
+	cd repo
+	atf_check -o ignore -- xbps-create -A noarch -n B-1.1_1 -s "B pkg" ../pkg_A
+	atf_check -o ignore -- xbps-rindex -a $PWD/B-1.1_1.noarch.xbps
+	atf_check -o ignore -- xbps-create -A noarch -n C-1.0_1 -s "C pkg" ../pkg_A
+	atf_check -o ignore -- xbps-rindex -a $PWD/C-1.0_1.noarch.xbps
+	atf_check -o ignore -- xbps-rindex -r $PWD
+	cd ..
+	atf_check -o "inline:2\n" -- sh -c 'ls repo/*-repodata.*.delta | wc -l'
+	atf_check -o save:sync.out -e save:sync.err -- \
+		xbps-install -C empty.conf -r root --repository=$url -Sd
+	# both deltas are applied and the repodata is not downloaded again
+	atf_check -o "inline:2\n" -- sh -c 'grep -c "\[reposync\] .*: updated" sync.err'
+	atf_check -s exit:1 -- grep -q -- "-repodata: " sync.out
+	atf_check -o "inline:[-] A-1.0_1 A pkg\n[-] B-1.1_1 B pkg\n[-] C-1.0_1 C pkg\n" -- \
+		xbps-query -C empty.conf -r root --repository=$url -s ''
+	atf_check -o ignore -- xbps-install -C empty.conf -r root --repository=$url -S
+	atf_check -o "inline:[-] A-1.0_1 A pkg\n[-] B-1.1_1 B pkg\n[-] C-1.0_1 C pkg\n" -- \
+		xbps-query -C empty.conf -r root --repository=$url -s ''
+}
+
+delta_sync_cleanup() {
+	httpd_stop
+}
+
+atf_test_case delta_sync_corrupt cleanup
+
+delta_sync_corrupt_head() {
+	atf_set "descr" "Tests for pkg repos: sync repodata with a corrupt delta"
+}
+
+delta_sync_corrupt_body() {
+	mkdir -p repo pkg_A
+	httpd_start
+	cd repo
+	atf_check -o ignore -- xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check -o ignore -- xbps-rindex -a $PWD/A-1.0_1.noarch.xbps
+	# make sure the new repodata is newer than the local copy
+	touch -d "1 hour ago" *-repodata
+	cd ..
+	atf_check -o ignore -- xbps-install -C empty.conf -r root --repository=$url -S
+	cd repo
+	atf_check -o ignore -- xbps-create -A noarch -n B-1.0_1 -s "B pkg" ../pkg_A
+	atf_check -o ignore -- xbps-rindex -a $PWD/B-1.0_1.noarch.xbps
+	echo garbage > $(ls *-repodata.*.delta)
+	cd ..
+	atf_check -o ignore -e save:sync.err -- \
+		xbps-install -C empty.conf -r root --repository=$url -Sd
+	atf_check -- grep -q "failed to apply delta" sync.err
+	atf_check -o "inline:[-] A-1.0_1 A pkg\n[-] B-1.0_1 B pkg\n" -- \
+		xbps-query -C empty.conf -r root --repository=$url -s ''
+}
+
+delta_sync_corrupt_cleanup() {
+	httpd_stop
+}
+
+atf_test_case delta_sync_missing cleanup
+
+delta_sync_missing_head() {
+	atf_set "descr" "Tests for pkg repos: sync repodata with a missing delta"
+}
+
+delta_sync_missing_body() {
+	mkdir -p repo pkg_A
+	httpd_start
+	cd repo
+	atf_check -o ignore -- xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n B-1.0_1 -s "B pkg" ../pkg_A
+	atf_check -o ignore -- xbps-rindex -a $PWD/A-1.0_1.noarch.xbps $PWD/B-1.0_1.noarch.xbps
+	touch -d "1 hour ago" *-repodata
+	cd ..
+	atf_check -o ignore -- xbps-install -C empty.conf -r root --repository=$url -S
+	cd repo
+	atf_check -o ignore -- xbps-create -A noarch -n B-1.1_1 -s "B pkg" ../pkg_A
+	atf_check -o ignore -- xbps-rindex -a $PWD/B-1.1_1.noarch.xbps
+	rm *-repodata.*.delta
+	atf_check -o ignore -- xbps-create -A noarch -n C-1.0_1 -s "C pkg" ../pkg_A
+	atf_check -o ignore -- xbps-rindex -a $PWD/C-1.0_1.noarch.xbps
+	atf_check -o ignore -- xbps-rindex -r $PWD
+	cd ..
+	atf_check -o save:sync.out -e save:sync.err -- \
+		xbps-install -C empty.conf -r root --repository=$url -Sd
+	atf_check -s exit:1 -- grep -q "\[reposync\] .*: updated" sync.err
+	atf_check -- grep -q -- "-repodata: " sync.out
+	atf_check -o "inline:[-] A-1.0_1 A pkg\n[-] B-1.1_1 B pkg\n[-] C-1.0_1 C pkg\n" -- \
+		xbps-query -C empty.conf -r root --repository=$url -s ''
+}
+
+delta_sync_missing_cleanup() {
+	httpd_stop
+}
+
+atf_test_case delta_sync_unpublished cleanup
+
+delta_sync_unpublished_head() {
+	atf_set "descr" "Tests for pkg repos: sync repodata without looking for deltas"
+}
+
+delta_sync_unpublished_body() {
+	mkdir -p repo pkg_A
+	httpd_start
+	cd repo
+	atf_check -o ignore -- xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check -o ignore -- xbps-rindex -a $PWD/A-1.0_1.noarch.xbps
+	touch -d "1 hour ago" *-repodata
+	cd ..
+	atf_check -o ignore -- xbps-install -C empty.conf -r root --repository=$url -S
+	atf_check -o ignore -- sh -c 'ls root/var/db/xbps/*/*-repodata.id'
+	# the local copy is not known to come from a repository with deltas
+	rm root/var/db/xbps/*/*-repodata.id
+	cd repo
+	atf_check -o ignore -- xbps-create -A noarch -n B-1.0_1 -s "B pkg" ../pkg_A
+	atf_check -o ignore -- xbps-rindex -a $PWD/B-1.0_1.noarch.xbps
+	cd ..
+	atf_check -o ignore -e ignore -- \
+		xbps-install -C empty.conf -r root --repository=$url -Sd
+	atf_check -s exit:1 -- grep -q "\.delta" httpd.log
+	atf_check -o ignore -- sh -c 'ls root/var/db/xbps/*/*-repodata.id'
+	atf_check -o "inline:[-] A-1.0_1 A pkg\n[-] B-1.0_1 B pkg\n" -- \
+		xbps-query -C empty.conf -r root --repository=$url -s ''
+}
+
+delta_sync_unpublished_cleanup() {
+	httpd_stop
+}
+
 atf_init_test_cases() {
 	atf_add_test_case repo_close
+	atf_add_test_case delta_sync
+	atf_add_test_case delta_sync_corrupt
+	atf_add_test_case delta_sync_missing
+	atf_add_test_case delta_sync_unpublished
 }
@@ -363,6 +363,43 @@ vpkg_multirepo_body() {
        atf_check_equal "$out" "B-1.0_1"
 }
 
+atf_test_case vpkg_provider_other_repo
+
+vpkg_provider_other_repo_head() {
+	atf_set "descr" "Tests for virtual pkgs: vpkg dependency provided by another repo"
+}
+
+vpkg_provider_other_repo_body() {
+	mkdir empty repo-1 repo-2 repo-3
+
+	cd repo-1
+	xbps-create -n A-1.0_1 -s A -A noarch -D "V>=1.0_1" ../empty
+	atf_check_equal $? 0
+	xbps-create -n C-1.0_1 -s C -A noarch -P V-0.9_1 ../empty
+	atf_check_equal $? 0
+
+	cd ../repo-2
+	xbps-create -n D-1.0_1 -s D -A noarch ../empty
+	atf_check_equal $? 0
+
+	cd ../repo-3
+	xbps-create -n B-1.0_1 -s B -A noarch -P V-1.0_1 ../empty
+	atf_check_equal $? 0
+
+	cd ..
+	xbps-rindex -a repo-1/*.xbps
+	atf_check_equal $? 0
+	xbps-rindex -a repo-2/*.xbps
+	atf_check_equal $? 0
+	xbps-rindex -a repo-3/*.xbps
+	atf_check_equal $? 0
+
+	out="$(xbps-install -r root --repo=repo-1 --repo=repo-2 --repo=repo-3 -n A|awk '{print $1}'|tr '\n' ' ')"
+	atf_check_equal "$out" "B-1.0_1 A-1.0_1 "
+	xbps-install -r root --repo=repo-1 --repo=repo-2 --repo=repo-3 -n W
+	atf_check_equal $? 2
+}
+
 atf_init_test_cases() {
 	atf_add_test_case vpkg_dont_update
 	atf_add_test_case vpkg_replace_provider
@@ -374,4 +411,5 @@ atf_init_test_cases() {
 	atf_add_test_case vpkg_provider_and_revdeps_downgrade
 	atf_add_test_case vpkg_provider_remove
 	atf_add_test_case vpkg_multirepo
+	atf_add_test_case vpkg_provider_other_repo
 }
@@ -175,10 +175,142 @@ show_prop_body() {
 		xbps-query -r root --property pkgver bar-1.0_1
 }
 
+pkgdb_cache_head() {
+	atf_set "descr" "xbps-query(1): pkgdb cache test"
+}
+
+pkgdb_cache_body() {
+	mkdir -p root some_repo other_repo pkg_A pkg_B pkg_C
+	touch pkg_A/file00 pkg_B/file01 pkg_C/file02
+	cd some_repo
+	atf_check -o ignore -- xbps-create -A noarch -n foo-1.0_1 -s "foo pkg" --provides "virt-1.0_1" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n bar-1.0_1 -s "bar pkg" ../pkg_B
+	atf_check -o ignore -- xbps-rindex -a $PWD/*.xbps
+	cd ../other_repo
+	atf_check -o ignore -- xbps-create -A noarch -n baz-1.0_1 -s "baz pkg" --dependencies "virt>=0" ../pkg_C
+	atf_check -o ignore -- xbps-rindex -a $PWD/*.xbps
+	cd ..
+	atf_check -o ignore -- xbps-install -r root --repository=some_repo -y foo
+	# flushing the pkgdb writes the cache
+	atf_check -o ignore -- ls root/var/db/xbps/pkgdb-0.38.plist.cache
+	atf_check -o inline:"foo-1.0_1\n" -- xbps-query -r root -p pkgver foo
+	# the cache is not used once the plist changes
+	atf_check -o ignore -- xbps-install -r root --repository=some_repo -y bar
+	atf_check -o inline:"ii bar-1.0_1 bar pkg\nii foo-1.0_1 foo pkg\n" -- \
+		xbps-query -r root -l
+	# a damaged cache is ignored
+	printf 'garbage' | dd of=root/var/db/xbps/pkgdb-0.38.plist.cache bs=1 seek=200 conv=notrunc 2>/dev/null
+	atf_check -o inline:"ii bar-1.0_1 bar pkg\nii foo-1.0_1 foo pkg\n" -- \
+		xbps-query -r root -l
+	# the virtual package map is read from the cache
+	atf_check -o ignore -- xbps-install -r root --repository=other_repo -y baz
+	atf_check -o inline:"virt>=0\n" -- xbps-query -r root -x baz
+	atf_check -o ignore -- xbps-remove -r root -y baz foo
+	atf_check -o inline:"ii bar-1.0_1 bar pkg\n" -- xbps-query -r root -l
+	# read-only commands do not write the cache
+	rm root/var/db/xbps/pkgdb-0.38.plist.cache
+	atf_check -o inline:"ii bar-1.0_1 bar pkg\n" -- xbps-query -r root -l
+	atf_check -s exit:1 -- test -e root/var/db/xbps/pkgdb-0.38.plist.cache
+}
+
+pkgdb_revdeps_head() {
+	atf_set "descr" "xbps-query(1) -X: reverse dependencies of installed packages"
+}
+
+pkgdb_revdeps_body() {
+	mkdir -p root some_repo pkg_A pkg_B pkg_C pkg_D
+	touch pkg_A/file00 pkg_B/file01 pkg_C/file02 pkg_D/file03
+	cd some_repo
+	atf_check -o ignore -- xbps-create -A noarch -n lib-1.0_1 -s "lib pkg" --provides "virt-1.0_1" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n foo-1.0_1 -s "foo pkg" --dependencies "lib>=0" ../pkg_B
+	atf_check -o ignore -- xbps-create -A noarch -n bar-1.0_1 -s "bar pkg" --dependencies "virt>=0 lib>=1.0" ../pkg_C
+	atf_check -o ignore -- xbps-rindex -a $PWD/*.xbps
+	cd ..
+	atf_check -o ignore -- xbps-install -r root --repository=some_repo -y foo
+	atf_check -o inline:"foo-1.0_1\n" -- xbps-query -r root -X lib
+	# packages installed later are added to the stored map
+	atf_check -o ignore -- xbps-install -r root --repository=some_repo -y bar
+	atf_check -o inline:"bar-1.0_1\nfoo-1.0_1\n" -- xbps-query -r root -X lib
+	cd some_repo
+	atf_check -o ignore -- xbps-create -A noarch -n foo-1.1_1 -s "foo pkg" --dependencies "lib>=0" ../pkg_B
+	atf_check -o ignore -- xbps-create -A noarch -n baz-1.0_1 -s "baz pkg" --dependencies "foo>=0" ../pkg_D
+	atf_check -o ignore -- xbps-rindex -a $PWD/foo-1.1_1.noarch.xbps $PWD/baz-1.0_1.noarch.xbps
+	cd ..
+	atf_check -o ignore -- xbps-install -r root --repository=some_repo -yu foo
+	atf_check -o ignore -- xbps-install -r root --repository=some_repo -y baz
+	atf_check -o inline:"bar-1.0_1\nfoo-1.1_1\n" -- xbps-query -r root -X lib
+	atf_check -o inline:"baz-1.0_1\n" -- xbps-query -r root -X foo
+	atf_check -o ignore -- xbps-remove -r root -y bar
+	atf_check -o inline:"foo-1.1_1\n" -- xbps-query -r root -X lib
+	# same result without the cache
+	rm root/var/db/xbps/pkgdb-0.38.plist.cache
+	atf_check -o inline:"foo-1.1_1\n" -- xbps-query -r root -X lib
+	atf_check -o inline:"baz-1.0_1\n" -- xbps-query -r root -X foo
+}
+
+pkgdb_files_head() {
+	atf_set "descr" "xbps-query(1) -o/-f: files database of installed packages"
+}
+
+pkgdb_files_body() {
+	mkdir -p root some_repo pkg_A pkg_B pkg_C
+	touch pkg_A/file00 pkg_B/file01 pkg_C/file02
+	ln -s file00 pkg_A/link00
+	cd some_repo
+	atf_check -o ignore -- xbps-create -A noarch -n foo-1.0_1 -s "foo pkg" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n bar-1.0_1 -s "bar pkg" ../pkg_B
+	atf_check -o ignore -- xbps-rindex -a $PWD/*.xbps
+	cd ..
+	atf_check -o ignore -- xbps-install -r root --repository=some_repo -y foo bar
+	atf_check -o ignore -- ls root/var/db/xbps/files-0.38.db
+	atf_check -o inline:"foo-1.0_1: /file00 (regular file)\n" -- \
+		xbps-query -r root -o /file00
+	atf_check -o inline:"foo-1.0_1: /link00 -> /file00 (link)\n" -- \
+		xbps-query -r root -o /link00
+	atf_check -o inline:"bar-1.0_1: /file01 (regular file)\nfoo-1.0_1: /file00 (regular file)\n" -- \
+		xbps-query -r root -o "/file0*"
+	atf_check -o inline:"/file01\n" -- xbps-query -r root -f bar
+	# updated packages replace their files
+	rm pkg_A/file00
+	touch pkg_A/file10
+	cd some_repo
+	atf_check -o ignore -- xbps-create -A noarch -n foo-1.1_1 -s "foo pkg" ../pkg_A
+	atf_check -o ignore -- xbps-rindex -a $PWD/foo-1.1_1.noarch.xbps
+	cd ..
+	atf_check -o ignore -- xbps-install -r root --repository=some_repo -yu foo
+	atf_check -o empty -- xbps-query -r root -o /file00
+	atf_check -o inline:"foo-1.1_1: /file10 (regular file)\n" -- \
+		xbps-query -r root -o /file10
+	# packages registered without updating the database are read
+	# from their files plist
+	cp root/var/db/xbps/files-0.38.db files.db
+	cd some_repo
+	atf_check -o ignore -- xbps-create -A noarch -n baz-1.0_1 -s "baz pkg" ../pkg_C
+	atf_check -o ignore -- xbps-rindex -a $PWD/baz-1.0_1.noarch.xbps
+	cd ..
+	atf_check -o ignore -- xbps-install -r root --repository=some_repo -y baz
+	atf_check -o ignore -- xbps-remove -r root -y foo
+	cp files.db root/var/db/xbps/files-0.38.db
+	atf_check -o inline:"baz-1.0_1: /file02 (regular file)\n" -- \
+		xbps-query -r root -o /file02
+	atf_check -o empty -- xbps-query -r root -o /file10
+	# queries do not write the database
+	atf_check -- cmp files.db root/var/db/xbps/files-0.38.db
+	# same result without the database
+	rm root/var/db/xbps/files-0.38.db
+	atf_check -o inline:"baz-1.0_1: /file02 (regular file)\n" -- \
+		xbps-query -r root -o /file02
+	atf_check -o inline:"/file01\n" -- xbps-query -r root -f bar
+	atf_check -s exit:1 -- test -e root/var/db/xbps/files-0.38.db
+}
+
 atf_init_test_cases() {
 	atf_add_test_case cat_file
 	atf_add_test_case repo_cat_file
 	atf_add_test_case search
 	atf_add_test_case search_prop
 	atf_add_test_case show_prop
+	atf_add_test_case pkgdb_cache
+	atf_add_test_case pkgdb_revdeps
+	atf_add_test_case pkgdb_files
 }
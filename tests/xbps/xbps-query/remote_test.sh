@@ -23,6 +23,41 @@ remote_files_body() {
 	atf_check_equal $? 2
 }
 
+atf_test_case repodata_cache
+
+repodata_cache_head() {
+	atf_set "descr" "xbps-query(1) -R: synchronized repodata cache test"
+}
+
+repodata_cache_body() {
+	repo=https://localhost/some_repo
+	repodir=root/var/db/xbps/https___localhost_some_repo
+	mkdir -p some_repo pkg_A $repodir
+	touch pkg_A/file00
+	cd some_repo
+	atf_check -o ignore -- xbps-create -A noarch -n foo-1.0_1 -s "foo pkg" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n bar-1.0_1 -s "bar pkg" ../pkg_A
+	atf_check -o ignore -- xbps-rindex -a $PWD/*.xbps
+	cd ..
+	cp some_repo/*-repodata $repodir
+	atf_check -o "inline:[-] bar-1.0_1 bar pkg\n[-] foo-1.0_1 foo pkg\n" -e empty -- \
+		xbps-query -r root -C empty.conf --repository=$repo -Rs ''
+	atf_check -o ignore -- ls $repodir/*-repodata.cache
+	atf_check -o "inline:[-] bar-1.0_1 bar pkg\n[-] foo-1.0_1 foo pkg\n" -e empty -- \
+		xbps-query -r root -C empty.conf --repository=$repo -Rs ''
+	# the cache is not used once the repodata changes
+	cd some_repo
+	atf_check -o ignore -- xbps-create -A noarch -n foo-1.1_1 -s "foo pkg" ../pkg_A
+	atf_check -o ignore -- xbps-rindex -a $PWD/foo-1.1_1.noarch.xbps
+	cd ..
+	cp some_repo/*-repodata $repodir
+	atf_check -o "inline:[-] bar-1.0_1 bar pkg\n[-] foo-1.1_1 foo pkg\n" -e empty -- \
+		xbps-query -r root -C empty.conf --repository=$repo -Rs ''
+	atf_check -o "inline:foo-1.1_1\n" -e empty -- \
+		xbps-query -r root -C empty.conf --repository=$repo -R --property=pkgver foo
+}
+
 atf_init_test_cases() {
 	atf_add_test_case remote_files
+	atf_add_test_case repodata_cache
 }
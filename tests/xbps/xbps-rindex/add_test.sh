@@ -194,10 +194,117 @@ stage_stacked_body() {
 
 }
 
+atf_test_case lookup_index
+
+lookup_index_head() {
+	atf_set "descr" "xbps-rindex(1) -a: packages are found through the lookup index"
+}
+
+lookup_index_body() {
+	mkdir -p some_repo pkg_A
+	touch pkg_A/file00
+	cd some_repo
+	for p in foo-1.0_1 bar-2.0_1 baz-1.2_3; do
+		atf_check -o ignore -- xbps-create -A noarch -n ${p} -s "${p%%-*} pkg" --provides "virt-${p%%-*}-1_1" ../pkg_A
+	done
+	atf_check -o ignore -- xbps-rindex -a $PWD/*.xbps
+	atf_check -o ignore -- xbps-create -A noarch -n foo-1.1_1 -s "foo pkg" ../pkg_A
+	atf_check -o ignore -- xbps-rindex -a $PWD/foo-1.1_1.noarch.xbps
+	cd ..
+	atf_check -o "inline:[-] bar-2.0_1 bar pkg\n[-] baz-1.2_3 baz pkg\n[-] foo-1.1_1 foo pkg\n" -e empty -- \
+		xbps-query -r root -C empty.conf --repository=some_repo -Rs ''
+	atf_check -o "inline:baz-1.2_3\n" -e empty -- \
+		xbps-query -r root -C empty.conf --repository=some_repo -R --property=pkgver baz
+	atf_check -o "inline:bar-2.0_1\n" -e empty -- \
+		xbps-query -r root -C empty.conf --repository=some_repo -R --property=pkgver virt-bar
+	atf_check -s exit:2 -o empty -e empty -- \
+		xbps-query -r root -C empty.conf --repository=some_repo -R --property=pkgver virt-foo
+}
+
+atf_test_case provides_index
+
+provides_index_head() {
+	atf_set "descr" "xbps-rindex(1) -a: virtual packages are found through the provides map"
+}
+
+provides_index_body() {
+	mkdir -p some_repo pkg_A
+	touch pkg_A/file00
+	cd some_repo
+	atf_check -o ignore -- xbps-create -A noarch -n A-1.0_1 -s "A pkg" --provides "V-1_1" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n B-1.0_1 -s "B pkg" --provides "V-2_1 W-1_1" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n C-1.0_1 -s "C pkg" --provides "W-2_1" ../pkg_A
+	atf_check -o ignore -- xbps-rindex --compression none -a $PWD/*.xbps
+	cd ..
+	atf_check -o match:index-provides.plist -- tar -tf some_repo/*-repodata
+	atf_check -o "inline:A-1.0_1\n" -e empty -- \
+		xbps-query -r root -C empty.conf --repository=some_repo -R --property=pkgver V
+	atf_check -o "inline:B-1.0_1\n" -e empty -- \
+		xbps-query -r root -C empty.conf --repository=some_repo -R --property=pkgver 'V>=2'
+	atf_check -o "inline:C-1.0_1\n" -e empty -- \
+		xbps-query -r root -C empty.conf --repository=some_repo -R --property=pkgver W-2_1
+	atf_check -s exit:2 -o empty -e empty -- \
+		xbps-query -r root -C empty.conf --repository=some_repo -R --property=pkgver X
+}
+
+atf_test_case revdeps_index
+
+revdeps_index_head() {
+	atf_set "descr" "xbps-rindex(1) -a: reverse dependencies are found through the revdeps map"
+}
+
+revdeps_index_body() {
+	mkdir -p some_repo pkg_A
+	touch pkg_A/file00
+	cd some_repo
+	atf_check -o ignore -- xbps-create -A noarch -n A-1.0_1 -s "A pkg" --provides "V-1_1" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n B-1.0_1 -s "B pkg" --dependencies "A>=0" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n C-1.0_1 -s "C pkg" --dependencies "V>=1" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n D-1.0_1 -s "D pkg" --dependencies "A-[0-9]*" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n E-1.0_1 -s "E pkg" --dependencies "B>=0" ../pkg_A
+	atf_check -o ignore -- xbps-rindex --compression none -a $PWD/*.xbps
+	cd ..
+	atf_check -o match:index-revdeps.plist -- tar -tf some_repo/*-repodata
+	atf_check -o "inline:B-1.0_1\nC-1.0_1\nD-1.0_1\n" -e empty -- \
+		xbps-query -r root -C empty.conf --repository=some_repo -RX A
+	atf_check -o "inline:C-1.0_1\n" -e empty -- \
+		xbps-query -r root -C empty.conf --repository=some_repo -RX V
+	atf_check -o "inline:E-1.0_1\n" -e empty -- \
+		xbps-query -r root -C empty.conf --repository=some_repo -RX B
+	atf_check -s exit:2 -o empty -e empty -- \
+		xbps-query -r root -C empty.conf --repository=some_repo -RX E
+}
+
+atf_test_case delta
+
+delta_head() {
+	atf_set "descr" "xbps-rindex(1) -a: a delta from the previous repodata is written"
+}
+
+delta_body() {
+	mkdir -p some_repo pkg_A
+	touch pkg_A/file00
+	cd some_repo
+	atf_check -o ignore -- xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n B-1.0_1 -s "B pkg" ../pkg_A
+	atf_check -o ignore -- xbps-rindex --compression none -a $PWD/A-1.0_1.noarch.xbps $PWD/B-1.0_1.noarch.xbps
+	atf_check -o ignore -- xbps-create -A noarch -n B-1.1_1 -s "B pkg" ../pkg_A
+	atf_check -o ignore -- xbps-rindex --compression none -a $PWD/B-1.1_1.noarch.xbps
+	cd ..
+	atf_check -o "inline:1\n" -- sh -c 'ls some_repo/*-repodata.*.delta | wc -l'
+	atf_check -o "inline:delta.plist\n" -- tar -tf some_repo/*.delta
+	atf_check -o match:B-1.1_1 -- tar -xOf some_repo/*.delta delta.plist
+	atf_check -o not-match:A-1.0_1 -- tar -xOf some_repo/*.delta delta.plist
+}
+
 atf_init_test_cases() {
 	atf_add_test_case update
 	atf_add_test_case revert
 	atf_add_test_case stage
 	atf_add_test_case stage_resolve_bug
 	atf_add_test_case stage_stacked
+	atf_add_test_case lookup_index
+	atf_add_test_case provides_index
+	atf_add_test_case revdeps_index
+	atf_add_test_case delta
 }